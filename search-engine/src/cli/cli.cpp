@@ -1,8 +1,18 @@
 #include "cli.hpp"
+#include <chrono>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <string>
 
-int CLI::run(SearchEngine& engine) {
+// `limit` 0 only counts the matches
+using SearchFn = std::function<SearchResponse(const std::string& q, size_t limit)>;
+// EXPLAIN ANALYZE as text; only with a local engine
+using ExplainFn = std::function<std::string(const std::string& q)>;
+// "more like this" as text; only with a local engine
+using SimilarFn = std::function<std::string(const std::string& url)>;
+
+static int repl(const SearchFn& search, const ExplainFn& explain = nullptr, const SimilarFn& similar = nullptr) {
     std::ios::sync_with_stdio(false);
     std::cin.tie(nullptr);
 
@@ -14,9 +24,31 @@ int CLI::run(SearchEngine& engine) {
         if (line.empty()) continue;
 
         try {
-            auto results = engine.search(line, 50);
+            // commands start with ':', which no query does
+            if (line.rfind(":count ", 0) == 0) {
+                const uint64_t total = search(line.substr(7), 0).total;
+                std::cout << "Count: " << total << "\n";
+                continue;
+            }
+            if (explain && line.rfind(":explain ", 0) == 0) {
+                const std::string text = explain(line.substr(9));
+                std::cout << text;
+                continue;
+            }
+            if (similar && line.rfind(":similar ", 0) == 0) {
+                const std::string text = similar(line.substr(9));
+                std::cout << text;
+                continue;
+            }
+            SearchResponse resp = search(line, 50);
+            const auto& results = resp.results;
             std::cout << "Query: " << line << "\n";
-            std::cout << "Found: " << results.size() << " documents\n";
+            std::cout << "Found: " << resp.total << " documents\n";
+            if (resp.partial) {
+                std::cout << "Partial results:";
+                for (const auto& e : resp.errors) std::cout << " " << e << ";";
+                std::cout << "\n";
+            }
             for (size_t i = 0; i < results.size(); ++i) {
                 std::cout << (i + 1) << ". " << results[i].url << "\n";
             }
@@ -26,3 +58,107 @@ int CLI::run(SearchEngine& engine) {
     }
     return 0;
 }
+
+int CLI::run(SearchEngine& engine) {
+    return repl([&engine](const std::string& q, size_t limit) {
+        if (limit == 0) {
+            SearchResponse resp;
+            resp.total = engine.count(q);
+            return resp;
+        }
+        return engine.execute(q, limit);
+    }, [&engine](const std::string& q) {
+        QueryExplain ex;
+        const SearchResponse resp = engine.execute(q, 50, 0, &ex);
+        return "Found: " + std::to_string(resp.total) + " documents\n" + ex.toText();
+    }, [&engine](const std::string& url) {
+        std::string out;
+        const std::vector<SimilarDoc> found = engine.similar(url, 10);
+        for (size_t i = 0; i < found.size(); ++i) {
+            out += std::to_string(i + 1) + ". " + found[i].result.url + "  " + std::to_string(found[i].score) + "\n";
+        }
+        return out.empty() ? "No similar documents\n" : out;
+    });
+}
+
+int CLI::run(ShardCoordinator& coordinator) {
+    return repl([&coordinator](const std::string& q, size_t limit) {
+        return coordinator.search(q, limit);
+    });
+}
+
+int CLI::runBatch(SearchEngine& engine, const std::string& path) {
+    std::ifstream f(path);
+    if (!f) {
+        std::cerr << "Cannot open batch file: " << path << "\n";
+        return 1;
+    }
+    std::vector<std::string> queries;
+    std::string line;
+    while (std::getline(f, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty()) queries.push_back(line);
+    }
+
+    std::ios::sync_with_stdio(false);
+    auto t0 = std::chrono::steady_clock::now();
+
+    engine.searchBatch(queries, 50, [](size_t, const BatchItem& item) {
+        std::cout << "Query: " << item.query << "\n";
+        if (!item.error.empty()) {
+            std::cout << "Error: " << item.error << "\n";
+            return;
+        }
+        const auto& results = item.response.results;
+        std::cout << "Found: " << item.response.total << " documents\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            std::cout << (i + 1) << ". " << results[i].url << "\n";
+        }
+    });
+    std::cout << std::flush;
+
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::cerr << "Batch: " << queries.size() << " queries in " << sec * 1000.0 << " ms ("
+              << (sec > 0 ? (double)queries.size() / sec : 0.0) << " q/s)\n";
+    return 0;
+}
+
+int CLI::runPruneRecall(const SearchEngine& full, const SearchEngine& pruned, const std::string& path) {
+    std::ifstream f(path);
+    if (!f) {
+        std::cerr << "Cannot open query file: " << path << "\n";
+        return 1;
+    }
+    uint64_t queries = 0, failed = 0, complete = 0, emptied = 0;
+    uint64_t full_total = 0, pruned_total = 0, shared_total = 0;
+    double recall_sum = 0.0;
+    std::string line;
+    while (std::getline(f, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+        PostingList a, b;
+        try {
+            a = full.matches(line);
+            b = pruned.matches(line);
+        } catch (const std::exception&) {
+            ++failed;
+            continue;
+        }
+        if (a.size() == 0) continue;   // nothing to recall
+        const uint64_t shared = PostingList::AndCount(a, b);
+        ++queries;
+        full_total += a.size();
+        pruned_total += b.size();
+        shared_total += shared;
+        recall_sum += (double)shared / (double)a.size();
+        complete += shared == a.size();
+        emptied += b.size() == 0;
+    }
+    const auto ratio = [](uint64_t x, uint64_t y) { return y ? (double)x / (double)y : 1.0; };
+    std::cout << "Prune recall over " << queries << " queries with matches (" << failed << " failed to parse)\n"
+              << "  matches: full " << full_total << ", pruned " << pruned_total << ", shared " << shared_total
+              << "\n  recall " << ratio(shared_total, full_total) << " (per query mean "
+              << (queries ? recall_sum / (double)queries : 1.0) << "), precision " << ratio(shared_total, pruned_total)
+              << "\n  complete " << complete << ", emptied " << emptied << "\n";
+    return 0;
+}
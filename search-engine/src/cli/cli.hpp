@@ -1,7 +1,16 @@
 #pragma once
 #include "../search/search_engine.hpp"
+#include "../coordinator/shard_coordinator.hpp"
 
 class CLI {
 public:
     static int run(SearchEngine& engine);
+    static int run(ShardCoordinator& coordinator);
+
+    // Answers every line of `path` through SearchEngine::searchBatch.
+    static int runBatch(SearchEngine& engine, const std::string& path);
+
+    // Recall and precision of the matches of `pruned` against those of
+    // `full` (same documents, unpruned) over the queries in `path`.
+    static int runPruneRecall(const SearchEngine& full, const SearchEngine& pruned, const std::string& path);
 };
@@ -0,0 +1,289 @@
+#include "shard_coordinator.hpp"
+#include "../web/json.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+
+#include <httplib.h>
+
+namespace {
+
+struct ShardReply {
+    bool ok = false;
+    bool partial = false;
+    uint64_t total = 0;
+    std::string error;
+    std::vector<SearchResult> hits;   // sorted by global_id
+    std::vector<FacetCount> hosts;
+};
+
+std::string url_encode(const std::string& s) {
+    static const char* hex = "0123456789ABCDEF";
+    std::string out;
+    out.reserve(s.size() * 3);
+    for (unsigned char c : s) {
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+            c == '-' || c == '_' || c == '.' || c == '~') {
+            out.push_back(static_cast<char>(c));
+        } else {
+            out.push_back('%');
+            out.push_back(hex[c >> 4]);
+            out.push_back(hex[c & 15]);
+        }
+    }
+    return out;
+}
+
+void parse_reply(const std::string& body, ShardReply& reply) {
+    json::Value v = json::parse(body);
+    if (const json::Value* p = v.get("partial"); p && p->type == json::Value::Type::Bool) {
+        reply.partial = p->boolean;
+    }
+    if (const json::Value* t = v.get("total"); t && t->type == json::Value::Type::Number) {
+        reply.total = static_cast<uint64_t>(t->number);
+    }
+    const json::Value* res = v.get("results");
+    if (!res || res->type != json::Value::Type::Array) {
+        throw std::runtime_error("response has no results array");
+    }
+    reply.hits.reserve(res->array.size());
+    for (const auto& r : res->array) {
+        SearchResult sr;
+        if (const json::Value* x = r.get("id")) sr.global_id = static_cast<int64_t>(x->number);
+        if (const json::Value* x = r.get("url")) sr.url = x->string;
+        if (const json::Value* x = r.get("snippet")) sr.snippet = x->string;
+        reply.hits.push_back(std::move(sr));
+    }
+    const json::Value* facets = v.get("facets");
+    const json::Value* hosts = facets ? facets->get("host") : nullptr;
+    if (hosts && hosts->type == json::Value::Type::Array) {
+        for (const auto& f : hosts->array) {
+            FacetCount fc;
+            if (const json::Value* x = f.get("value")) fc.value = x->string;
+            if (const json::Value* x = f.get("count")) fc.count = static_cast<uint64_t>(x->number);
+            reply.hosts.push_back(std::move(fc));
+        }
+    }
+}
+
+} // namespace
+
+struct ShardCoordinator::Shard {
+    ShardEndpoint ep;
+    int timeout_ms = 500;
+    size_t max_idle = 16;
+    size_t max_in_flight = 16;
+
+    std::mutex mu;
+    std::vector<std::unique_ptr<httplib::Client>> idle;
+    size_t in_flight = 0;
+
+    // A slow shard holds its slots until its requests time out; queries
+    // past the cap skip it instead of piling up behind it.
+    bool admit() {
+        std::lock_guard<std::mutex> lk(mu);
+        if (in_flight >= max_in_flight) return false;
+        ++in_flight;
+        return true;
+    }
+
+    void finish() {
+        std::lock_guard<std::mutex> lk(mu);
+        --in_flight;
+    }
+
+    std::unique_ptr<httplib::Client> acquire() {
+        {
+            std::lock_guard<std::mutex> lk(mu);
+            if (!idle.empty()) {
+                auto c = std::move(idle.back());
+                idle.pop_back();
+                return c;
+            }
+        }
+        auto c = std::make_unique<httplib::Client>(ep.host, ep.port);
+        c->set_keep_alive(true);
+        c->set_connection_timeout(timeout_ms / 1000, (timeout_ms % 1000) * 1000);
+        c->set_read_timeout(timeout_ms / 1000, (timeout_ms % 1000) * 1000);
+        c->set_write_timeout(timeout_ms / 1000, (timeout_ms % 1000) * 1000);
+        return c;
+    }
+
+    void release(std::unique_ptr<httplib::Client> c) {
+        std::lock_guard<std::mutex> lk(mu);
+        if (idle.size() < max_idle) idle.push_back(std::move(c));
+    }
+
+    ShardReply query(const std::string& path) {
+        ShardReply reply;
+        auto client = acquire();
+        auto res = client->Get(path);
+        if (!res) {
+            // broken connection: do not return it to the pool
+            reply.error = ep.name() + ": " + httplib::to_string(res.error());
+            return reply;
+        }
+        if (res->status != 200) {
+            reply.error = ep.name() + ": HTTP " + std::to_string(res->status);
+            release(std::move(client));
+            return reply;
+        }
+        try {
+            parse_reply(res->body, reply);
+            reply.ok = true;
+        } catch (const std::exception& e) {
+            reply.error = ep.name() + ": " + e.what();
+        }
+        release(std::move(client));
+        return reply;
+    }
+};
+
+// Shared between the waiting caller and the pool tasks, so a shard that
+// misses the deadline can still finish and drop its reply safely.
+struct ShardCoordinator::Gather {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::vector<ShardReply> replies;
+    std::vector<bool> done;
+    size_t pending = 0;
+};
+
+ShardCoordinator::ShardCoordinator(CoordinatorConfig cfg)
+    : cfg_(std::move(cfg)) {
+    for (const auto& ep : cfg_.shards) {
+        auto sh = std::make_shared<Shard>();
+        sh->ep = ep;
+        sh->timeout_ms = cfg_.timeout_ms;
+        sh->max_idle = cfg_.max_idle_connections;
+        sh->max_in_flight = std::max<size_t>(1, cfg_.max_in_flight);
+        shards_.push_back(std::move(sh));
+    }
+    if (!shards_.empty()) pool_ = std::make_unique<ThreadPool>(shards_.size() * shards_.front()->max_in_flight);
+}
+
+ShardCoordinator::~ShardCoordinator() = default;
+
+bool ShardCoordinator::parseShardList(const std::string& spec, std::vector<ShardEndpoint>& out,
+                                      std::string* err) {
+    out.clear();
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t comma = spec.find(',', start);
+        std::string item = spec.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        if (!item.empty()) {
+            size_t colon = item.rfind(':');
+            if (colon == std::string::npos || colon == 0 || colon + 1 == item.size()) {
+                if (err) *err = "Bad shard address (want host:port): " + item;
+                return false;
+            }
+            ShardEndpoint ep;
+            ep.host = item.substr(0, colon);
+            try {
+                ep.port = std::stoi(item.substr(colon + 1));
+            } catch (const std::exception&) {
+                if (err) *err = "Bad shard port: " + item;
+                return false;
+            }
+            out.push_back(std::move(ep));
+        }
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    if (out.empty()) {
+        if (err) *err = "No shards given";
+        return false;
+    }
+    return true;
+}
+
+SearchResponse ShardCoordinator::search(const std::string& query, size_t max_results, size_t facets) const {
+    SearchResponse out;
+    if (shards_.empty()) return out;
+
+    std::string path = "/api/search?q=" + url_encode(query) + "&limit=" + std::to_string(max_results);
+    if (facets) path += "&facets=" + std::to_string(facets);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(cfg_.timeout_ms);
+
+    auto g = std::make_shared<Gather>();
+    g->replies.resize(shards_.size());
+    g->done.assign(shards_.size(), false);
+    g->pending = shards_.size();
+
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        const std::shared_ptr<Shard>& sh = shards_[i];
+        if (!sh->admit()) {
+            std::lock_guard<std::mutex> lk(g->mu);
+            g->replies[i].error = sh->ep.name() + ": too many requests in flight";
+            g->done[i] = true;
+            --g->pending;
+            continue;
+        }
+        pool_->submit([g, sh, i, path] {
+            ShardReply r = sh->query(path);
+            sh->finish();
+            std::lock_guard<std::mutex> lk(g->mu);
+            g->replies[i] = std::move(r);
+            g->done[i] = true;
+            if (--g->pending == 0) g->cv.notify_all();
+        });
+    }
+
+    std::vector<ShardReply> replies(shards_.size());
+    {
+        std::unique_lock<std::mutex> lk(g->mu);
+        g->cv.wait_until(lk, deadline, [&] { return g->pending == 0; });
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            if (!g->done[i]) {
+                replies[i].error = shards_[i]->ep.name() + ": timed out";
+            } else {
+                replies[i] = std::move(g->replies[i]);
+            }
+        }
+    }
+
+    // k-way merge of the per-shard lists by global id
+    struct Cursor { int64_t key; size_t shard; size_t pos; };
+    auto later = [](const Cursor& a, const Cursor& b) { return a.key > b.key; };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> heap(later);
+
+    for (size_t i = 0; i < replies.size(); ++i) {
+        const ShardReply& r = replies[i];
+        if (!r.ok) {
+            out.partial = true;
+            out.errors.push_back(r.error);
+            continue;
+        }
+        if (r.partial) out.partial = true;
+        out.total += r.total;
+        if (!r.hits.empty()) heap.push({r.hits[0].global_id, i, 0});
+    }
+
+    if (facets) {
+        std::map<std::string, uint64_t> sums;
+        for (const ShardReply& r : replies) {
+            for (const FacetCount& f : r.hosts) sums[f.value] += f.count;
+        }
+        for (auto& [value, count] : sums) out.hosts.push_back({value, count});
+        const size_t top = std::min(facets, out.hosts.size());
+        std::partial_sort(out.hosts.begin(), out.hosts.begin() + top, out.hosts.end(),
+                          [](const FacetCount& a, const FacetCount& b) {
+                              return a.count != b.count ? a.count > b.count : a.value < b.value;
+                          });
+        out.hosts.resize(top);
+    }
+
+    out.results.reserve(max_results);
+    while (!heap.empty() && out.results.size() < max_results) {
+        Cursor c = heap.top();
+        heap.pop();
+        auto& hits = replies[c.shard].hits;
+        out.results.push_back(std::move(hits[c.pos]));
+        if (++c.pos < hits.size()) heap.push({hits[c.pos].global_id, c.shard, c.pos});
+    }
+    return out;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../document.hpp"
+#include "../structures/thread_pool.hpp"
+
+struct ShardEndpoint {
+    std::string host;
+    int port = 0;
+
+    std::string name() const { return host + ":" + std::to_string(port); }
+};
+
+struct CoordinatorConfig {
+    std::vector<ShardEndpoint> shards;
+    int timeout_ms = 500;               // per-shard budget for one query
+    size_t max_idle_connections = 16;   // kept-alive clients per shard
+    size_t max_in_flight = 16;          // requests per shard at once; beyond it the shard is skipped
+};
+
+// Scatter-gather front for document-partitioned shards. Every shard is a
+// normal `--web` server started with `--shard i/N`; the coordinator sends
+// the query to all of them over /api/search, merges the doc lists by
+// global id and answers with whatever arrived before the deadline.
+class ShardCoordinator {
+public:
+    explicit ShardCoordinator(CoordinatorConfig cfg);
+    ~ShardCoordinator();
+
+    ShardCoordinator(const ShardCoordinator&) = delete;
+    ShardCoordinator& operator=(const ShardCoordinator&) = delete;
+
+    // "host:port,host:port,..."
+    static bool parseShardList(const std::string& spec, std::vector<ShardEndpoint>& out,
+                               std::string* err = nullptr);
+
+    // Host facets are the sums of each shard's top `facets` hosts, so a host
+    // that misses some shard's top list is undercounted there.
+    SearchResponse search(const std::string& query, size_t max_results = 50, size_t facets = 0) const;
+
+    size_t shardCount() const { return shards_.size(); }
+
+private:
+    struct Shard;
+    struct Gather;
+
+    CoordinatorConfig cfg_;
+    std::vector<std::shared_ptr<Shard>> shards_;
+    // max_in_flight workers per shard, so an admitted request never queues;
+    // declared last so it is joined before the shards go away
+    std::unique_ptr<ThreadPool> pool_;
+};
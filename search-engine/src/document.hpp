@@ -1,8 +1,11 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <vector>
 
 struct Document {
     int id = -1;
+    int64_t global_id = -1;    // position in the unsharded source; merge key across shards
     std::string html;          // raw HTML
     std::string url;
     std::string crawled_at;
@@ -14,4 +17,18 @@ struct Document {
 struct SearchResult {
     std::string url;
     std::string snippet;
+    int64_t global_id = -1;
+};
+
+struct FacetCount {
+    std::string value;
+    uint64_t count = 0;
+};
+
+struct SearchResponse {
+    std::vector<SearchResult> results;
+    uint64_t total = 0;                // all matching documents (of the part searched when partial)
+    std::vector<FacetCount> hosts;     // top hosts over all matches, when requested
+    bool partial = false;              // part of the corpus was not searched
+    std::vector<std::string> errors;   // why the response is partial
 };
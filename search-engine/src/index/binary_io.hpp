@@ -0,0 +1,145 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Sequential, buffered binary files for the on-disk index: raw bytes and
+// LEB128 varints. Both sides stream through a fixed buffer (1 MiB by default).
+class BinaryWriter {
+public:
+    explicit BinaryWriter(size_t buffer = 1 << 20) : buf_(buffer) {}
+    ~BinaryWriter() { close(); }
+
+    BinaryWriter(const BinaryWriter&) = delete;
+    BinaryWriter& operator=(const BinaryWriter&) = delete;
+
+    bool open(const std::string& path) {
+        close();
+        f_ = std::fopen(path.c_str(), "wb");
+        ok_ = f_ != nullptr;
+        written_ = 0;
+        return ok_;
+    }
+
+    // flushes and closes; false if any write failed
+    bool close() {
+        if (!f_) return ok_;
+        flush_();
+        if (std::fclose(f_) != 0) ok_ = false;
+        f_ = nullptr;
+        return ok_;
+    }
+
+    void putBytes(const void* p, size_t n) {
+        const char* s = static_cast<const char*>(p);
+        written_ += n;
+        while (n) {
+            if (used_ == buf_.size()) flush_();
+            size_t k = std::min(n, buf_.size() - used_);
+            std::memcpy(buf_.data() + used_, s, k);
+            used_ += k;
+            s += k;
+            n -= k;
+        }
+    }
+
+    void putVarint(uint64_t v) {
+        uint8_t tmp[10];
+        size_t n = 0;
+        while (v >= 0x80) {
+            tmp[n++] = (uint8_t)(v | 0x80);
+            v >>= 7;
+        }
+        tmp[n++] = (uint8_t)v;
+        putBytes(tmp, n);
+    }
+
+    static size_t varintSize(uint64_t v) {
+        size_t n = 1;
+        while (v >= 0x80) { v >>= 7; ++n; }
+        return n;
+    }
+
+    uint64_t written() const { return written_; }
+    bool ok() const { return ok_; }
+
+private:
+    std::FILE* f_ = nullptr;
+    std::vector<char> buf_;
+    size_t used_ = 0;
+    uint64_t written_ = 0;
+    bool ok_ = false;
+
+    void flush_() {
+        if (used_ && std::fwrite(buf_.data(), 1, used_, f_) != used_) ok_ = false;
+        used_ = 0;
+    }
+};
+
+class BinaryReader {
+public:
+    explicit BinaryReader(size_t buffer = 1 << 20) : buf_(buffer) {}
+    ~BinaryReader() { if (f_) std::fclose(f_); }
+
+    BinaryReader(const BinaryReader&) = delete;
+    BinaryReader& operator=(const BinaryReader&) = delete;
+
+    bool open(const std::string& path) {
+        if (f_) std::fclose(f_);
+        f_ = std::fopen(path.c_str(), "rb");
+        pos_ = len_ = 0;
+        return f_ != nullptr;
+    }
+
+    bool getBytes(void* p, size_t n) {
+        char* d = static_cast<char*>(p);
+        while (n) {
+            if (pos_ == len_ && !fill_()) return false;
+            size_t k = std::min(n, len_ - pos_);
+            std::memcpy(d, buf_.data() + pos_, k);
+            pos_ += k;
+            d += k;
+            n -= k;
+        }
+        return true;
+    }
+
+    bool getVarint(uint64_t& v) {
+        v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos_ == len_ && !fill_()) return false;
+            const uint8_t b = (uint8_t)buf_[pos_++];
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+
+    // streams n bytes straight into `out` without decoding them
+    bool copyTo(BinaryWriter& out, uint64_t n) {
+        while (n) {
+            if (pos_ == len_ && !fill_()) return false;
+            size_t k = (size_t)std::min<uint64_t>(n, len_ - pos_);
+            out.putBytes(buf_.data() + pos_, k);
+            pos_ += k;
+            n -= k;
+        }
+        return true;
+    }
+
+private:
+    std::FILE* f_ = nullptr;
+    std::vector<char> buf_;
+    size_t pos_ = 0;
+    size_t len_ = 0;
+
+    bool fill_() {
+        if (!f_) return false;
+        len_ = std::fread(buf_.data(), 1, buf_.size(), f_);
+        pos_ = 0;
+        return len_ > 0;
+    }
+};
@@ -0,0 +1,149 @@
+#include "build_profile.hpp"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+const char* BuildProfile::stageName(BuildStage s) {
+    switch (s) {
+        case BuildStage::Load:            return "load";
+        case BuildStage::Extract:         return "extract";
+        case BuildStage::Dedup:           return "dedup";
+        case BuildStage::Stem:            return "stem";
+        case BuildStage::DictInsert:      return "dict_insert";
+        case BuildStage::PostingAppend:   return "posting_append";
+        case BuildStage::Finalize:        return "finalize";
+        case BuildStage::Reorder:         return "reorder";
+        case BuildStage::Prune:           return "prune";
+        case BuildStage::Freeze:          return "freeze";
+        default:                          return "?";
+    }
+}
+
+uint64_t BuildProfile::peakRssKb() {
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage ru {};
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#if defined(__APPLE__)
+    return (uint64_t)ru.ru_maxrss / 1024; // bytes on macOS
+#else
+    return (uint64_t)ru.ru_maxrss;        // kilobytes on Linux
+#endif
+#else
+    return 0;
+#endif
+}
+
+uint64_t BuildProfile::currentRssKb() {
+#if defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    uint64_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident)) return 0;
+    return resident * (uint64_t)sysconf(_SC_PAGESIZE) / 1024;
+#else
+    return 0;
+#endif
+}
+
+void BuildProfile::print(std::ostream& os) const {
+    uint64_t staged = 0;
+    for (size_t i = 1; i < stages.size(); ++i) staged += stages[i].nanos; // load is outside build
+
+    std::ostream out(os.rdbuf());
+    out << std::fixed;
+    out << "Index build profile\n";
+    out << "  " << std::left << std::setw(18) << "stage"
+        << std::right << std::setw(12) << "ms"
+        << std::setw(8) << "%"
+        << std::setw(12) << "MB/s"
+        << std::setw(14) << "docs/s" << "\n";
+
+    for (size_t i = 0; i < stages.size(); ++i) {
+        const StageTiming& t = stages[i];
+        double pct = (i > 0 && staged) ? 100.0 * (double)t.nanos / (double)staged : 0.0;
+        out << "  " << std::left << std::setw(18) << stageName((BuildStage)i)
+            << std::right << std::setprecision(3) << std::setw(12) << (double)t.nanos / 1e6
+            << std::setprecision(1) << std::setw(8) << pct
+            << std::setprecision(2) << std::setw(12) << t.mb_per_sec()
+            << std::setprecision(0) << std::setw(14) << t.docs_per_sec() << "\n";
+    }
+    out << "  build total: " << std::setprecision(3) << (double)total_nanos / 1e6 << " ms"
+        << " (untracked " << (double)(total_nanos > staged ? total_nanos - staged : 0) / 1e6 << " ms)\n";
+    out << "  peak RSS: " << peak_rss_kb / 1024 << " MiB";
+    if (final_rss_kb) out << ", after freeze: " << final_rss_kb / 1024 << " MiB";
+    out << "\n";
+
+    if (!reorder.empty()) {
+        out << "  doc reorder (" << reorder << "): avg gap " << std::setprecision(1) << gaps_before.avg_gap
+            << " -> " << gaps_after.avg_gap << ", " << std::setprecision(2) << gaps_before.avg_gap_bits
+            << " -> " << gaps_after.avg_gap_bits << " bits/gap, postings "
+            << std::setprecision(1) << (double)gaps_before.posting_bytes / (1024.0 * 1024.0) << " -> "
+            << (double)gaps_after.posting_bytes / (1024.0 * 1024.0) << " MiB\n";
+    }
+
+    if (pruned) {
+        const auto pct = [](uint64_t a, uint64_t b) { return b ? 100.0 * (double)a / (double)b : 0.0; };
+        out << "  prune: postings " << prune.postings_before << " -> " << prune.postings_after << " ("
+            << std::setprecision(1) << pct(prune.postings_after, prune.postings_before) << "%), lists+positions "
+            << (double)prune.bytes_before / (1024.0 * 1024.0) << " -> " << (double)prune.bytes_after / (1024.0 * 1024.0)
+            << " MiB (" << pct(prune.bytes_after, prune.bytes_before) << "%), impact >= " << std::setprecision(3)
+            << prune.threshold << ", " << prune.capped_terms << " lists capped"
+            << (prune.budget_met ? "" : ", over budget") << "\n";
+    }
+
+    if (!dict_growth.empty()) {
+        out << "  dictionary growth (docs -> unique terms @ ms):\n";
+        for (const auto& g : dict_growth) {
+            out << "    " << std::setw(10) << g.docs << " -> " << std::setw(10) << g.unique_terms
+                << " @ " << std::setprecision(1) << (double)g.elapsed_nanos / 1e6 << "\n";
+        }
+    }
+}
+
+std::string BuildProfile::toJson() const {
+    std::ostringstream oss;
+    oss << "{\"stages\":[";
+    for (size_t i = 0; i < stages.size(); ++i) {
+        const StageTiming& t = stages[i];
+        if (i) oss << ",";
+        oss << "{\"name\":\"" << stageName((BuildStage)i) << "\""
+            << ",\"nanos\":" << t.nanos
+            << ",\"bytes\":" << t.bytes
+            << ",\"docs\":" << t.docs
+            << ",\"mb_per_sec\":" << t.mb_per_sec()
+            << ",\"docs_per_sec\":" << t.docs_per_sec() << "}";
+    }
+    oss << "],\"total_nanos\":" << total_nanos
+        << ",\"peak_rss_kb\":" << peak_rss_kb
+        << ",\"final_rss_kb\":" << final_rss_kb;
+    if (!reorder.empty()) {
+        auto gaps = [&](const PostingGapStats& g) {
+            oss << "{\"gaps\":" << g.gaps << ",\"avg_gap\":" << g.avg_gap << ",\"avg_gap_bits\":" << g.avg_gap_bits
+                << ",\"posting_bytes\":" << g.posting_bytes << "}";
+        };
+        oss << ",\"reorder\":{\"order\":\"" << reorder << "\",\"before\":";
+        gaps(gaps_before);
+        oss << ",\"after\":";
+        gaps(gaps_after);
+        oss << "}";
+    }
+    if (pruned) {
+        oss << ",\"prune\":{\"postings_before\":" << prune.postings_before << ",\"postings_after\":"
+            << prune.postings_after << ",\"bytes_before\":" << prune.bytes_before << ",\"bytes_after\":"
+            << prune.bytes_after << ",\"capped_terms\":" << prune.capped_terms << ",\"threshold\":"
+            << prune.threshold << ",\"budget_met\":" << (prune.budget_met ? "true" : "false") << "}";
+    }
+    oss << ",\"dict_growth\":[";
+    for (size_t i = 0; i < dict_growth.size(); ++i) {
+        const auto& g = dict_growth[i];
+        if (i) oss << ",";
+        oss << "{\"docs\":" << g.docs << ",\"unique_terms\":" << g.unique_terms
+            << ",\"elapsed_nanos\":" << g.elapsed_nanos << "}";
+    }
+    oss << "]}";
+    return oss.str();
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class BuildStage {
+    Load,
+    Extract,   // fused HTML pass: plain and normalized text and tokens
+    Dedup,
+    Stem,
+    DictInsert,
+    PostingAppend,
+    Finalize,
+    Reorder,
+    Prune,
+    Freeze,
+    Count
+};
+
+struct StageTiming {
+    uint64_t nanos = 0;
+    uint64_t bytes = 0;   // input bytes the stage consumed
+    uint64_t docs = 0;
+
+    double seconds() const { return (double)nanos / 1e9; }
+    double mb_per_sec() const { return nanos ? ((double)bytes / (1024.0 * 1024.0)) / seconds() : 0.0; }
+    double docs_per_sec() const { return nanos ? (double)docs / seconds() : 0.0; }
+};
+
+struct DictGrowthSample {
+    uint64_t docs = 0;
+    uint64_t unique_terms = 0;
+    uint64_t elapsed_nanos = 0;
+};
+
+// Doc-id gaps between consecutive postings of each list, and the heap size
+// of the lists.
+struct PostingGapStats {
+    uint64_t gaps = 0;
+    double avg_gap = 0.0;
+    double avg_gap_bits = 0.0;    // bits of each gap: what a delta code pays, roughly
+    uint64_t posting_bytes = 0;
+};
+
+// What static pruning removed (see IndexPruner).
+struct PruneStats {
+    uint64_t postings_before = 0, postings_after = 0;
+    uint64_t bytes_before = 0, bytes_after = 0;   // posting lists and positions
+    uint64_t capped_terms = 0;                    // lists cut by the per-list cap
+    double threshold = 0.0;                       // lowest impact kept outside each term's top
+    bool budget_met = true;
+};
+
+// Per-stage wall time of an index build, measured with steady_clock at
+// nanosecond resolution around each stage of each document.
+struct BuildProfile {
+    std::array<StageTiming, (size_t)BuildStage::Count> stages{};
+    std::vector<DictGrowthSample> dict_growth;
+    uint64_t total_nanos = 0;
+    uint64_t peak_rss_kb = 0;
+    uint64_t final_rss_kb = 0;   // after the build structures are released
+
+    std::string reorder;         // doc order applied ("url", "bp"); empty if none
+    PostingGapStats gaps_before, gaps_after;
+    bool pruned = false;
+    PruneStats prune;
+
+    StageTiming& operator[](BuildStage s) { return stages[(size_t)s]; }
+    const StageTiming& operator[](BuildStage s) const { return stages[(size_t)s]; }
+
+    void add(BuildStage s, uint64_t nanos, uint64_t bytes, uint64_t docs = 1) {
+        StageTiming& t = stages[(size_t)s];
+        t.nanos += nanos;
+        t.bytes += bytes;
+        t.docs += docs;
+    }
+
+    static const char* stageName(BuildStage s);
+    static uint64_t peakRssKb();
+    static uint64_t currentRssKb();
+
+    void print(std::ostream& os) const;
+    std::string toJson() const;
+};
+
+class StageClock {
+public:
+    using clock = std::chrono::steady_clock;
+
+    StageClock() : last_(clock::now()) {}
+
+    // nanoseconds since the previous lap (or construction)
+    uint64_t lap() {
+        auto now = clock::now();
+        uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_).count();
+        last_ = now;
+        return ns;
+    }
+
+private:
+    clock::time_point last_;
+};
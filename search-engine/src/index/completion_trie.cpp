@@ -0,0 +1,104 @@
+#include "completion_trie.hpp"
+#include <algorithm>
+
+CompletionTrie CompletionTrie::build(const FrozenIndex& index) {
+    CompletionTrie t;
+    const uint32_t n = (uint32_t)index.termCount();
+    if (n <= kTopK) return t; // every prefix is small enough to rank at lookup
+    t.nodes_.emplace_back();
+    t.labels_.push_back('\0');
+    t.buildNode_(index, 0, n, 0, 0);
+    t.nodes_.shrink_to_fit();
+    t.labels_.shrink_to_fit();
+    t.tops_.shrink_to_fit();
+    return t;
+}
+
+// `node` is the prefix shared by terms [lo, hi), of length `depth`; more than kTopK of them.
+void CompletionTrie::buildNode_(const FrozenIndex& index, uint32_t lo, uint32_t hi, size_t depth,
+                                uint32_t node) {
+    std::vector<uint32_t> ids(hi - lo);
+    for (uint32_t i = lo; i < hi; ++i) ids[i - lo] = i;
+    std::partial_sort(ids.begin(), ids.begin() + kTopK, ids.end(), [&](uint32_t a, uint32_t b) {
+        return index.df(a) != index.df(b) ? index.df(a) > index.df(b) : a < b;
+    });
+    nodes_[node].top = (uint32_t)tops_.size();
+    tops_.insert(tops_.end(), ids.begin(), ids.begin() + kTopK);
+
+    // terms equal to the prefix sort first; the rest group by their next byte
+    struct Group { char label; uint32_t lo, hi; };
+    std::vector<Group> heavy;
+    uint32_t i = lo;
+    while (i < hi && index.term(i).size() == depth) ++i;
+    while (i < hi) {
+        const char c = index.term(i)[depth];
+        uint32_t e = i + 1;
+        while (e < hi && index.term(e)[depth] == c) ++e;
+        if (e - i > kTopK) heavy.push_back({c, i, e});
+        i = e;
+    }
+
+    nodes_[node].first_child = (uint32_t)nodes_.size();
+    nodes_[node].children = (uint32_t)heavy.size();
+    for (const Group& g : heavy) {
+        nodes_.emplace_back();
+        labels_.push_back(g.label);
+    }
+    const uint32_t first = nodes_[node].first_child;
+    for (size_t g = 0; g < heavy.size(); ++g) {
+        buildNode_(index, heavy[g].lo, heavy[g].hi, depth + 1, first + (uint32_t)g);
+    }
+}
+
+size_t CompletionTrie::complete(const FrozenIndex& index, std::string_view prefix, uint32_t* out,
+                                size_t k) const {
+    k = std::min(k, kTopK);
+    if (k == 0) return 0;
+
+    if (!nodes_.empty()) {
+        uint32_t node = 0;
+        size_t depth = 0;
+        for (; depth < prefix.size(); ++depth) {
+            const Node& nd = nodes_[node];
+            const char* b = labels_.data() + nd.first_child;
+            const char* e = b + nd.children;
+            const char* it = std::find(b, e, prefix[depth]);
+            if (it == e) break;
+            node = nd.first_child + (uint32_t)(it - b);
+        }
+        if (depth == prefix.size()) {
+            std::copy(tops_.begin() + nodes_[node].top, tops_.begin() + nodes_[node].top + k, out);
+            return k;
+        }
+    }
+
+    // at most kTopK terms start with the prefix: find them, keep the best k
+    uint32_t lo = 0, hi = (uint32_t)index.termCount();
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (index.term(mid) < prefix) lo = mid + 1;
+        else hi = mid;
+    }
+    size_t n = 0;
+    for (uint32_t id = lo; id < index.termCount() && index.term(id).starts_with(prefix); ++id) {
+        size_t j = std::min(n, k - 1);
+        if (n == k && index.df(out[j]) >= index.df(id)) continue;
+        while (j > 0 && index.df(out[j - 1]) < index.df(id)) {
+            out[j] = out[j - 1];
+            --j;
+        }
+        out[j] = id;
+        n = std::min(n + 1, k);
+    }
+    return n;
+}
+
+size_t CompletionTrie::memoryBytes() const {
+    return nodes_.capacity() * sizeof(Node) + labels_.capacity() + tops_.capacity() * sizeof(uint32_t);
+}
+
+void CompletionTrie::memoryUsage(MemoryReport& r) const {
+    r.items.push_back(MemoryReport::vector("completions.nodes", nodes_));
+    r.items.push_back(MemoryReport::vector("completions.labels", labels_));
+    r.items.push_back(MemoryReport::vector("completions.tops", tops_));
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "frozen_index.hpp"
+
+// Prefix completion over the sorted term dictionary of a FrozenIndex. A
+// prefix is a contiguous range of term ids; the trie keeps only the prefixes
+// with more than kTopK terms, each with its kTopK most frequent terms (by
+// document frequency) precomputed. A lookup walks those nodes; past them the
+// prefix covers at most kTopK terms, which are found by binary search in the
+// dictionary and ranked in place. Lookups do not allocate.
+class CompletionTrie {
+public:
+    static constexpr size_t kTopK = 10;
+
+    static CompletionTrie build(const FrozenIndex& index);
+
+    // Writes up to min(k, kTopK) ids of terms starting with `prefix` to `out`,
+    // most frequent first; returns how many. `index` is the one built from.
+    size_t complete(const FrozenIndex& index, std::string_view prefix, uint32_t* out, size_t k = kTopK) const;
+
+    size_t nodeCount() const { return nodes_.size(); }
+    size_t memoryBytes() const;
+    void memoryUsage(MemoryReport& r) const;
+
+private:
+    struct Node {
+        uint32_t first_child = 0;   // children are nodes_[first_child, first_child + children)
+        uint32_t children = 0;
+        uint32_t top = 0;           // kTopK ids at tops_[top]
+    };
+
+    std::vector<Node> nodes_;       // nodes_[0] is the empty prefix when the dictionary is large
+    std::vector<char> labels_;      // parallel to nodes_: the byte leading to each node
+    std::vector<uint32_t> tops_;
+
+    void buildNode_(const FrozenIndex& index, uint32_t lo, uint32_t hi, size_t depth, uint32_t node);
+};
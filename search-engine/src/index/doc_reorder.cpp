@@ -0,0 +1,217 @@
+#include "doc_reorder.hpp"
+#include "doc_values.hpp"
+#include "positions.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numeric>
+#include <utility>
+
+bool DocReorder::parseOrder(const std::string& s, DocOrder& out, std::string* err) {
+    if (s == "none") out = DocOrder::None;
+    else if (s == "url") out = DocOrder::Url;
+    else if (s == "bp") out = DocOrder::Bisection;
+    else {
+        if (err) *err = "Unknown doc order (want url, bp or none): " + s;
+        return false;
+    }
+    return true;
+}
+
+static std::vector<uint32_t> ids_of(const std::vector<uint32_t>& order) {
+    std::vector<uint32_t> new_id(order.size());
+    for (uint32_t pos = 0; pos < order.size(); ++pos) new_id[order[pos]] = pos;
+    return new_id;
+}
+
+std::vector<uint32_t> DocReorder::byUrl(const std::vector<Document>& docs) {
+    std::vector<std::string> hosts(docs.size());
+    for (size_t i = 0; i < docs.size(); ++i) hosts[i] = DocValues::hostOf(docs[i].url);
+    std::vector<uint32_t> order(docs.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        const int c = hosts[a].compare(hosts[b]);
+        return c != 0 ? c < 0 : docs[a].url < docs[b].url;
+    });
+    return ids_of(order);
+}
+
+namespace {
+
+// One run of recursive graph bisection over a doc -> terms CSR graph.
+// Moving a doc between halves changes, for each of its terms, the cost
+// d * log2(n / (d + 1)) of the term's degrees d in halves of size n: the
+// log-gap a delta code would pay if the term's docs were spread evenly.
+class Bisector {
+public:
+    Bisector(const std::vector<uint32_t>& offsets, const std::vector<uint32_t>& edges, uint32_t terms,
+             const ReorderOptions& opt)
+        : offsets_(offsets), edges_(edges), opt_(opt), deg_a_(terms, 0), deg_b_(terms, 0),
+          gain_(offsets.size() - 1, 0.0f), log2_(offsets.size() + 1, 0.0f) {
+        for (size_t i = 1; i < log2_.size(); ++i) log2_[i] = (float)std::log2((double)i);
+    }
+
+    void run(std::vector<uint32_t>& order, size_t lo, size_t hi) {
+        if (hi - lo <= std::max<size_t>(opt_.bp_leaf, 2)) return;
+        const size_t mid = lo + (hi - lo) / 2;
+        for (size_t i = lo; i < hi; ++i) move_(order[i], i < mid ? deg_a_ : deg_b_, 1);
+        // later rounds only trade a few docs back and forth
+        const size_t settled = (hi - lo) / 100;
+        marginal_(mid - lo, marg_a_);
+        marginal_(hi - mid, marg_b_);
+        for (int it = 0; it < opt_.bp_iterations; ++it) {
+            if (swapRound_(order, lo, mid, hi) <= settled) break;
+        }
+        for (size_t i = lo; i < hi; ++i) move_(order[i], i < mid ? deg_a_ : deg_b_, 0);
+        run(order, lo, mid);
+        run(order, mid, hi);
+    }
+
+private:
+    const std::vector<uint32_t>& offsets_;
+    const std::vector<uint32_t>& edges_;
+    const ReorderOptions& opt_;
+    std::vector<int32_t> deg_a_, deg_b_;   // per term, within the range being split
+    std::vector<float> gain_;              // per doc
+    std::vector<float> log2_;              // log2(i)
+    std::vector<float> marg_a_, marg_b_;   // cost(d) - cost(d - 1) in each half
+
+    // cost(d) = d * log2(n / (d + 1)) for a term in d of the n docs of a half
+    void marginal_(size_t n, std::vector<float>& out) const {
+        out.resize(n + 2);
+        out[0] = 0.0f;
+        float prev = 0.0f;
+        for (size_t d = 1; d < out.size(); ++d) {
+            const float c = (float)d * (log2_[n] - log2_[d + 1]);
+            out[d] = c - prev;
+            prev = c;
+        }
+    }
+
+    // adds `delta` to the degrees of the doc's terms; 0 clears them
+    void move_(uint32_t doc, std::vector<int32_t>& deg, int32_t delta) {
+        for (uint32_t e = offsets_[doc]; e < offsets_[doc + 1]; ++e) {
+            deg[edges_[e]] = delta ? deg[edges_[e]] + delta : 0;
+        }
+    }
+
+    // Cost saved by moving `doc` out of the half with degrees `from` into the other.
+    float gain_of_(uint32_t doc, const std::vector<int32_t>& from, const std::vector<float>& marg_from,
+                   const std::vector<int32_t>& to, const std::vector<float>& marg_to) const {
+        float g = 0.0f;
+        for (uint32_t e = offsets_[doc]; e < offsets_[doc + 1]; ++e) {
+            const uint32_t t = edges_[e];
+            g += marg_from[from[t]] - marg_to[to[t] + 1];
+        }
+        return g;
+    }
+
+    // Swaps the pairs that lower the cost most; returns how many.
+    size_t swapRound_(std::vector<uint32_t>& order, size_t lo, size_t mid, size_t hi) {
+        const size_t na = mid - lo, nb = hi - mid;
+        for (size_t i = lo; i < mid; ++i) gain_[order[i]] = gain_of_(order[i], deg_a_, marg_a_, deg_b_, marg_b_);
+        for (size_t i = mid; i < hi; ++i) gain_[order[i]] = gain_of_(order[i], deg_b_, marg_b_, deg_a_, marg_a_);
+
+        auto by_gain = [&](uint32_t x, uint32_t y) { return gain_[x] > gain_[y]; };
+        std::sort(order.begin() + lo, order.begin() + mid, by_gain);
+        std::sort(order.begin() + mid, order.begin() + hi, by_gain);
+        size_t swapped = 0;
+        for (size_t i = 0; i < std::min(na, nb); ++i) {
+            const uint32_t a = order[lo + i], b = order[mid + i];
+            if (gain_[a] + gain_[b] <= 0.0f) break;
+            move_(a, deg_a_, -1);
+            move_(a, deg_b_, 1);
+            move_(b, deg_b_, -1);
+            move_(b, deg_a_, 1);
+            std::swap(order[lo + i], order[mid + i]);
+            ++swapped;
+        }
+        return swapped;
+    }
+};
+
+} // namespace
+
+std::vector<uint32_t> DocReorder::bisection(const HashTable<TermData>& index, size_t doc_count,
+                                            const ReorderOptions& opt) {
+    // doc -> terms; a term in a single document costs the same anywhere
+    std::vector<uint32_t> offsets(doc_count + 1, 0);
+    index.forEach([&](const std::string&, const TermData& td) {
+        if (td.postings.size() < 2) return;
+        td.postings.forEach([&](int d) { ++offsets[d + 1]; return true; });
+    });
+    for (size_t i = 0; i < doc_count; ++i) offsets[i + 1] += offsets[i];
+    std::vector<uint32_t> edges(offsets[doc_count]);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    uint32_t terms = 0;
+    index.forEach([&](const std::string&, const TermData& td) {
+        if (td.postings.size() < 2) return;
+        td.postings.forEach([&](int d) { edges[fill[d]++] = terms; return true; });
+        ++terms;
+    });
+
+    std::vector<uint32_t> order(doc_count);
+    std::iota(order.begin(), order.end(), 0u);
+    Bisector(offsets, edges, terms, opt).run(order, 0, doc_count);
+    return ids_of(order);
+}
+
+void DocReorder::apply(const std::vector<uint32_t>& new_id, std::vector<Document>& docs,
+                       HashTable<TermData>& index) {
+    struct Posting { uint32_t doc, pos_begin, pos_end; };
+    std::vector<Posting> postings;
+    std::vector<uint8_t> positions;
+    index.forEach([&](const std::string&, TermData& td) {
+        postings.clear();
+        const uint8_t* base = td.positions.data();
+        const uint8_t* p = base;
+        const bool positional = !td.positions.empty();
+        td.postings.forEach([&](int d) {
+            const uint8_t* e = positional ? Positions::skip(p) : p;
+            postings.push_back({new_id[d], (uint32_t)(p - base), (uint32_t)(e - base)});
+            p = e;
+            return true;
+        });
+        std::sort(postings.begin(), postings.end(), [](const Posting& a, const Posting& b) { return a.doc < b.doc; });
+
+        PostingList list;
+        positions.clear();
+        for (const Posting& x : postings) {
+            list.addSortedUnique((int)x.doc);
+            positions.insert(positions.end(), base + x.pos_begin, base + x.pos_end);
+        }
+        list.optimize();
+        td.postings = std::move(list);
+        td.positions.swap(positions);
+    });
+
+    std::vector<Document> moved(docs.size());
+    for (size_t i = 0; i < docs.size(); ++i) {
+        moved[new_id[i]] = std::move(docs[i]);
+        moved[new_id[i]].id = (int)new_id[i];
+    }
+    docs.swap(moved);
+}
+
+PostingGapStats DocReorder::gaps(const HashTable<TermData>& index) {
+    PostingGapStats s;
+    uint64_t sum = 0, bits = 0;
+    index.forEach([&](const std::string&, const TermData& td) {
+        int prev = -1;
+        td.postings.forEach([&](int d) {
+            if (prev >= 0) {
+                sum += (uint64_t)(d - prev);
+                bits += (uint64_t)std::bit_width((uint32_t)(d - prev));
+                ++s.gaps;
+            }
+            prev = d;
+            return true;
+        });
+        s.posting_bytes += td.postings.memoryBytes();
+    });
+    if (s.gaps) {
+        s.avg_gap = (double)sum / (double)s.gaps;
+        s.avg_gap_bits = (double)bits / (double)s.gaps;
+    }
+    return s;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../document.hpp"
+#include "../structures/hash_table.hpp"
+#include "build_profile.hpp"
+#include "term_data.hpp"
+
+enum class DocOrder { None, Url, Bisection };
+
+struct ReorderOptions {
+    DocOrder order = DocOrder::None;
+    int bp_iterations = 20;     // swap rounds per bisection
+    size_t bp_leaf = 16;        // parts this small are left in their order
+};
+
+// Doc-id reassignment after the build: similar documents get nearby ids, so
+// posting lists have small gaps, denser containers and more runs, and the
+// results of a query sit closer together.
+//  - Url: by host, then URL (pages of a site tend to share vocabulary).
+//  - Bisection: recursive graph bisection (BP) over the document-term graph.
+//    Each range of docs is split in two halves; rounds of swaps between the
+//    halves lower the estimated log-gap cost of the terms they contain,
+//    then each half is ordered the same way.
+class DocReorder {
+public:
+    // "url", "bp" or "none"
+    static bool parseOrder(const std::string& s, DocOrder& out, std::string* err = nullptr);
+
+    // New id of each document: a permutation of [0, docs.size()).
+    static std::vector<uint32_t> byUrl(const std::vector<Document>& docs);
+    static std::vector<uint32_t> bisection(const HashTable<TermData>& index, size_t doc_count,
+                                           const ReorderOptions& opt);
+
+    // Renumbers document i to new_id[i] in every posting list and positions
+    // record of `index`, and moves docs[i] to docs[new_id[i]].
+    static void apply(const std::vector<uint32_t>& new_id, std::vector<Document>& docs,
+                      HashTable<TermData>& index);
+
+    static PostingGapStats gaps(const HashTable<TermData>& index);
+};
@@ -0,0 +1,274 @@
+#include "doc_values.hpp"
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <unordered_map>
+
+namespace {
+
+constexpr size_t kLaneHosts = 1 << 16;  // hosts up to which facets count into four lanes
+constexpr size_t kFacetBatch = 256;
+
+// days since 1970-01-01 of a proleptic Gregorian date
+int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = (unsigned)(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+bool digits(std::string_view s, size_t at, size_t n, unsigned& out) {
+    if (at + n > s.size()) return false;
+    out = 0;
+    for (size_t i = at; i < at + n; ++i) {
+        if (s[i] < '0' || s[i] > '9') return false;
+        out = out * 10 + (unsigned)(s[i] - '0');
+    }
+    return true;
+}
+
+// Host reversed with '.' as the lowest byte, so that a host sorts right
+// before all of its subdomains: "a.example" -> "elpmaxe\1a".
+std::string site_key(std::string s) {
+    std::reverse(s.begin(), s.end());
+    std::replace(s.begin(), s.end(), '.', '\1');
+    return s;
+}
+
+} // namespace
+
+std::string DocValues::hostOf(std::string_view url) {
+    if (size_t scheme = url.find("://"); scheme != std::string_view::npos) url.remove_prefix(scheme + 3);
+    url = url.substr(0, url.find_first_of("/?#"));
+    if (size_t at = url.rfind('@'); at != std::string_view::npos) url.remove_prefix(at + 1);
+    if (size_t colon = url.rfind(':'); colon != std::string_view::npos && url.find(']') == std::string_view::npos) {
+        url = url.substr(0, colon);
+    }
+    std::string host(url);
+    for (char& c : host) {
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+    }
+    while (!host.empty() && host.back() == '.') host.pop_back();
+    return host;
+}
+
+bool DocValues::parseTime(std::string_view s, int64_t& out) {
+    unsigned y, mo, d, h = 0, mi = 0, sec = 0;
+    if (!digits(s, 0, 4, y) || s.size() < 10 || s[4] != '-' || !digits(s, 5, 2, mo) || s[7] != '-' ||
+        !digits(s, 8, 2, d)) return false;
+    size_t at = 10;
+    if (at < s.size() && (s[at] == 'T' || s[at] == ' ')) {
+        if (!digits(s, at + 1, 2, h) || at + 3 >= s.size() || s[at + 3] != ':' || !digits(s, at + 4, 2, mi)) {
+            return false;
+        }
+        at += 6;
+        if (at < s.size() && s[at] == ':') {
+            if (!digits(s, at + 1, 2, sec)) return false;
+            at += 3;
+        }
+    }
+    if (at < s.size() && s[at] == 'Z') ++at;
+    if (at != s.size() || mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || sec > 60) return false;
+    out = days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60 + sec;
+    return true;
+}
+
+DocValues DocValues::build(const std::vector<Document>& docs) {
+    DocValues v;
+    const size_t n = docs.size();
+
+    // host dictionary in site-key order
+    std::vector<std::string> doc_hosts(n);
+    for (size_t i = 0; i < n; ++i) doc_hosts[i] = hostOf(docs[i].url);
+    std::vector<std::pair<std::string, std::string>> dict; // (key, host)
+    {
+        std::unordered_map<std::string, uint32_t> seen;
+        for (const auto& h : doc_hosts) {
+            if (seen.emplace(h, 0).second) dict.push_back({site_key(h), h});
+        }
+    }
+    std::sort(dict.begin(), dict.end());
+    std::unordered_map<std::string, uint32_t> ids;
+    ids.reserve(dict.size());
+    v.keys_.reserve(dict.size());
+    v.hosts_.reserve(dict.size());
+    for (uint32_t id = 0; id < dict.size(); ++id) {
+        ids.emplace(dict[id].second, id);
+        v.keys_.push_back(std::move(dict[id].first));
+        v.hosts_.push_back(std::move(dict[id].second));
+    }
+
+    v.host_of_.resize(n);
+    v.host_offsets_.assign(v.hosts_.size() + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+        v.host_of_[i] = ids.find(doc_hosts[i])->second;
+        ++v.host_offsets_[v.host_of_[i] + 1];
+    }
+    std::partial_sum(v.host_offsets_.begin(), v.host_offsets_.end(), v.host_offsets_.begin());
+    v.host_docs_.resize(n);
+    std::vector<uint32_t> fill(v.host_offsets_.begin(), v.host_offsets_.end() - 1);
+    for (size_t i = 0; i < n; ++i) v.host_docs_[fill[v.host_of_[i]]++] = (int)i;
+
+    std::vector<std::pair<int64_t, int>> timed;
+    timed.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        int64_t t;
+        if (parseTime(docs[i].crawled_at, t)) timed.push_back({t, (int)i});
+    }
+    std::sort(timed.begin(), timed.end());
+    v.times_.reserve(timed.size());
+    v.time_docs_.reserve(timed.size());
+    for (const auto& [t, doc] : timed) {
+        v.times_.push_back(t);
+        v.time_docs_.push_back(doc);
+    }
+    return v;
+}
+
+bool DocValues::parseFilter(const std::string& expr, DocFilter& out, std::string* err) const {
+    const size_t colon = expr.find(':');
+    const std::string field = expr.substr(0, colon);
+    const std::string value = colon == std::string::npos ? "" : expr.substr(colon + 1);
+    out = DocFilter{};
+
+    if (field == "site") {
+        const std::string key = site_key(hostOf(value));
+        if (key.empty()) {
+            if (err) *err = "Empty host in " + expr;
+            return false;
+        }
+        // the host and its subdomains: keys from `key` up to, excluding, key + '\2'
+        out.site = true;
+        out.host_lo = (uint32_t)(std::lower_bound(keys_.begin(), keys_.end(), key) - keys_.begin());
+        out.host_hi = (uint32_t)(std::lower_bound(keys_.begin(), keys_.end(), key + '\2') - keys_.begin());
+        return true;
+    }
+    if (field == "after" || field == "before") {
+        int64_t t;
+        if (!parseTime(value, t)) {
+            if (err) *err = "Bad date in " + expr + " (expected YYYY-MM-DD[THH:MM[:SS]])";
+            return false;
+        }
+        out.from = field == "after" ? t : INT64_MIN;
+        out.to = field == "after" ? INT64_MAX : t;
+        return true;
+    }
+    if (err) *err = "Unknown filter: " + expr;
+    return false;
+}
+
+std::pair<size_t, size_t> DocValues::timeRange_(const DocFilter& f) const {
+    const size_t lo = std::lower_bound(times_.begin(), times_.end(), f.from) - times_.begin();
+    const size_t hi = f.to == INT64_MAX ? times_.size()
+                                        : std::lower_bound(times_.begin(), times_.end(), f.to) - times_.begin();
+    return {lo, std::max(lo, hi)};
+}
+
+uint64_t DocValues::count(const DocFilter& f) const {
+    if (f.site) return host_offsets_[f.host_hi] - host_offsets_[f.host_lo];
+    const auto [lo, hi] = timeRange_(f);
+    return hi - lo;
+}
+
+PostingList DocValues::apply(const DocFilter& f, int hi, const Deadline* dl, int* cutoff) const {
+    std::vector<int> docs;
+    auto below = [hi](int d) { return d < hi; };
+    if (f.site) {
+        std::copy_if(host_docs_.begin() + host_offsets_[f.host_lo], host_docs_.begin() + host_offsets_[f.host_hi],
+                     std::back_inserter(docs), below);
+        if (f.host_hi - f.host_lo > 1) std::sort(docs.begin(), docs.end());
+    } else {
+        const auto [from, to] = timeRange_(f);
+        std::copy_if(time_docs_.begin() + from, time_docs_.begin() + to, std::back_inserter(docs), below);
+        std::sort(docs.begin(), docs.end());
+    }
+    PostingList out;
+    for (size_t i = 0; i < docs.size(); ++i) {
+        // once per 65536-doc chunk, like the container merges
+        if (dl && (i == 0 || docs[i] >> 16 != docs[i - 1] >> 16) && dl->expired()) {
+            if (cutoff) *cutoff = docs[i] & ~0xFFFF;
+            break;
+        }
+        out.addSortedUnique(docs[i]);
+    }
+    out.optimize();
+    return out;
+}
+
+std::vector<FacetCount> DocValues::hostFacets(const PostingList& docs, size_t top) const {
+    const size_t h = hosts_.size();
+    if (top == 0 || h == 0) return {};
+
+    // Doc ids are gathered into host ids a batch at a time, then counted into
+    // four interleaved histograms so runs of one host do not serialize on a
+    // single counter; the lanes are summed at the end.
+    const size_t lanes = h <= kLaneHosts ? 4 : 1;
+    std::vector<uint32_t> counts(lanes * h, 0);
+    uint32_t* c0 = counts.data();
+    uint32_t* c1 = c0 + (lanes == 4 ? h : 0);
+    uint32_t* c2 = c0 + (lanes == 4 ? 2 * h : 0);
+    uint32_t* c3 = c0 + (lanes == 4 ? 3 * h : 0);
+    uint32_t batch[kFacetBatch];
+    size_t n = 0;
+    auto flush = [&] {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            ++c0[batch[i]];
+            ++c1[batch[i + 1]];
+            ++c2[batch[i + 2]];
+            ++c3[batch[i + 3]];
+        }
+        for (; i < n; ++i) ++c0[batch[i]];
+        n = 0;
+    };
+    docs.forEach([&](int d) {
+        if (d < (int)host_of_.size()) batch[n++] = host_of_[d];
+        if (n == kFacetBatch) flush();
+        return true;
+    });
+    flush();
+    if (lanes == 4) {
+        for (size_t k = 0; k < h; ++k) c0[k] += c1[k] + c2[k] + c3[k];
+    }
+
+    std::vector<uint32_t> ids;
+    for (uint32_t k = 0; k < h; ++k) {
+        if (c0[k]) ids.push_back(k);
+    }
+    auto before = [&](uint32_t a, uint32_t b) {
+        return c0[a] != c0[b] ? c0[a] > c0[b] : hosts_[a] < hosts_[b];
+    };
+    top = std::min(top, ids.size());
+    std::partial_sort(ids.begin(), ids.begin() + top, ids.end(), before);
+
+    std::vector<FacetCount> out(top);
+    for (size_t i = 0; i < top; ++i) out[i] = {hosts_[ids[i]], c0[ids[i]]};
+    return out;
+}
+
+size_t DocValues::memoryBytes() const {
+    size_t bytes = host_of_.capacity() * sizeof(uint32_t) + host_offsets_.capacity() * sizeof(uint32_t) +
+                   host_docs_.capacity() * sizeof(int) + times_.capacity() * sizeof(int64_t) +
+                   time_docs_.capacity() * sizeof(int);
+    for (const auto& s : hosts_) bytes += sizeof(std::string) + s.capacity();
+    for (const auto& s : keys_) bytes += sizeof(std::string) + s.capacity();
+    return bytes;
+}
+
+void DocValues::memoryUsage(MemoryReport& r) const {
+    MemoryItem hosts = MemoryReport::vector("doc_values.hosts", hosts_);
+    MemoryItem keys = MemoryReport::vector("doc_values.host_keys", keys_);
+    for (const auto& s : hosts_) hosts.addString(s);
+    for (const auto& s : keys_) keys.addString(s);
+    hosts.count = hosts_.size();
+    keys.count = keys_.size();
+    r.items.push_back(std::move(hosts));
+    r.items.push_back(std::move(keys));
+    r.items.push_back(MemoryReport::vector("doc_values.host_of", host_of_));
+    r.items.push_back(MemoryReport::vector("doc_values.host_offsets", host_offsets_));
+    r.items.push_back(MemoryReport::vector("doc_values.host_docs", host_docs_));
+    r.items.push_back(MemoryReport::vector("doc_values.times", times_));
+    r.items.push_back(MemoryReport::vector("doc_values.time_docs", time_docs_));
+}
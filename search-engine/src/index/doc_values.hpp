@@ -0,0 +1,62 @@
+#pragma once
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../document.hpp"
+#include "../structures/memory_report.hpp"
+#include "../structures/posting_list.hpp"
+
+// A parsed site:/after:/before: operand: doc ids of hosts [host_lo, host_hi)
+// or crawled in [from, to).
+struct DocFilter {
+    bool site = false;
+    uint32_t host_lo = 0, host_hi = 0;
+    int64_t from = 0, to = 0;
+};
+
+// Columnar per-document values for filtering and faceting. Hosts are
+// dictionary-encoded: ids follow the order of the reversed host names, so a
+// host and all of its subdomains form one id range, and the doc ids of each
+// host are stored together (CSR). Crawl times are Unix seconds, sorted, with
+// the doc id of each kept alongside.
+class DocValues {
+public:
+    static DocValues build(const std::vector<Document>& docs);
+
+    // Lower-cased host of a URL, without scheme, user info or port.
+    static std::string hostOf(std::string_view url);
+
+    // "YYYY-MM-DD", optionally followed by 'T' or ' ' and "HH:MM[:SS]" and 'Z',
+    // as Unix seconds (UTC).
+    static bool parseTime(std::string_view s, int64_t& out);
+
+    // "site:host", "after:date" (crawled at or after) or "before:date" (strictly before)
+    bool parseFilter(const std::string& expr, DocFilter& out, std::string* err = nullptr) const;
+
+    // Docs below `hi` only. Stops once `dl` passes, setting *cutoff to the
+    // first doc id left out.
+    PostingList apply(const DocFilter& f, int hi = INT_MAX, const Deadline* dl = nullptr,
+                      int* cutoff = nullptr) const;
+    uint64_t count(const DocFilter& f) const;
+
+    // The `top` hosts with most documents among `docs`, most frequent first.
+    std::vector<FacetCount> hostFacets(const PostingList& docs, size_t top) const;
+
+    size_t hostCount() const { return hosts_.size(); }
+    size_t memoryBytes() const;
+    void memoryUsage(MemoryReport& r) const;
+
+private:
+    std::vector<std::string> hosts_;        // by host id
+    std::vector<std::string> keys_;         // sort keys of hosts_ (reversed), ascending
+    std::vector<uint32_t> host_of_;         // by doc id
+    std::vector<uint32_t> host_offsets_;    // host id -> range in host_docs_
+    std::vector<int> host_docs_;
+    std::vector<int64_t> times_;            // sorted; docs with no parseable time are left out
+    std::vector<int> time_docs_;            // doc id of each entry of times_
+
+    std::pair<size_t, size_t> timeRange_(const DocFilter& f) const;
+};
@@ -0,0 +1,203 @@
+#include "forward_index.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numeric>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct Entry {
+    uint32_t term;
+    float w;
+};
+
+} // namespace
+
+ForwardIndex ForwardIndex::build(const FrozenIndex& index, size_t doc_count, const SimilarOptions& opt) {
+    ForwardIndex f;
+    f.opt_ = opt;
+    f.offsets_.reserve(doc_count + 1);
+    f.offsets_.push_back(0);
+    f.scale_.reserve(doc_count);
+
+    std::vector<float> idf(index.termCount());
+    uint64_t postings = 0;
+    for (uint32_t id = 0; id < idf.size(); ++id) {
+        const uint32_t df = index.df(id);
+        idf[id] = df ? (float)std::log((double)doc_count / (double)df) : 0.0f;
+        postings += df;
+    }
+    const uint64_t most = std::min<uint64_t>(postings, (uint64_t)doc_count * opt.doc_terms);
+    f.terms_.reserve(most);
+    f.weights_.reserve(most);
+
+    // The postings of a chunk are counted per doc, then placed by doc; each
+    // doc's terms come out in term id order.
+    struct Posting { uint32_t term; uint32_t tf; };
+    std::vector<Posting> grouped;
+    std::vector<uint32_t> starts(65537), fill;
+    std::vector<Entry> vec;
+    std::vector<float> ws;
+    size_t next_doc = 0;
+    int pass = 0;
+
+    // vectors of docs [next_doc, end_doc); a doc's postings are grouped[starts[d], starts[d + 1])
+    auto flush = [&](size_t end_doc) {
+        for (size_t d = 0; next_doc < end_doc; ++d, ++next_doc) {
+            vec.clear();
+            double norm = 0.0;
+            for (uint32_t i = starts[d]; i < starts[d + 1]; ++i) {
+                const Posting& p = grouped[i];
+                const float w = (1.0f + std::log((float)p.tf)) * idf[p.term];
+                norm += (double)w * w;
+                if (w > 0.0f && index.df(p.term) > 1) vec.push_back({p.term, w});
+            }
+            if (vec.size() > opt.doc_terms) {
+                // keep the doc_terms heaviest, ties by term id, in term id order
+                ws.clear();
+                for (const Entry& x : vec) ws.push_back(x.w);
+                std::nth_element(ws.begin(), ws.begin() + (opt.doc_terms - 1), ws.end(), std::greater<float>());
+                const float cut = ws[opt.doc_terms - 1];
+                size_t above = 0;
+                for (const Entry& x : vec) above += x.w > cut;
+                size_t ties = opt.doc_terms - above, kept = 0;
+                for (const Entry& x : vec) {
+                    if (x.w > cut) {
+                        vec[kept++] = x;
+                    } else if (x.w == cut && ties) {
+                        vec[kept++] = x;
+                        --ties;
+                    }
+                }
+                vec.resize(kept);
+            }
+            float top = 0.0f;
+            for (const Entry& x : vec) top = std::max(top, x.w);
+            for (const Entry& x : vec) {
+                f.terms_.push_back(x.term);
+                f.weights_.push_back((uint8_t)std::max(1L, std::lround(x.w / top * 255.0f)));
+            }
+            f.offsets_.push_back((uint32_t)f.terms_.size());
+            f.scale_.push_back(top > 0.0f ? (float)(top / std::sqrt(norm) / 255.0) : 0.0f);
+        }
+    };
+
+    index.forEachChunkPosting(2,
+        [&](uint32_t term, int doc, uint32_t tf) {
+            if ((size_t)doc >= doc_count) return;
+            if (pass == 0) ++starts[(doc & 0xFFFF) + 1];
+            else grouped[fill[doc & 0xFFFF]++] = {term, tf};
+        },
+        [&](uint32_t key, int p) {
+            pass = 1 - p;
+            if (p == 0) {
+                std::partial_sum(starts.begin(), starts.end(), starts.begin());
+                fill.assign(starts.begin(), starts.end() - 1);
+                grouped.resize(starts.back());
+                return;
+            }
+            flush(std::min(doc_count, ((size_t)key + 1) << 16));
+            std::fill(starts.begin(), starts.end(), 0u);
+        });
+    std::fill(starts.begin(), starts.end(), 0u);
+    while (next_doc < doc_count) flush(std::min(doc_count, next_doc + 65536));  // docs without terms
+    return f;
+}
+
+uint32_t ForwardIndex::dot_(const uint32_t* terms, const uint8_t* weights, size_t n, const uint8_t* table) {
+    size_t i = 0;
+    uint32_t sum = 0;
+#if defined(__AVX2__)
+    // the table has 3 bytes of padding, so every slot can be gathered as 4 bytes
+    __m256i acc = _mm256_setzero_si256();
+    const __m256i low = _mm256_set1_epi32(0xFF);
+    for (; i + 8 <= n; i += 8) {
+        const __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(terms + i));
+        const __m256i q = _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int*>(table), idx, 1), low);
+        const __m256i w = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(weights + i)));
+        acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(q, w));
+    }
+    __m128i s4 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s4 = _mm_add_epi32(s4, _mm_shuffle_epi32(s4, 0x4E));
+    s4 = _mm_add_epi32(s4, _mm_shuffle_epi32(s4, 0xB1));
+    sum = (uint32_t)_mm_cvtsi128_si32(s4);
+#elif defined(__SSE2__)
+    // no gather: the 8 query bytes are loaded one by one, the products are summed 16 bits wide
+    __m128i acc = _mm_setzero_si128();
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        const __m128i q = _mm_setr_epi16(table[terms[i]], table[terms[i + 1]], table[terms[i + 2]],
+                                         table[terms[i + 3]], table[terms[i + 4]], table[terms[i + 5]],
+                                         table[terms[i + 6]], table[terms[i + 7]]);
+        const __m128i w = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(weights + i)), zero);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(q, w));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4E));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xB1));
+    sum = (uint32_t)_mm_cvtsi128_si32(acc);
+#endif
+    for (; i < n; ++i) sum += (uint32_t)table[terms[i]] * weights[i];
+    return sum;
+}
+
+std::vector<SimilarHit> ForwardIndex::similar(const FrozenIndex& index, int doc, size_t k) const {
+    std::vector<SimilarHit> out;
+    if (doc < 0 || (size_t)doc >= docCount() || k == 0) return out;
+    const uint32_t b = offsets_[doc], e = offsets_[doc + 1];
+
+    std::vector<uint32_t> heaviest(e - b);
+    std::iota(heaviest.begin(), heaviest.end(), b);
+    const size_t q = std::min(heaviest.size(), opt_.query_terms);
+    std::partial_sort(heaviest.begin(), heaviest.begin() + q, heaviest.end(),
+                      [&](uint32_t x, uint32_t y) { return weights_[x] > weights_[y]; });
+    PostingList candidates;
+    for (size_t i = 0; i < q && candidates.size() < opt_.max_candidates; ++i) {
+        candidates = PostingList::Or(candidates, index.postings(terms_[heaviest[i]]));
+    }
+
+    // the document's weights by term id; zeroed again before returning
+    thread_local std::vector<uint8_t> table;
+    if (table.size() < index.termCount() + 3) table.resize(index.termCount() + 3, 0);
+    for (uint32_t i = b; i < e; ++i) table[terms_[i]] = weights_[i];
+
+    // min-heap of the best k so far
+    auto better = [](const SimilarHit& x, const SimilarHit& y) {
+        return x.score != y.score ? x.score > y.score : x.doc < y.doc;
+    };
+    out.reserve(k + 1);
+    candidates.forEach([&](int c) {
+        if (c == doc || (size_t)c >= docCount()) return true;
+        const uint32_t o = offsets_[c];
+        const uint32_t dot = dot_(terms_.data() + o, weights_.data() + o, offsets_[c + 1] - o, table.data());
+        if (!dot) return true;
+        const SimilarHit hit{c, (float)dot * scale_[c] * scale_[doc]};
+        if (out.size() < k) {
+            out.push_back(hit);
+            std::push_heap(out.begin(), out.end(), better);
+        } else if (better(hit, out.front())) {
+            std::pop_heap(out.begin(), out.end(), better);
+            out.back() = hit;
+            std::push_heap(out.begin(), out.end(), better);
+        }
+        return true;
+    });
+    for (uint32_t i = b; i < e; ++i) table[terms_[i]] = 0;
+
+    std::sort(out.begin(), out.end(), better);
+    return out;
+}
+
+size_t ForwardIndex::memoryBytes() const {
+    return offsets_.capacity() * sizeof(uint32_t) + terms_.capacity() * sizeof(uint32_t) + weights_.capacity() +
+           scale_.capacity() * sizeof(float);
+}
+
+void ForwardIndex::memoryUsage(MemoryReport& r) const {
+    r.items.push_back(MemoryReport::vector("similar.offsets", offsets_));
+    r.items.push_back(MemoryReport::vector("similar.terms", terms_));
+    r.items.push_back(MemoryReport::vector("similar.weights", weights_));
+    r.items.push_back(MemoryReport::vector("similar.scale", scale_));
+}
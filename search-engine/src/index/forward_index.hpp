@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "../structures/memory_report.hpp"
+#include "frozen_index.hpp"
+
+struct SimilarOptions {
+    size_t doc_terms = 64;             // terms kept per document vector
+    size_t query_terms = 24;           // of those, the ones whose postings give the candidates
+    uint64_t max_candidates = 200000;  // no more terms are added past this many candidates
+};
+
+struct SimilarHit {
+    int doc = -1;
+    float score = 0.0f;                // cosine of the stored vectors
+};
+
+// Per-document TF-IDF vectors for "more like this". Weights are
+// (1 + ln tf) * ln(N / df), L2-normalized over all terms of the document;
+// only the `doc_terms` heaviest are kept, sorted by term id, as a byte each
+// against a per-document scale. Terms of a single document can match no
+// other one and are not kept.
+class ForwardIndex {
+public:
+    // One pass over `index`, holding the postings of one chunk at a time.
+    static ForwardIndex build(const FrozenIndex& index, size_t doc_count, const SimilarOptions& opt = {});
+
+    // Up to k documents most similar to `doc`, best first, `doc` excluded.
+    // Candidates share one of its heaviest terms; each is scored by a sparse
+    // dot product of the quantized vectors. `index` is the one built from.
+    std::vector<SimilarHit> similar(const FrozenIndex& index, int doc, size_t k) const;
+
+    size_t docCount() const { return scale_.size(); }
+    size_t memoryBytes() const;
+    void memoryUsage(MemoryReport& r) const;
+
+private:
+    SimilarOptions opt_;
+    std::vector<uint32_t> offsets_;    // docCount() + 1, into terms_ and weights_
+    std::vector<uint32_t> terms_;
+    std::vector<uint8_t> weights_;
+    std::vector<float> scale_;         // weight = quantized byte * scale
+
+    // sum of weights[i] * table[terms[i]]
+    static uint32_t dot_(const uint32_t* terms, const uint8_t* weights, size_t n, const uint8_t* table);
+};
@@ -0,0 +1,202 @@
+#include "frozen_index.hpp"
+#include "spimi.hpp"
+#include <algorithm>
+#include <utility>
+
+uint64_t FrozenIndex::hash_(std::string_view s) {
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : s) {
+        h ^= static_cast<uint64_t>(c);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+FrozenIndex FrozenIndex::freeze(HashTable<TermData>& index) {
+    struct Entry { const std::string* key; TermData* td; };
+    std::vector<Entry> entries;
+    entries.reserve(index.size());
+    size_t chars = 0, dirs = 0, shorts = 0, words = 0, pos_bytes = 0;
+    index.forEach([&](const std::string& key, TermData& td) {
+        entries.push_back({&key, &td});
+        chars += key.size();
+        pos_bytes += td.positions.size();
+        for (const auto& c : td.postings.containers()) {
+            ++dirs;
+            (c.kind == PostingList::Kind::Bitmap ? words : shorts) += c.length;
+        }
+    });
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return *a.key < *b.key; });
+
+    FrozenIndex f;
+    const size_t n = entries.size();
+    f.term_chars_.reserve(chars);
+    f.term_offsets_.reserve(n + 1);
+    f.df_.reserve(n);
+    f.total_tf_.reserve(n);
+    f.dir_offsets_.reserve(n + 1);
+    f.dir_.reserve(dirs);
+    f.shorts_.reserve(shorts);
+    f.words_.reserve(words);
+    f.positional_ = true;
+    f.pos_bytes_.reserve(pos_bytes);
+    f.pos_offsets_.reserve(dirs);
+    f.term_offsets_.push_back(0);
+    f.dir_offsets_.push_back(0);
+
+    for (const Entry& e : entries) {
+        f.appendTerm_(*e.key, e.td->total_tf, e.td->postings, &e.td->positions);
+        e.td->postings = PostingList{}; // release as we go to keep the peak down
+        e.td->positions = std::vector<uint8_t>();
+    }
+    index.clear();
+    f.buildLookup_();
+    return f;
+}
+
+bool FrozenIndex::load(SpimiIndexReader& in, FrozenIndex& out, std::string* err) {
+    FrozenIndex f;
+    f.term_offsets_.push_back(0);
+    f.dir_offsets_.push_back(0);
+
+    std::string term, prev;
+    uint32_t total_tf = 0;
+    PostingList postings;
+    while (in.next(term, total_tf, postings)) {
+        if (f.termCount() && term <= prev) {
+            if (err) *err = "Index terms out of order at: " + term;
+            return false;
+        }
+        f.appendTerm_(term, total_tf, postings);
+        prev.swap(term);
+    }
+    if (!in.error().empty()) {
+        if (err) *err = in.error();
+        return false;
+    }
+    f.term_chars_.shrink_to_fit();
+    f.dir_.shrink_to_fit();
+    f.shorts_.shrink_to_fit();
+    f.words_.shrink_to_fit();
+    f.buildLookup_();
+    out = std::move(f);
+    return true;
+}
+
+void FrozenIndex::appendTerm_(std::string_view term, uint32_t total_tf, const PostingList& postings,
+                              const std::vector<uint8_t>* positions) {
+    term_chars_ += term;
+    term_offsets_.push_back((uint32_t)term_chars_.size());
+    df_.push_back((uint32_t)postings.size());
+    total_tf_.push_back(total_tf);
+    postings.appendTo(dir_, shorts_, words_);
+    dir_offsets_.push_back((uint32_t)dir_.size());
+
+    if (!positions) return;
+    const uint64_t base = pos_bytes_.size();
+    pos_bytes_.insert(pos_bytes_.end(), positions->begin(), positions->end());
+    const uint8_t* p = positions->data();
+    for (const auto& c : postings.containers()) {
+        pos_offsets_.push_back(base + (uint64_t)(p - positions->data()));
+        for (uint32_t k = 0; k < c.card; ++k) p = Positions::skip(p);
+    }
+}
+
+void FrozenIndex::buildLookup_() {
+    const size_t n = termCount();
+    size_t cap = 1;
+    while (cap < n * 2) cap <<= 1;
+    slots_.assign(cap, 0);
+    for (uint32_t id = 0; id < n; ++id) {
+        size_t i = (size_t)hash_(term(id)) & (cap - 1);
+        while (slots_[i]) i = (i + 1) & (cap - 1);
+        slots_[i] = id + 1;
+    }
+}
+
+uint32_t FrozenIndex::find(std::string_view term) const {
+    if (slots_.empty()) return kNoTerm;
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = (size_t)hash_(term) & mask; slots_[i]; i = (i + 1) & mask) {
+        const uint32_t id = slots_[i] - 1;
+        if (this->term(id) == term) return id;
+    }
+    return kNoTerm;
+}
+
+PostingList FrozenIndex::postings(uint32_t id) const {
+    const uint32_t b = dir_offsets_[id], e = dir_offsets_[id + 1];
+    return PostingList::view({dir_.data() + b, e - b}, shorts_.data(), words_.data(), df_[id]);
+}
+
+bool FrozenIndex::PositionCursor::seek(int doc, std::vector<uint32_t>& out) {
+    const uint32_t key = (uint32_t)doc >> 16;
+    while (c_ < end_ && index_->dir_[c_].key < key) {
+        ++c_;
+        loaded_ = false;
+    }
+    if (c_ == end_ || index_->dir_[c_].key != key) return false;
+    if (!loaded_) {
+        docs_.clear();
+        PostingList::view({index_->dir_.data() + c_, 1}, index_->shorts_.data(), index_->words_.data(),
+                          index_->dir_[c_].card)
+            .forEach([&](int d) {
+                docs_.push_back(d);
+                return true;
+            });
+        next_ = 0;
+        p_ = index_->pos_bytes_.data() + index_->pos_offsets_[c_];
+        loaded_ = true;
+    }
+    for (; next_ < docs_.size() && docs_[next_] < doc; ++next_) p_ = Positions::skip(p_);
+    if (next_ == docs_.size() || docs_[next_] != doc) return false;
+    p_ = Positions::decode(p_, out);
+    ++next_;
+    return true;
+}
+
+size_t FrozenIndex::memoryBytes() const {
+    return term_chars_.capacity()
+         + term_offsets_.capacity() * sizeof(uint32_t)
+         + df_.capacity() * sizeof(uint32_t)
+         + total_tf_.capacity() * sizeof(uint32_t)
+         + dir_offsets_.capacity() * sizeof(uint32_t)
+         + dir_.capacity() * sizeof(PostingList::Container)
+         + shorts_.capacity() * sizeof(uint16_t)
+         + words_.capacity() * sizeof(uint64_t)
+         + pos_bytes_.capacity()
+         + pos_offsets_.capacity() * sizeof(uint64_t)
+         + slots_.capacity() * sizeof(uint32_t);
+}
+
+void FrozenIndex::memoryUsage(MemoryReport& r) const {
+    r.items.push_back({"index.term_chars", term_chars_.size(), term_chars_.size(), term_chars_.capacity()});
+    r.items.push_back(MemoryReport::vector("index.term_offsets", term_offsets_));
+    r.items.push_back(MemoryReport::vector("index.df", df_));
+    r.items.push_back(MemoryReport::vector("index.total_tf", total_tf_));
+    r.items.push_back(MemoryReport::vector("index.dir_offsets", dir_offsets_));
+    r.items.push_back(MemoryReport::vector("index.dir", dir_));
+    r.items.push_back(MemoryReport::vector("index.shorts", shorts_));
+    r.items.push_back(MemoryReport::vector("index.words", words_));
+    r.items.push_back(MemoryReport::vector("index.pos_bytes", pos_bytes_));
+    r.items.push_back(MemoryReport::vector("index.pos_offsets", pos_offsets_));
+    r.items.push_back(MemoryReport::vector("index.lookup_slots", slots_));
+
+    const size_t n = termCount();
+    std::vector<uint64_t> postings(df_.begin(), df_.end()), bytes(n), pos(positional_ ? n : 0);
+    for (size_t id = 0; id < n; ++id) {
+        uint64_t b = 0;
+        for (uint32_t c = dir_offsets_[id]; c < dir_offsets_[id + 1]; ++c) {
+            b += sizeof(PostingList::Container) +
+                 (uint64_t)dir_[c].length * (dir_[c].kind == PostingList::Kind::Bitmap ? 8 : 2);
+        }
+        bytes[id] = b;
+        if (!positional_ || dir_offsets_[id] == dir_offsets_[id + 1]) continue;
+        const uint32_t e = dir_offsets_[id + 1];
+        pos[id] = (e < pos_offsets_.size() ? pos_offsets_[e] : pos_bytes_.size()) - pos_offsets_[dir_offsets_[id]];
+    }
+    r.distributions.push_back(SizeDistribution::of("postings per term", std::move(postings)));
+    r.distributions.push_back(SizeDistribution::of("posting bytes per term", std::move(bytes)));
+    if (positional_) r.distributions.push_back(SizeDistribution::of("position bytes per term", std::move(pos)));
+}
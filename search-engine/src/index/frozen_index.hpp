@@ -0,0 +1,122 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../structures/hash_table.hpp"
+#include "../structures/memory_report.hpp"
+#include "../structures/posting_list.hpp"
+#include "term_data.hpp"
+#include "positions.hpp"
+
+class SpimiIndexReader;
+
+// Read-only serving layout of a built index. Terms are sorted and numbered;
+// term text, container directories and container payloads each live in one
+// contiguous array indexed through an offsets array (CSR), and per-term
+// statistics are parallel arrays. Lookups go through an open-addressing
+// table of term ids. Posting lists are handed out as views into the arrays.
+// Word positions, when the build recorded them, are one more byte array with
+// the offset of each container's first record kept parallel to the directory.
+class FrozenIndex {
+public:
+    static constexpr uint32_t kNoTerm = UINT32_MAX;
+
+    // Moves every posting list out of `index`, leaving it empty.
+    static FrozenIndex freeze(HashTable<TermData>& index);
+
+    // Reads the rest of an index file written by SpimiBuilder.
+    static bool load(SpimiIndexReader& in, FrozenIndex& out, std::string* err = nullptr);
+
+    size_t termCount() const { return df_.size(); }
+
+    uint32_t find(std::string_view term) const;
+
+    std::string_view term(uint32_t id) const {
+        return {term_chars_.data() + term_offsets_[id], term_offsets_[id + 1] - term_offsets_[id]};
+    }
+    uint32_t df(uint32_t id) const { return df_[id]; }
+    uint32_t totalTf(uint32_t id) const { return total_tf_[id]; }
+
+    // view into this index; valid while the index is alive and unchanged
+    PostingList postings(uint32_t id) const;
+
+    // false for indexes loaded from SPIMI files, which carry no positions
+    bool hasPositions() const { return positional_; }
+
+    // Word positions of one term, doc by doc in ascending order. Only the doc
+    // ids of the current container are held; nothing else is decoded ahead.
+    class PositionCursor {
+    public:
+        PositionCursor(const FrozenIndex& index, uint32_t id)
+            : index_(&index), c_(index.dir_offsets_[id]), end_(index.dir_offsets_[id + 1]) {}
+
+        // Positions of `doc` into `out`; false if the term does not occur in
+        // it. Docs must be asked for in ascending order.
+        bool seek(int doc, std::vector<uint32_t>& out);
+
+    private:
+        const FrozenIndex* index_;
+        uint32_t c_, end_;
+        bool loaded_ = false;
+        std::vector<int> docs_;      // of container c_
+        size_t next_ = 0;            // docs_[next_] is the record at p_
+        const uint8_t* p_ = nullptr;
+    };
+
+    // Every posting, one 65536-doc chunk at a time and `passes` times over
+    // each chunk: fn(term, doc, tf) for its postings term by term (doc ids
+    // ascending within a term), then done(key, pass). tf is the number of
+    // positions, or 1 when the index has none.
+    template <class Fn, class Done>
+    void forEachChunkPosting(int passes, Fn&& fn, Done&& done) const {
+        uint32_t last = 0;
+        for (const auto& c : dir_) last = std::max(last, c.key);
+        std::vector<uint32_t> next(dir_offsets_.begin(), dir_offsets_.end() - (dir_offsets_.empty() ? 0 : 1));
+        for (uint32_t key = 0; !dir_.empty() && key <= last; ++key) {
+            for (int pass = 0; pass < passes; ++pass) {
+                for (uint32_t id = 0; id < next.size(); ++id) {
+                    const uint32_t c = next[id];
+                    if (c == dir_offsets_[id + 1] || dir_[c].key != key) continue;
+                    const uint8_t* p = positional_ ? pos_bytes_.data() + pos_offsets_[c] : nullptr;
+                    PostingList::view({dir_.data() + c, 1}, shorts_.data(), words_.data(), dir_[c].card)
+                        .forEach([&](int doc) {
+                            fn(id, doc, p ? Positions::count(p) : 1u);
+                            return true;
+                        });
+                    if (pass + 1 == passes) next[id] = c + 1;
+                }
+                done(key, pass);
+            }
+        }
+    }
+
+    size_t memoryBytes() const;
+    // each array as a group, with postings and bytes per term
+    void memoryUsage(MemoryReport& r) const;
+
+private:
+    std::string term_chars_;
+    std::vector<uint32_t> term_offsets_;       // termCount() + 1
+
+    std::vector<uint32_t> df_;
+    std::vector<uint32_t> total_tf_;
+
+    std::vector<uint32_t> dir_offsets_;        // termCount() + 1, into dir_
+    std::vector<PostingList::Container> dir_;
+    std::vector<uint16_t> shorts_;
+    std::vector<uint64_t> words_;
+
+    bool positional_ = false;
+    std::vector<uint8_t> pos_bytes_;
+    std::vector<uint64_t> pos_offsets_;        // parallel to dir_, into pos_bytes_
+
+    std::vector<uint32_t> slots_;              // term id + 1, 0 = empty; power-of-two size
+
+    static uint64_t hash_(std::string_view s);
+    void appendTerm_(std::string_view term, uint32_t total_tf, const PostingList& postings,
+                     const std::vector<uint8_t>* positions = nullptr);
+    void buildLookup_();
+};
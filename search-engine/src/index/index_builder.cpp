@@ -1,4 +1,5 @@
 #include "index_builder.hpp"
+#include "positions.hpp"
 #include "../tokenizer/html_strip.hpp"
 #include "../tokenizer/tokenizer.hpp"
 #include "../stemmer/stemmer.hpp"
@@ -7,55 +8,140 @@
 
 BuildStats IndexBuilder::build(std::vector<Document>& docs,
                                HashTable<TermData>& index,
-                               bool enable_stemming) {
+                               bool enable_stemming,
+                               const DedupOptions& dedup) {
     BuildStats stats;
+    BuildProfile& prof = stats.profile;
+    NearDupIndex near_dups(dedup);
+    int next_id = 0;
 
     std::vector<std::string> tokens;
     tokens.reserve(4096);
+    std::vector<uint32_t> order;   // token positions, grouped by term
+    struct Group { TermData* td; size_t begin, end; };
+    std::vector<Group> groups;
 
+    const size_t sample_every = std::max<size_t>(1, docs.size() / 32);
+    StageClock total;
+    uint64_t elapsed = 0;
+    StageClock clk;
+
+    HtmlStripper::ExtractedText text;
     for (auto& d : docs) {
-        d.plain = HtmlStripper::extract_span_text(d.html);
-        d.normalized = HtmlStripper::normalize_for_phrase(d.plain);
+        clk.lap();
+        HtmlStripper::extract_fused(d.html, text);
+        d.plain = text.plain;
+        d.normalized = text.normalized;
 
-        tokens.clear();
-        Tokenizer::tokenize_into(d.plain, tokens, &stats.tokenization);
+        // token strings keep their capacity from earlier documents
+        tokens.resize(text.tokens.size());
+        uint64_t token_chars = 0;
+        for (size_t k = 0; k < text.tokens.size(); ++k) {
+            tokens[k].assign(text.tokens[k]);
+            token_chars += text.tokens[k].size();
+        }
+        // tokenizing is part of the fused pass and has no time of its own
+        const uint64_t extract_ns = clk.lap();
+        stats.tokenization.total_tokens += tokens.size();
+        stats.tokenization.total_token_chars += token_chars;
+        stats.tokenization.bytes_processed += d.plain.size();
+        stats.tokenization.nanos += extract_ns;
+        prof.add(BuildStage::Extract, extract_ns, d.html.size());
+
+        // shingles are taken before stemming so that word forms still count
+        if (dedup.enabled && !tokens.empty()) {
+            const uint64_t fp = NearDupIndex::fingerprint(tokens, dedup.shingle);
+            const bool dup = near_dups.findOrAdd(fp, (uint32_t)next_id) != NearDupIndex::kNone;
+            prof.add(BuildStage::Dedup, clk.lap(), token_chars);
+            if (dup) {
+                d.id = -1;
+                ++stats.duplicates;
+                continue;
+            }
+        }
+        d.id = next_id++;
 
         if (enable_stemming) {
             for (auto& t : tokens) t = Stemmer::stem(t);
+            prof.add(BuildStage::Stem, clk.lap(), token_chars);
         }
 
-        for (const auto& t : tokens) {
-            if (t.empty()) continue;
-            TermData& td = index.getOrCreate(t);
-            td.total_tf += 1;
+        // group occurrences by term; within a term positions stay ascending
+        order.resize(tokens.size());
+        for (uint32_t k = 0; k < order.size(); ++k) order[k] = k;
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            const int c = tokens[a].compare(tokens[b]);
+            return c < 0 || (c == 0 && a < b);
+        });
+        groups.clear();
+        for (size_t g = 0, e; g < order.size(); g = e) {
+            e = g + 1;
+            while (e < order.size() && tokens[order[e]] == tokens[order[g]]) ++e;
+            if (tokens[order[g]].empty()) continue;
+            TermData& td = index.getOrCreate(tokens[order[g]]);
+            td.total_tf += (uint32_t)(e - g);
+            groups.push_back({&td, g, e});
         }
+        prof.add(BuildStage::DictInsert, clk.lap(), token_chars);
 
-        std::sort(tokens.begin(), tokens.end());
-        tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
-
-        for (const auto& t : tokens) {
-            if (t.empty()) continue;
-            TermData& td = index.getOrCreate(t);
-            td.postings.addSortedUnique(d.id);
+        uint64_t unique_chars = 0;
+        for (const Group& g : groups) {
+            g.td->postings.addSortedUnique(d.id);
+            Positions::append(g.td->positions, order.data() + g.begin, g.end - g.begin);
+            unique_chars += tokens[order[g.begin]].size();
         }
+        prof.add(BuildStage::PostingAppend, clk.lap(), unique_chars);
 
         stats.docs_indexed += 1;
+        elapsed += total.lap();
+        if (stats.docs_indexed % sample_every == 0) {
+            prof.dict_growth.push_back({stats.docs_indexed, (uint64_t)index.size(), elapsed});
+        }
+        clk.lap(); // growth sampling is not part of any stage
+    }
+    elapsed += total.lap();
+    if (prof.dict_growth.empty() || prof.dict_growth.back().docs != stats.docs_indexed) {
+        prof.dict_growth.push_back({stats.docs_indexed, (uint64_t)index.size(), elapsed});
     }
+    if (stats.duplicates) {
+        docs.erase(std::remove_if(docs.begin(), docs.end(), [](const Document& d) { return d.id < 0; }),
+                   docs.end());
+    }
+    clk.lap();
 
+    // pick array/bitmap/run per chunk now that every list is complete
+    uint64_t posting_bytes = 0;
+    index.forEach([&](const std::string&, TermData& td) {
+        td.postings.optimize();
+        posting_bytes += td.postings.memoryBytes();
+    });
+    const uint64_t finalize_ns = clk.lap();
+    prof.add(BuildStage::Finalize, finalize_ns, posting_bytes, 0);
+    elapsed += finalize_ns;
+
+    prof.total_nanos = elapsed;
+    prof.peak_rss_kb = BuildProfile::peakRssKb();
     stats.unique_terms = index.size();
     return stats;
 }
 
-void IndexBuilder::export_zipf_csv(const HashTable<TermData>& index,
+void IndexBuilder::prepare_text(Document& d) {
+    HtmlStripper::ExtractedText text;
+    HtmlStripper::extract_fused(d.html, text);
+    d.plain = text.plain;
+    d.normalized = text.normalized;
+}
+
+void IndexBuilder::export_zipf_csv(const FrozenIndex& index,
                                   const std::string& path_csv,
                                   size_t max_terms) {
-    struct Row { std::string term; uint32_t tf; };
+    struct Row { std::string_view term; uint32_t tf; };
     std::vector<Row> rows;
-    rows.reserve(index.size());
+    rows.reserve(index.termCount());
 
-    index.forEach([&](const std::string& key, const TermData& td){
-        rows.push_back({key, td.total_tf});
-    });
+    for (uint32_t id = 0; id < index.termCount(); ++id) {
+        rows.push_back({index.term(id), index.totalTf(id)});
+    }
 
     std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b){
         return a.tf > b.tf;
@@ -68,3 +154,18 @@ void IndexBuilder::export_zipf_csv(const HashTable<TermData>& index,
         f << (i+1) << "," << rows[i].term << "," << rows[i].tf << "\n";
     }
 }
+
+void IndexBuilder::memoryUsage(const HashTable<TermData>& index, std::vector<MemoryItem>& out) {
+    index.memoryUsage("dict", out);
+    MemoryItem postings{"dict.postings"}, positions{"dict.positions"};
+    index.forEach([&](const std::string&, const TermData& td) {
+        ++postings.count;
+        postings.used += td.postings.usedBytes();
+        postings.reserved += td.postings.memoryBytes();
+        positions.count += td.positions.empty() ? 0 : 1;
+        positions.used += td.positions.size();
+        positions.reserved += td.positions.capacity();
+    });
+    out.push_back(std::move(postings));
+    out.push_back(std::move(positions));
+}
@@ -4,21 +4,36 @@
 #include "../document.hpp"
 #include "../structures/hash_table.hpp"
 #include "term_data.hpp"
+#include "frozen_index.hpp"
+#include "build_profile.hpp"
+#include "near_dup.hpp"
 #include "../tokenizer/tokenizer.hpp"
 
 struct BuildStats {
     TokenizationStats tokenization;
     uint64_t docs_indexed = 0;
     uint64_t unique_terms = 0;
+    uint64_t duplicates = 0;   // near-duplicates dropped before indexing
+    BuildProfile profile;
 };
 
 class IndexBuilder {
 public:
+    // Assigns doc ids in order. With dedup enabled, near-duplicates of an
+    // earlier document are not indexed and are removed from `docs`.
     static BuildStats build(std::vector<Document>& docs,
                             HashTable<TermData>& index,
-                            bool enable_stemming);
+                            bool enable_stemming,
+                            const DedupOptions& dedup = {});
 
-    static void export_zipf_csv(const HashTable<TermData>& index,
+    // Fills d.plain and d.normalized from d.html the way build() does.
+    static void prepare_text(Document& d);
+
+    // Heap of the build-time dictionary: the table, then the posting lists
+    // and positions of its terms.
+    static void memoryUsage(const HashTable<TermData>& index, std::vector<MemoryItem>& out);
+
+    static void export_zipf_csv(const FrozenIndex& index,
                                 const std::string& path_csv,
                                 size_t max_terms = 0);
 };
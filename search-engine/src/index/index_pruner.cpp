@@ -0,0 +1,156 @@
+#include "index_pruner.hpp"
+#include "positions.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+constexpr double kK1 = 1.2, kB = 0.75;
+constexpr size_t kBuckets = 4096;
+
+struct Scored {
+    float impact;
+    uint32_t cost;     // bytes: an array container entry and the positions record
+    uint32_t key;      // container, doc >> 16
+    bool forced;       // in the term's keep_top
+    bool capped;       // past the term's max_postings
+};
+
+// Doc lengths in tokens, and their average from the terms' collection counts.
+struct Lengths {
+    std::vector<uint32_t> doc;
+    double avg = 1.0;
+};
+
+Lengths doc_lengths(const HashTable<TermData>& index, size_t doc_count) {
+    Lengths l;
+    l.doc.assign(doc_count, 0);
+    uint64_t tokens = 0;
+    index.forEach([&](const std::string&, const TermData& td) {
+        tokens += td.total_tf;
+        const uint8_t* p = td.positions.data();
+        const bool positional = !td.positions.empty();
+        td.postings.forEach([&](int d) {
+            l.doc[d] += positional ? Positions::count(p) : 1;
+            return true;
+        });
+    });
+    if (doc_count && tokens) l.avg = (double)tokens / (double)doc_count;
+    return l;
+}
+
+// Impacts of the term's postings in posting order, with their rank classes.
+void score_term(const TermData& td, const Lengths& len, size_t doc_count, const PruneOptions& opt,
+                std::vector<Scored>& out, std::vector<uint32_t>& order) {
+    out.clear();
+    const double df = (double)td.postings.size();
+    const double idf = std::log(1.0 + ((double)doc_count - df + 0.5) / (df + 0.5));
+    const uint8_t* p = td.positions.data();
+    const bool positional = !td.positions.empty();
+    td.postings.forEach([&](int d) {
+        const uint8_t* start = p;
+        const double tf = positional ? (double)Positions::count(p) : 1.0;
+        const double norm = kK1 * (1.0 - kB + kB * (double)len.doc[d] / len.avg);
+        out.push_back({(float)(idf * tf * (kK1 + 1.0) / (tf + norm)), 2u + (uint32_t)(p - start), (uint32_t)d >> 16,
+                       false, false});
+        return true;
+    });
+
+    const size_t n = out.size();
+    const size_t cap = opt.max_postings ? std::min<size_t>(opt.max_postings, n) : n;
+    const size_t ranked = std::min(n, std::max<size_t>(opt.keep_top, opt.max_postings ? cap : 0));
+    if (n <= opt.keep_top && cap == n) {
+        for (auto& s : out) s.forced = true;
+        return;
+    }
+    // rank by impact, ties to the lower doc id; past `ranked` order does not matter
+    order.resize(n);
+    for (uint32_t i = 0; i < n; ++i) order[i] = i;
+    std::partial_sort(order.begin(), order.begin() + ranked, order.end(), [&](uint32_t a, uint32_t b) {
+        return out[a].impact != out[b].impact ? out[a].impact > out[b].impact : a < b;
+    });
+    for (size_t r = 0; r < n; ++r) {
+        out[order[r]].forced = r < opt.keep_top && r < cap;
+        out[order[r]].capped = r >= cap;
+    }
+}
+
+} // namespace
+
+PruneStats IndexPruner::prune(HashTable<TermData>& index, size_t doc_count, const PruneOptions& opt) {
+    PruneStats st;
+    const Lengths len = doc_lengths(index, doc_count);
+    std::vector<Scored> scored;
+    std::vector<uint32_t> order;
+
+    // Cost histogram by impact of what the threshold decides on. A container
+    // is charged to the best posting of its chunk: it stays while that does.
+    // Bitmap containers are costed as arrays, which only overestimates.
+    const double top = (kK1 + 1.0) * std::log(1.0 + ((double)doc_count + 0.5) / 1.5);
+    auto bucket = [&](float impact) { return std::min(kBuckets - 1, (size_t)(impact / top * kBuckets)); };
+    std::vector<uint64_t> cost_at(kBuckets, 0);
+    uint64_t forced_cost = 0;
+    index.forEach([&](const std::string&, const TermData& td) {
+        st.postings_before += td.postings.size();
+        st.bytes_before += td.postings.usedBytes() + td.positions.size();
+        score_term(td, len, doc_count, opt, scored, order);
+        for (size_t i = 0; i < scored.size();) {
+            size_t e = i;
+            bool forced = false;
+            float best = -1.0f;
+            for (; e < scored.size() && scored[e].key == scored[i].key; ++e) {
+                const Scored& s = scored[e];
+                if (s.forced) forced_cost += s.cost;
+                else if (!s.capped) cost_at[bucket(s.impact)] += s.cost;
+                forced |= s.forced;
+                if (!s.capped) best = std::max(best, s.impact);
+            }
+            if (forced) forced_cost += sizeof(PostingList::Container);
+            else if (best >= 0.0f) cost_at[bucket(best)] += sizeof(PostingList::Container);
+            i = e;
+        }
+    });
+
+    double threshold = opt.min_impact;
+    if (opt.budget_bytes) {
+        // keep the highest buckets that fit next to the forced postings
+        uint64_t kept = forced_cost;
+        size_t b = kBuckets;
+        while (b > 0 && kept + cost_at[b - 1] <= opt.budget_bytes) kept += cost_at[--b];
+        st.budget_met = forced_cost <= opt.budget_bytes;
+        if (b > 0) threshold = std::max(threshold, b == kBuckets ? std::numeric_limits<double>::infinity()
+                                                                 : top * (double)b / kBuckets);
+    }
+    st.threshold = threshold;
+
+    std::vector<uint8_t> positions;
+    index.forEach([&](const std::string&, TermData& td) {
+        score_term(td, len, doc_count, opt, scored, order);
+        PostingList list;
+        positions.clear();
+        const uint8_t* p = td.positions.data();
+        const bool positional = !td.positions.empty();
+        bool capped = false;
+        size_t i = 0;
+        td.postings.forEach([&](int d) {
+            const uint8_t* e = positional ? Positions::skip(p) : p;
+            const Scored& s = scored[i++];
+            capped |= s.capped;
+            if (s.forced || (!s.capped && s.impact >= threshold)) {
+                list.addSortedUnique(d);
+                positions.insert(positions.end(), p, e);
+            }
+            p = e;
+            return true;
+        });
+        st.capped_terms += capped;
+        list.optimize();
+        td.postings = std::move(list);
+        td.positions = std::vector<uint8_t>(positions.begin(), positions.end());   // total_tf stays the corpus count
+        st.postings_after += td.postings.size();
+        st.bytes_after += td.postings.usedBytes() + td.positions.size();
+    });
+    if (opt.budget_bytes && st.bytes_after > opt.budget_bytes) st.budget_met = false;
+    return st;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "../structures/hash_table.hpp"
+#include "build_profile.hpp"
+#include "term_data.hpp"
+
+struct PruneOptions {
+    uint64_t budget_bytes = 0;    // posting lists and positions after pruning; 0 = no budget
+    uint32_t max_postings = 0;    // per-list cap, keeping the highest impacts; 0 = no cap
+    double min_impact = 0.0;      // postings scoring lower are dropped
+    uint32_t keep_top = 10;       // highest-impact postings of each term, kept whatever the threshold
+
+    bool enabled() const { return budget_bytes || max_postings || min_impact > 0.0; }
+};
+
+// Static index pruning after the build. Each posting is scored by its BM25
+// impact (tf from its positions, document length from all of them, average
+// length from the terms' total_tf), and
+//  - lists longer than max_postings keep only their top postings,
+//  - elsewhere postings below an impact threshold are dropped: min_impact,
+//    raised as far as needed to bring the estimated size under budget_bytes,
+//  - the keep_top best postings of a term always stay, so no term vanishes
+//    (a missing term would empty every AND it is part of).
+// Positions are dropped with their postings. Doc ids are unchanged, so a
+// pruned index can be compared with the full one query by query.
+class IndexPruner {
+public:
+    static PruneStats prune(HashTable<TermData>& index, size_t doc_count, const PruneOptions& opt);
+};
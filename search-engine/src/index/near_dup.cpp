@@ -0,0 +1,90 @@
+#include "near_dup.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+
+namespace {
+
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t fnv1a(uint64_t h, const std::string& s) {
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+} // namespace
+
+NearDupIndex::NearDupIndex(const DedupOptions& opt)
+    : max_distance_(std::clamp(opt.max_distance, 0, 7)) {
+    const int n = max_distance_ + 1;
+    for (int b = 0, shift = 0; b < n; ++b) {
+        const int width = 64 / n + (b < 64 % n ? 1 : 0);
+        bands_.push_back({shift, width == 64 ? ~0ull : (1ull << width) - 1});
+        shift += width;
+    }
+}
+
+uint64_t NearDupIndex::fingerprint(const std::vector<std::string>& tokens, size_t shingle) {
+    const size_t k = std::max<size_t>(1, std::min(shingle, tokens.size()));
+    std::vector<uint64_t> words(tokens.size());
+    for (size_t i = 0; i < tokens.size(); ++i) words[i] = fnv1a(14695981039346656037ull, tokens[i]);
+
+    // Bit votes are counted eight at a time: kSpread[v] holds bit j of v in
+    // byte j, so adding it bumps eight byte-wide counters. They are drained
+    // into `ones` before any can overflow.
+    static constexpr auto kSpread = [] {
+        std::array<uint64_t, 256> t{};
+        for (int v = 0; v < 256; ++v) {
+            for (int j = 0; j < 8; ++j) t[v] |= (uint64_t)((v >> j) & 1) << (8 * j);
+        }
+        return t;
+    }();
+    uint64_t packed[8] = {};
+    uint32_t ones[64] = {};
+    auto drain = [&] {
+        for (int g = 0; g < 8; ++g) {
+            for (int j = 0; j < 8; ++j) ones[g * 8 + j] += (packed[g] >> (8 * j)) & 0xFF;
+            packed[g] = 0;
+        }
+    };
+
+    const size_t shingles = tokens.size() - k + 1;
+    for (size_t i = 0; i < shingles; ++i) {
+        uint64_t h = 0;
+        for (size_t j = 0; j < k; ++j) h = mix64(h ^ words[i + j]);
+        for (int g = 0; g < 8; ++g) packed[g] += kSpread[(h >> (8 * g)) & 0xFF];
+        if (i % 255 == 254) drain();
+    }
+    drain();
+
+    uint64_t fp = 0;
+    for (int b = 0; b < 64; ++b) {
+        if (2 * (uint64_t)ones[b] > shingles) fp |= 1ull << b;
+    }
+    return fp;
+}
+
+uint32_t NearDupIndex::findOrAdd(uint64_t fp, uint32_t doc) {
+    for (size_t b = 0; b < bands_.size(); ++b) {
+        auto it = buckets_.find(key_(b, fp));
+        if (it == buckets_.end()) continue;
+        for (uint32_t slot : it->second) {
+            if (std::popcount(fps_[slot] ^ fp) <= max_distance_) return docs_[slot];
+        }
+    }
+    const uint32_t slot = (uint32_t)fps_.size();
+    fps_.push_back(fp);
+    docs_.push_back(doc);
+    for (size_t b = 0; b < bands_.size(); ++b) buckets_[key_(b, fp)].push_back(slot);
+    return kNone;
+}
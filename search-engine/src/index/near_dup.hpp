@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct DedupOptions {
+    bool enabled = false;
+    size_t shingle = 3;       // words per shingle
+    int max_distance = 3;     // Hamming distance (of 64 bits) still counted as a duplicate
+};
+
+// Near-duplicate detection with 64-bit SimHash fingerprints over word
+// shingles. Fingerprints are split into max_distance + 1 bands: two within
+// max_distance bits agree exactly on at least one band (pigeonhole), so
+// only documents sharing a band bucket are compared.
+class NearDupIndex {
+public:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    explicit NearDupIndex(const DedupOptions& opt);
+
+    static uint64_t fingerprint(const std::vector<std::string>& tokens, size_t shingle);
+
+    // The earlier document `fp` duplicates, or kNone after recording `doc` as
+    // a new canonical document.
+    uint32_t findOrAdd(uint64_t fp, uint32_t doc);
+
+    size_t size() const { return fps_.size(); }
+
+private:
+    struct Band { int shift; uint64_t mask; };
+
+    int max_distance_;
+    std::vector<Band> bands_;
+    std::vector<uint64_t> fps_;     // canonical fingerprints
+    std::vector<uint32_t> docs_;    // their document ids
+    std::unordered_map<uint64_t, std::vector<uint32_t>> buckets_;   // (band, value) -> slots in fps_
+
+    uint64_t key_(size_t band, uint64_t fp) const {
+        return ((fp >> bands_[band].shift) & bands_[band].mask) << 3 | band;
+    }
+};
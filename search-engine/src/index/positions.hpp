@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Word positions of one term in one document, stored per posting in posting
+// order as a self-delimiting record:
+//
+//   varint payload_bytes, then the positions as varints: the first one
+//   absolute, each following one as the gap from the previous.
+//
+// Spans: a term occurrence covers one position, a phrase occurrence `len`
+// consecutive ones starting at its first word.
+class Positions {
+public:
+    static void append(std::vector<uint8_t>& out, const uint32_t* pos, size_t n) {
+        size_t bytes = 0;
+        for (size_t i = 0; i < n; ++i) bytes += varintSize_(i ? pos[i] - pos[i - 1] : pos[i]);
+        putVarint_(out, bytes);
+        for (size_t i = 0; i < n; ++i) putVarint_(out, i ? pos[i] - pos[i - 1] : pos[i]);
+    }
+
+    // decodes the record at `p` into `out`; returns the end of the record
+    static const uint8_t* decode(const uint8_t* p, std::vector<uint32_t>& out) {
+        out.clear();
+        const uint8_t* end = p;
+        const uint64_t bytes = getVarint_(end);
+        p = end;
+        end += bytes;
+        uint32_t pos = 0;
+        while (p < end) {
+            pos += (uint32_t)getVarint_(p);
+            out.push_back(pos);
+        }
+        return end;
+    }
+
+    // number of positions in the record at `p`; moves `p` past the record
+    static uint32_t count(const uint8_t*& p) {
+        const uint64_t bytes = getVarint_(p);
+        const uint8_t* end = p + bytes;
+        uint32_t n = 0;
+        for (; p < end; ++p) n += (*p & 0x80) == 0;
+        return n;
+    }
+
+    static const uint8_t* skip(const uint8_t* p) {
+        const uint64_t bytes = getVarint_(p);
+        return p + bytes;
+    }
+
+    // True if a span of `a` (len la) and a span of `b` (len lb) do not overlap
+    // and one starts at most k positions after the other ends (k = 1: adjacent);
+    // with `ordered` the `a` span must come first. Both lists ascending.
+    static bool near(const std::vector<uint32_t>& a, uint32_t la,
+                     const std::vector<uint32_t>& b, uint32_t lb, uint32_t k, bool ordered) {
+        return before_(a, la, b, k) || (!ordered && before_(b, lb, a, k));
+    }
+
+    // Starts of the phrase whose words occur at `lists[0]`, `lists[1]`, ...
+    static void phraseStarts(const std::vector<std::vector<uint32_t>>& lists, std::vector<uint32_t>& out) {
+        out.clear();
+        if (lists.empty()) return;
+        std::vector<size_t> at(lists.size(), 0);
+        for (uint32_t s : lists[0]) {
+            bool all = true;
+            for (size_t w = 1; w < lists.size() && all; ++w) {
+                const auto& l = lists[w];
+                while (at[w] < l.size() && l[at[w]] < s + w) ++at[w];
+                all = at[w] < l.size() && l[at[w]] == s + w;
+            }
+            if (all) out.push_back(s);
+        }
+    }
+
+private:
+    // an `x` span ends before a `y` span starts, at most k positions earlier
+    static bool before_(const std::vector<uint32_t>& x, uint32_t lx, const std::vector<uint32_t>& y, uint32_t k) {
+        size_t j = 0;
+        for (uint32_t s : x) {
+            const uint32_t end = s + lx - 1;
+            while (j < y.size() && y[j] <= end) ++j;
+            if (j == y.size()) return false;
+            if (y[j] - end <= k) return true;
+        }
+        return false;
+    }
+
+    static size_t varintSize_(uint64_t v) {
+        size_t n = 1;
+        while (v >= 0x80) { v >>= 7; ++n; }
+        return n;
+    }
+
+    static void putVarint_(std::vector<uint8_t>& out, uint64_t v) {
+        while (v >= 0x80) {
+            out.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((uint8_t)v);
+    }
+
+    static uint64_t getVarint_(const uint8_t*& p) {
+        uint64_t v = 0;
+        for (int shift = 0;; shift += 7) {
+            const uint8_t b = *p++;
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+    }
+};
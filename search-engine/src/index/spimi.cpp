@@ -0,0 +1,302 @@
+#include "spimi.hpp"
+#include "build_profile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <queue>
+#include <utility>
+
+namespace {
+
+constexpr char kRunMagic[4] = {'S', 'P', 'R', '1'};
+constexpr char kIndexMagic[4] = {'S', 'P', 'X', '1'};
+constexpr size_t kMaxFanIn = 64;          // open runs per merge pass
+constexpr size_t kTermOverhead = 96;      // hash node, key and vector headers
+constexpr size_t kRunBuffer = 128 << 10;  // per open run while merging
+
+struct Record {
+    std::string term;
+    uint64_t tf = 0, df = 0, first = 0, last = 0, gap_bytes = 0;
+
+    // false at the end marker or on a short read (`bad` tells which)
+    bool read(BinaryReader& in, bool& bad) {
+        bad = true;
+        uint64_t len = 0;
+        if (!in.getVarint(len)) return false;
+        if (len == 0) { bad = false; return false; }
+        term.resize(len);
+        if (!in.getBytes(term.data(), len)) return false;
+        if (!in.getVarint(tf) || !in.getVarint(df) || !in.getVarint(first) ||
+            !in.getVarint(last) || !in.getVarint(gap_bytes)) return false;
+        bad = false;
+        return true;
+    }
+
+    void writeHeader(BinaryWriter& out) const {
+        out.putVarint(term.size());
+        out.putBytes(term.data(), term.size());
+        out.putVarint(tf);
+        out.putVarint(df);
+        out.putVarint(first);
+        out.putVarint(last);
+        out.putVarint(gap_bytes);
+    }
+};
+
+bool check_magic(BinaryReader& in, const char (&magic)[4]) {
+    char m[4];
+    return in.getBytes(m, 4) && std::memcmp(m, magic, 4) == 0;
+}
+
+} // namespace
+
+SpimiBuilder::SpimiBuilder(std::string out_path, SpimiOptions opt)
+    : out_path_(std::move(out_path)), opt_(std::move(opt)), block_(1 << 16) {
+    if (opt_.tmp_dir.empty()) {
+        std::filesystem::path p(out_path_);
+        opt_.tmp_dir = p.has_parent_path() ? p.parent_path().string() : ".";
+    }
+}
+
+SpimiBuilder::~SpimiBuilder() { removeRuns_(); }
+
+bool SpimiBuilder::addDocument(std::vector<std::string>& terms, std::string* err) {
+    StageClock clk;
+    const uint32_t doc = (uint32_t)stats_.docs++;
+    for (const auto& t : terms) {
+        if (t.empty()) continue;
+        BlockTerm* bt = block_.find(t);
+        if (!bt) {
+            bt = &block_.getOrCreate(t);
+            block_bytes_ += t.size() + kTermOverhead;
+        }
+        bt->tf += 1;
+        if (bt->docs.empty() || bt->docs.back() != doc) {
+            const size_t cap = bt->docs.capacity();
+            bt->docs.push_back(doc);
+            block_bytes_ += (bt->docs.capacity() - cap) * sizeof(uint32_t);
+            ++stats_.postings;
+        }
+    }
+    stats_.invert_nanos += clk.lap();
+
+    if (block_bytes_ >= opt_.budget_bytes) return spill_(err);
+    return true;
+}
+
+bool SpimiBuilder::spill_(std::string* err) {
+    if (block_.size() == 0) return true;
+    StageClock clk;
+
+    struct Entry { const std::string* term; const BlockTerm* bt; };
+    std::vector<Entry> entries;
+    entries.reserve(block_.size());
+    block_.forEach([&](const std::string& k, const BlockTerm& bt) { entries.push_back({&k, &bt}); });
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return *a.term < *b.term; });
+
+    std::string path = (std::filesystem::path(opt_.tmp_dir) /
+                        (std::filesystem::path(out_path_).filename().string() + ".run" +
+                         std::to_string(runs_.size()))).string();
+    BinaryWriter out;
+    if (!out.open(path)) {
+        if (err) *err = "Cannot create run file: " + path;
+        return false;
+    }
+    runs_.push_back(path);
+    out.putBytes(kRunMagic, 4);
+
+    Record r;
+    for (const Entry& e : entries) {
+        const auto& docs = e.bt->docs;
+        r.term = *e.term;
+        r.tf = e.bt->tf;
+        r.df = docs.size();
+        r.first = docs.front();
+        r.last = docs.back();
+        r.gap_bytes = 0;
+        for (size_t i = 1; i < docs.size(); ++i) r.gap_bytes += BinaryWriter::varintSize(docs[i] - docs[i - 1]);
+        r.writeHeader(out);
+        for (size_t i = 1; i < docs.size(); ++i) out.putVarint(docs[i] - docs[i - 1]);
+    }
+    out.putVarint(0);
+    stats_.run_bytes += out.written();
+    if (!out.close()) {
+        if (err) *err = "Write error on run file: " + path;
+        return false;
+    }
+
+    block_.clear();
+    block_bytes_ = 0;
+    ++stats_.runs;
+    stats_.spill_nanos += clk.lap();
+    return true;
+}
+
+// Merges consecutive runs into `out`; each input covers a later doc range
+// than the one before it, so a term's postings are concatenated in input order.
+static bool merge_runs(const std::vector<std::string>& inputs, BinaryWriter& out,
+                       uint64_t* terms, std::string* err) {
+    struct Cursor {
+        BinaryReader in{kRunBuffer};
+        Record rec;
+    };
+    std::vector<Cursor> cur(inputs.size());
+
+    auto later = [&](size_t a, size_t b) {
+        int c = cur[a].rec.term.compare(cur[b].rec.term);
+        return c > 0 || (c == 0 && a > b);
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap(later);
+
+    auto advance = [&](size_t i) {
+        bool bad = false;
+        if (cur[i].rec.read(cur[i].in, bad)) { heap.push(i); return true; }
+        if (bad && err) *err = "Truncated run file: " + inputs[i];
+        return !bad;
+    };
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (!cur[i].in.open(inputs[i]) || !check_magic(cur[i].in, kRunMagic)) {
+            if (err) *err = "Cannot read run file: " + inputs[i];
+            return false;
+        }
+        if (!advance(i)) return false;
+    }
+
+    std::vector<size_t> group;
+    Record merged;
+    while (!heap.empty()) {
+        group.clear();
+        group.push_back(heap.top());
+        heap.pop();
+        while (!heap.empty() && cur[heap.top()].rec.term == cur[group[0]].rec.term) {
+            group.push_back(heap.top());
+            heap.pop();
+        }
+
+        merged.term = cur[group[0]].rec.term;
+        merged.tf = merged.df = merged.gap_bytes = 0;
+        merged.first = cur[group[0]].rec.first;
+        merged.last = cur[group.back()].rec.last;
+        for (size_t k = 0; k < group.size(); ++k) {
+            const Record& r = cur[group[k]].rec;
+            merged.tf += r.tf;
+            merged.df += r.df;
+            merged.gap_bytes += r.gap_bytes;
+            if (k) merged.gap_bytes += BinaryWriter::varintSize(r.first - cur[group[k - 1]].rec.last);
+        }
+        merged.writeHeader(out);
+        for (size_t k = 0; k < group.size(); ++k) {
+            Cursor& c = cur[group[k]];
+            if (k) out.putVarint(c.rec.first - cur[group[k - 1]].rec.last);
+            if (!c.in.copyTo(out, c.rec.gap_bytes)) {
+                if (err) *err = "Truncated run file: " + inputs[group[k]];
+                return false;
+            }
+        }
+        if (terms) ++*terms;
+        for (size_t i : group) {
+            if (!advance(i)) return false;
+        }
+    }
+    out.putVarint(0);
+    return true;
+}
+
+bool SpimiBuilder::merge_(std::string* err) {
+    // cap open files: merge groups of consecutive runs until one pass suffices
+    size_t pass = 0;
+    while (runs_.size() > kMaxFanIn) {
+        std::vector<std::string> next;
+        for (size_t i = 0; i < runs_.size(); i += kMaxFanIn) {
+            std::vector<std::string> group(runs_.begin() + i,
+                                           runs_.begin() + std::min(runs_.size(), i + kMaxFanIn));
+            std::string path = (std::filesystem::path(opt_.tmp_dir) /
+                                (std::filesystem::path(out_path_).filename().string() + ".pass" +
+                                 std::to_string(pass) + "." + std::to_string(next.size()))).string();
+            BinaryWriter out;
+            if (!out.open(path)) {
+                if (err) *err = "Cannot create run file: " + path;
+                return false;
+            }
+            next.push_back(path);
+            out.putBytes(kRunMagic, 4);
+            if (!merge_runs(group, out, nullptr, err)) return false;
+            if (!out.close()) {
+                if (err) *err = "Write error on run file: " + path;
+                return false;
+            }
+            for (const auto& g : group) std::filesystem::remove(g);
+        }
+        runs_ = std::move(next);
+        ++pass;
+    }
+
+    BinaryWriter out;
+    if (!out.open(out_path_)) {
+        if (err) *err = "Cannot create index file: " + out_path_;
+        return false;
+    }
+    out.putBytes(kIndexMagic, 4);
+    out.putVarint(stats_.docs);
+    if (!merge_runs(runs_, out, &stats_.terms, err)) return false;
+    stats_.index_bytes = out.written();
+    if (!out.close()) {
+        if (err) *err = "Write error on index file: " + out_path_;
+        return false;
+    }
+    return true;
+}
+
+bool SpimiBuilder::finish(std::string* err) {
+    if (!spill_(err)) return false;
+    StageClock clk;
+    const bool ok = merge_(err);
+    stats_.merge_nanos += clk.lap();
+    removeRuns_();
+    return ok;
+}
+
+void SpimiBuilder::removeRuns_() {
+    std::error_code ec;
+    for (const auto& r : runs_) std::filesystem::remove(r, ec);
+    runs_.clear();
+}
+
+bool SpimiIndexReader::open(const std::string& path, std::string* err) {
+    if (!in_.open(path) || !check_magic(in_, kIndexMagic) || !in_.getVarint(docs_)) {
+        if (err) *err = "Not an index file: " + path;
+        return false;
+    }
+    return true;
+}
+
+bool SpimiIndexReader::next(std::string& term, uint32_t& total_tf, PostingList& postings) {
+    Record r;
+    bool bad = false;
+    if (!r.read(in_, bad)) {
+        if (bad) error_ = "Truncated index file";
+        return false;
+    }
+    postings = PostingList{};
+    uint64_t doc = r.first;
+    postings.addSortedUnique((int)doc);
+    for (uint64_t i = 1; i < r.df; ++i) {
+        uint64_t gap = 0;
+        if (!in_.getVarint(gap)) {
+            error_ = "Truncated index file";
+            return false;
+        }
+        doc += gap;
+        postings.addSortedUnique((int)doc);
+    }
+    if (doc != r.last || doc >= docs_) {
+        error_ = "Corrupt postings for term: " + r.term;
+        return false;
+    }
+    postings.optimize();
+    term = std::move(r.term);
+    total_tf = (uint32_t)r.tf;
+    return true;
+}
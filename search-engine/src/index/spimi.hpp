@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "binary_io.hpp"
+#include "../structures/hash_table.hpp"
+#include "../structures/posting_list.hpp"
+
+// Single-pass in-memory indexing (SPIMI) for corpora larger than RAM.
+//
+// Documents are inverted into a block until its estimated size reaches the
+// budget; the block is then written sorted by term as a run file and cleared.
+// finish() k-way merges the runs into one index file. Run files and the
+// index share one record format:
+//
+//   varint term_len (0 ends the file), term bytes,
+//   varint total_tf, varint df, varint first_doc, varint last_doc,
+//   varint gap_bytes, then df - 1 doc-id gaps as varints (gap_bytes long).
+//
+// Runs cover increasing doc-id ranges, so merging a term only re-encodes the
+// gap at each run boundary; the rest of its postings are copied as bytes.
+
+struct SpimiOptions {
+    size_t budget_bytes = size_t{256} << 20;
+    std::string tmp_dir;          // run files; default: next to the output
+    bool enable_stemming = true;
+};
+
+struct SpimiStats {
+    uint64_t docs = 0;
+    uint64_t runs = 0;
+    uint64_t terms = 0;
+    uint64_t postings = 0;
+    uint64_t run_bytes = 0;       // spilled to run files
+    uint64_t index_bytes = 0;     // final index file
+    uint64_t invert_nanos = 0;
+    uint64_t spill_nanos = 0;
+    uint64_t merge_nanos = 0;
+};
+
+class SpimiBuilder {
+public:
+    SpimiBuilder(std::string out_path, SpimiOptions opt);
+    ~SpimiBuilder();
+
+    SpimiBuilder(const SpimiBuilder&) = delete;
+    SpimiBuilder& operator=(const SpimiBuilder&) = delete;
+
+    // Doc ids are assigned in call order. `terms` is consumed (sorted in place).
+    bool addDocument(std::vector<std::string>& terms, std::string* err = nullptr);
+
+    // Spills the last block, merges all runs into the index file and removes them.
+    bool finish(std::string* err = nullptr);
+
+    const SpimiStats& stats() const { return stats_; }
+    const SpimiOptions& options() const { return opt_; }
+
+private:
+    struct BlockTerm {
+        std::vector<uint32_t> docs;
+        uint32_t tf = 0;
+    };
+
+    std::string out_path_;
+    SpimiOptions opt_;
+    SpimiStats stats_;
+    HashTable<BlockTerm> block_;
+    size_t block_bytes_ = 0;
+    std::vector<std::string> runs_;
+
+    bool spill_(std::string* err);
+    bool merge_(std::string* err);
+    void removeRuns_();
+};
+
+// Streams the terms of an index file written by SpimiBuilder, in term order.
+class SpimiIndexReader {
+public:
+    bool open(const std::string& path, std::string* err = nullptr);
+
+    uint64_t docCount() const { return docs_; }
+
+    // false at the end of the index or on a read error (then error() is set)
+    bool next(std::string& term, uint32_t& total_tf, PostingList& postings);
+
+    const std::string& error() const { return error_; }
+
+private:
+    BinaryReader in_;
+    uint64_t docs_ = 0;
+    std::string error_;
+};
@@ -1,8 +1,10 @@
 #pragma once
 #include <cstdint>
+#include <vector>
 #include "../structures/posting_list.hpp"
 
 struct TermData {
     PostingList postings;
     uint32_t total_tf = 0;
+    std::vector<uint8_t> positions;   // one Positions record per posting, in order
 };
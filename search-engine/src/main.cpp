@@ -1,6 +1,7 @@
 #include "search/search_engine.hpp"
 #include "web/web_server.hpp"
 #include "cli/cli.hpp"
+#include <fstream>
 #include <iostream>
 #include <string>
 
@@ -16,6 +17,39 @@ struct Args {
     std::string sample_file = "data/sample.tsv";
     bool export_zipf = false;
     std::string zipf_path = "data/zipf.csv";
+
+    bool build_report = false;
+    std::string build_report_json;
+    bool memory_report = false;
+    std::string memory_report_json;
+
+    // document-partitioned serving
+    uint32_t shard_index = 0;
+    uint32_t shard_count = 1;
+    bool coordinator = false;
+    std::string shards;
+    int shard_timeout_ms = 500;
+
+    ParallelOptions parallel;
+    std::string batch_file;
+
+    bool event_server = false;
+    EventServerOptions event;
+
+    QueryBudget budget;
+    ArenaOptions arena;
+    uint32_t slow_query_ms = 0;        // 0 = slow-query log off
+    size_t slow_query_log_size = 64;
+    DedupOptions dedup;
+    ReorderOptions reorder;
+    PruneOptions prune;
+    std::string prune_recall;
+    AdmissionOptions admission;
+
+    // external-memory build / serving from an index file
+    std::string spimi_out;
+    SpimiOptions spimi;
+    std::string index_file;
 };
 
 static void print_usage(const char* argv0) {
@@ -24,7 +58,24 @@ static void print_usage(const char* argv0) {
         << "  " << argv0 << " --cli [--no-stem] [--sample path]\n"
         << "  " << argv0 << " --web --port 8080 [--no-stem] [--sample path]\n"
         << "  " << argv0 << " --mongo --mongo-uri URI --mongo-db DB --mongo-col COL [--cli|--web]\n"
-        << "  " << argv0 << " --export-zipf [--zipf-path data/zipf.csv]\n\n"
+        << "  " << argv0 << " --export-zipf [--zipf-path data/zipf.csv]\n"
+        << "  " << argv0 << " --build-report [--build-report-json path] [--cli|--web]\n"
+        << "  " << argv0 << " --memory-report [--memory-report-json path] [--cli|--web]\n"
+        << "  " << argv0 << " --web --port 9001 --shard 0/2 [--sample path]\n"
+        << "  " << argv0 << " --query-threads 8 [--query-partitions 8] [--parallel-min-cost N] [--cli|--web]\n"
+        << "  " << argv0 << " --query-arena-kb 64 [--query-arena-max-kb 4096] [--cli|--web]   (0 = heap)\n"
+        << "  " << argv0 << " --batch queries.txt [--query-threads 8]\n"
+        << "  " << argv0 << " --spimi-out index.bin [--spimi-budget-mb 256] [--spimi-tmp dir] [--sample path]\n"
+        << "  " << argv0 << " --index index.bin [--sample path] [--cli|--web]\n"
+        << "  " << argv0 << " --web --event-server [--workers N] [--max-queue 1024] [--idle-timeout-ms 30000]\n"
+        << "  " << argv0 << " --dedup [--dedup-distance 3] [--dedup-shingle 3] [--cli|--web]\n"
+        << "  " << argv0 << " --reorder url|bp [--bp-iterations 20] [--build-report] [--cli|--web]\n"
+        << "  " << argv0 << " --prune-budget-mb 64 [--prune-max-postings N] [--prune-min-impact X] [--prune-keep 10]"
+        << " [--prune-recall queries.txt] [--build-report] [--cli|--web]\n"
+        << "  " << argv0 << " --max-query-cost N [--degrade] [--query-deadline-ms 200] [--cli|--web]\n"
+        << "  " << argv0 << " --web --slow-query-ms 50 [--slow-query-log-size 64]\n"
+        << "  " << argv0 << " --web --max-expensive 4 [--expensive-cost N] [--max-expensive-per-client 1]\n"
+        << "  " << argv0 << " --coordinator --shards host:port,host:port [--shard-timeout-ms 500] [--cli|--web]\n\n"
         << "Examples:\n"
         << "  " << argv0 << " --cli\n"
         << "  " << argv0 << " --web --port 8080\n"
@@ -45,6 +96,65 @@ static bool parse_args(int argc, char** argv, Args& a) {
         else if (s == "--mongo-col" && i + 1 < argc) a.mongo.collection = argv[++i];
         else if (s == "--export-zipf") a.export_zipf = true;
         else if (s == "--zipf-path" && i + 1 < argc) a.zipf_path = argv[++i];
+        else if (s == "--build-report") a.build_report = true;
+        else if (s == "--build-report-json" && i + 1 < argc) a.build_report_json = argv[++i];
+        else if (s == "--memory-report") a.memory_report = true;
+        else if (s == "--memory-report-json" && i + 1 < argc) a.memory_report_json = argv[++i];
+        else if (s == "--shard" && i + 1 < argc) {
+            std::string v = argv[++i];
+            size_t slash = v.find('/');
+            if (slash == std::string::npos) {
+                std::cerr << "Bad --shard (want i/N): " << v << "\n";
+                return false;
+            }
+            a.shard_index = (uint32_t)std::stoul(v.substr(0, slash));
+            a.shard_count = (uint32_t)std::stoul(v.substr(slash + 1));
+            if (a.shard_count == 0 || a.shard_index >= a.shard_count) {
+                std::cerr << "Bad --shard (want i/N with i < N): " << v << "\n";
+                return false;
+            }
+        }
+        else if (s == "--query-threads" && i + 1 < argc) a.parallel.threads = std::stoul(argv[++i]);
+        else if (s == "--query-partitions" && i + 1 < argc) a.parallel.partitions = std::stoul(argv[++i]);
+        else if (s == "--parallel-min-cost" && i + 1 < argc) a.parallel.min_cost = std::stoull(argv[++i]);
+        else if (s == "--query-arena-kb" && i + 1 < argc) a.arena.initial_bytes = std::stoul(argv[++i]) << 10;
+        else if (s == "--query-arena-max-kb" && i + 1 < argc) a.arena.max_bytes = std::stoul(argv[++i]) << 10;
+        else if (s == "--batch" && i + 1 < argc) a.batch_file = argv[++i];
+        else if (s == "--spimi-out" && i + 1 < argc) a.spimi_out = argv[++i];
+        else if (s == "--spimi-budget-mb" && i + 1 < argc) a.spimi.budget_bytes = (size_t)std::stoull(argv[++i]) << 20;
+        else if (s == "--spimi-tmp" && i + 1 < argc) a.spimi.tmp_dir = argv[++i];
+        else if (s == "--index" && i + 1 < argc) a.index_file = argv[++i];
+        else if (s == "--event-server") a.event_server = true;
+        else if (s == "--workers" && i + 1 < argc) a.event.workers = std::stoul(argv[++i]);
+        else if (s == "--max-queue" && i + 1 < argc) a.event.max_queue = std::stoul(argv[++i]);
+        else if (s == "--idle-timeout-ms" && i + 1 < argc) a.event.idle_timeout_ms = std::stoi(argv[++i]);
+        else if (s == "--dedup") a.dedup.enabled = true;
+        else if (s == "--dedup-distance" && i + 1 < argc) a.dedup.max_distance = std::stoi(argv[++i]);
+        else if (s == "--dedup-shingle" && i + 1 < argc) a.dedup.shingle = std::stoul(argv[++i]);
+        else if (s == "--reorder" && i + 1 < argc) {
+            std::string err;
+            if (!DocReorder::parseOrder(argv[++i], a.reorder.order, &err)) {
+                std::cerr << err << "\n";
+                return false;
+            }
+        }
+        else if (s == "--bp-iterations" && i + 1 < argc) a.reorder.bp_iterations = std::stoi(argv[++i]);
+        else if (s == "--prune-budget-mb" && i + 1 < argc) a.prune.budget_bytes = (uint64_t)(std::stod(argv[++i]) * 1048576.0);
+        else if (s == "--prune-max-postings" && i + 1 < argc) a.prune.max_postings = (uint32_t)std::stoul(argv[++i]);
+        else if (s == "--prune-min-impact" && i + 1 < argc) a.prune.min_impact = std::stod(argv[++i]);
+        else if (s == "--prune-keep" && i + 1 < argc) a.prune.keep_top = (uint32_t)std::stoul(argv[++i]);
+        else if (s == "--prune-recall" && i + 1 < argc) a.prune_recall = argv[++i];
+        else if (s == "--max-query-cost" && i + 1 < argc) a.budget.max_cost = std::stoull(argv[++i]);
+        else if (s == "--degrade") a.budget.degrade = true;
+        else if (s == "--query-deadline-ms" && i + 1 < argc) a.budget.deadline_ms = (uint32_t)std::stoul(argv[++i]);
+        else if (s == "--slow-query-ms" && i + 1 < argc) a.slow_query_ms = (uint32_t)std::stoul(argv[++i]);
+        else if (s == "--slow-query-log-size" && i + 1 < argc) a.slow_query_log_size = std::stoul(argv[++i]);
+        else if (s == "--expensive-cost" && i + 1 < argc) a.admission.expensive_cost = std::stoull(argv[++i]);
+        else if (s == "--max-expensive" && i + 1 < argc) a.admission.max_expensive = std::stoul(argv[++i]);
+        else if (s == "--max-expensive-per-client" && i + 1 < argc) a.admission.max_per_client = std::stoul(argv[++i]);
+        else if (s == "--coordinator") a.coordinator = true;
+        else if (s == "--shards" && i + 1 < argc) a.shards = argv[++i];
+        else if (s == "--shard-timeout-ms" && i + 1 < argc) a.shard_timeout_ms = std::stoi(argv[++i]);
         else if (s == "--help" || s == "-h") { print_usage(argv[0]); return false; }
         else {
             std::cerr << "Unknown arg: " << s << "\n";
@@ -52,7 +162,13 @@ static bool parse_args(int argc, char** argv, Args& a) {
             return false;
         }
     }
+    if (a.shard_count > 1 && a.reorder.order != DocOrder::None) {
+        // the coordinator merges shard hits by global_id, which a reordered shard no longer returns in order
+        std::cerr << "--reorder cannot be combined with --shard\n";
+        return false;
+    }
     if (!a.web && !a.cli) a.cli = true; // default
+    a.event.port = a.port;
     return true;
 }
 
@@ -60,9 +176,52 @@ int main(int argc, char** argv) {
     Args args;
     if (!parse_args(argc, argv, args)) return 1;
 
+    if (args.coordinator) {
+        CoordinatorConfig cfg;
+        cfg.timeout_ms = args.shard_timeout_ms;
+        std::string perr;
+        if (!ShardCoordinator::parseShardList(args.shards, cfg.shards, &perr)) {
+            std::cerr << "Coordinator error: " << perr << "\n";
+            return 1;
+        }
+        ShardCoordinator coordinator(std::move(cfg));
+        if (args.web) {
+            std::cout << "Starting coordinator for " << coordinator.shardCount()
+                      << " shards on http://localhost:" << args.port << "\n";
+            if (args.event_server) return WebServer::runEvented(coordinator, args.event);
+            return WebServer::run(coordinator, args.port);
+        }
+        return CLI::run(coordinator);
+    }
+
     SearchEngine engine;
+    engine.setShard(args.shard_index, args.shard_count);
+    engine.setParallelism(args.parallel);
+    engine.setQueryBudget(args.budget);
+    engine.setQueryArena(args.arena);
+    if (args.slow_query_ms) engine.setSlowQueryLog(args.slow_query_ms, args.slow_query_log_size);
+    engine.setDedup(args.dedup);
+    engine.setDocOrder(args.reorder);
+    engine.setPruning(args.prune);
 
     std::string err;
+    if (!args.spimi_out.empty()) {
+        SpimiStats st;
+        args.spimi.enable_stemming = args.stemming;
+        if (!engine.buildIndexFile(args.sample_file, args.spimi_out, args.spimi, &st, &err)) {
+            std::cerr << "Index build error: " << err << "\n";
+            return 2;
+        }
+        std::cout << "Index written to " << args.spimi_out << ": " << st.docs << " docs, "
+                  << st.terms << " terms, " << st.postings << " postings, " << st.runs << " runs ("
+                  << st.run_bytes / (1024 * 1024) << " MiB spilled, " << st.index_bytes / (1024 * 1024)
+                  << " MiB index)\n"
+                  << "  invert " << st.invert_nanos / 1000000 << " ms, spill " << st.spill_nanos / 1000000
+                  << " ms, merge " << st.merge_nanos / 1000000 << " ms, peak RSS "
+                  << BuildProfile::peakRssKb() / 1024 << " MiB\n";
+        return 0;
+    }
+
     bool ok = false;
     if (args.use_mongo) {
         ok = engine.loadFromMongo(args.mongo, &err);
@@ -74,7 +233,40 @@ int main(int argc, char** argv) {
         return 2;
     }
 
-    engine.buildIndex(args.stemming);
+    if (!args.index_file.empty()) {
+        if (!engine.loadIndex(args.index_file, &err)) {
+            std::cerr << "Index load error: " << err << "\n";
+            return 2;
+        }
+    } else {
+        engine.buildIndex(args.stemming);
+        if (args.dedup.enabled) {
+            std::cerr << "Dropped " << engine.buildStats().duplicates << " near-duplicate documents\n";
+        }
+    }
+
+    if (args.build_report) {
+        engine.buildStats().profile.print(std::cout);
+    }
+    if (!args.build_report_json.empty()) {
+        std::ofstream jf(args.build_report_json);
+        if (!jf) {
+            std::cerr << "Cannot write build report: " << args.build_report_json << "\n";
+            return 3;
+        }
+        jf << engine.buildStats().profile.toJson() << "\n";
+    }
+    if (args.memory_report) {
+        engine.memoryReport().print(std::cout);
+    }
+    if (!args.memory_report_json.empty()) {
+        std::ofstream jf(args.memory_report_json);
+        if (!jf) {
+            std::cerr << "Cannot write memory report: " << args.memory_report_json << "\n";
+            return 3;
+        }
+        jf << engine.memoryReport().toJson() << "\n";
+    }
 
     if (args.export_zipf) {
         if (!engine.exportZipfCSV(args.zipf_path, 0, &err)) {
@@ -84,9 +276,28 @@ int main(int argc, char** argv) {
         std::cout << "Zipf CSV exported to: " << args.zipf_path << "\n";
     }
 
+    if (!args.prune_recall.empty()) {
+        // the same build without pruning, to compare against
+        SearchEngine full;
+        full.setShard(args.shard_index, args.shard_count);
+        full.setDedup(args.dedup);
+        full.setDocOrder(args.reorder);
+        ok = args.use_mongo ? full.loadFromMongo(args.mongo, &err) : full.loadFromSampleFile(args.sample_file, &err);
+        if (!ok || !args.index_file.empty()) {
+            std::cerr << "Prune recall needs a buildIndex source" << (ok ? "" : ": " + err) << "\n";
+            return 2;
+        }
+        full.buildIndex(args.stemming);
+        return CLI::runPruneRecall(full, engine, args.prune_recall);
+    }
+
+    if (!args.batch_file.empty()) {
+        return CLI::runBatch(engine, args.batch_file);
+    }
     if (args.web) {
         std::cout << "Starting web server on http://localhost:" << args.port << "\n";
-        return WebServer::run(engine, args.port);
+        if (args.event_server) return WebServer::runEvented(engine, args.event, args.admission);
+        return WebServer::run(engine, args.port, args.admission);
     }
     return CLI::run(engine);
 }
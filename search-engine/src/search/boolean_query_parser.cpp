@@ -9,8 +9,31 @@ static std::string to_upper_ascii(std::string s) {
     return s;
 }
 
-std::vector<QToken> BooleanQueryParser::tokenizeQuery(const std::string& q) {
-    std::vector<QToken> out;
+// "NEAR/5" or "ONEAR/5" (already upper-cased) -> proximity operator
+static bool parse_near(const std::string& up, QToken& out) {
+    const size_t slash = up.find('/');
+    if (slash == std::string::npos) return false;
+    const std::string name = up.substr(0, slash);
+    if (name != "NEAR" && name != "ONEAR") return false;
+    const std::string k = up.substr(slash + 1);
+    if (k.empty() || k.size() > 6 || k.find_first_not_of("0123456789") != std::string::npos) return false;
+    out = {QTokType::NEAR, "", (uint32_t)std::stoul(k), name == "ONEAR"};
+    if (out.distance == 0) throw std::runtime_error("NEAR distance must be at least 1");
+    return true;
+}
+
+// "Site:Example.com" -> "site:Example.com"; empty if `w` is not a filter
+static std::string as_filter(const std::string& w) {
+    const size_t colon = w.find(':');
+    if (colon == std::string::npos || colon + 1 == w.size()) return {};
+    std::string field = w.substr(0, colon);
+    for (char& ch : field) ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    if (field != "site" && field != "after" && field != "before") return {};
+    return field + w.substr(colon);
+}
+
+ArenaVector<QToken> BooleanQueryParser::tokenizeQuery(const std::string& q, std::pmr::memory_resource* mr) {
+    ArenaVector<QToken> out(mr);
     size_t i = 0;
 
     auto push_word_or_op = [&](const std::string& w) {
@@ -18,6 +41,8 @@ std::vector<QToken> BooleanQueryParser::tokenizeQuery(const std::string& q) {
         if (up == "AND") out.push_back({QTokType::AND, ""});
         else if (up == "OR") out.push_back({QTokType::OR, ""});
         else if (up == "NOT") out.push_back({QTokType::NOT, ""});
+        else if (QToken near; parse_near(up, near)) out.push_back(near);
+        else if (std::string f = as_filter(w); !f.empty()) out.push_back({QTokType::FILTER, f});
         else out.push_back({QTokType::TERM, w});
     };
 
@@ -54,6 +79,7 @@ std::vector<QToken> BooleanQueryParser::tokenizeQuery(const std::string& q) {
 
 int BooleanQueryParser::precedence(QTokType t) {
     switch (t) {
+        case QTokType::NEAR: return 4;
         case QTokType::NOT: return 3;
         case QTokType::AND: return 2;
         case QTokType::OR:  return 1;
@@ -65,43 +91,47 @@ bool BooleanQueryParser::isRightAssociative(QTokType t) {
     return (t == QTokType::NOT);
 }
 
-std::vector<QToken> BooleanQueryParser::toRPN(const std::string& query) {
-    auto toks = tokenizeQuery(query);
-    std::vector<QToken> output;
-    std::vector<QToken> ops;
+ArenaVector<QToken> BooleanQueryParser::toRPN(const std::string& query, std::pmr::memory_resource* mr) {
+    auto toks = tokenizeQuery(query, mr);
+    ArenaVector<QToken> output(mr);
+    ArenaVector<QToken> ops(mr);
+    output.reserve(toks.size());
+    ops.reserve(toks.size());
 
     for (size_t i = 0; i < toks.size(); ++i) {
-        QToken t = toks[i];
+        QToken& t = toks[i];
         switch (t.type) {
             case QTokType::TERM:
             case QTokType::PHRASE:
-                output.push_back(t);
+            case QTokType::FILTER:
+                output.push_back(std::move(t));
                 break;
 
             case QTokType::AND:
             case QTokType::OR:
-            case QTokType::NOT: {
+            case QTokType::NOT:
+            case QTokType::NEAR: {
                 while (!ops.empty()) {
                     QTokType top = ops.back().type;
                     if (top == QTokType::LPAREN) break;
                     int p1 = precedence(t.type);
                     int p2 = precedence(top);
                     if (p2 > p1 || (p2 == p1 && !isRightAssociative(t.type))) {
-                        output.push_back(ops.back());
+                        output.push_back(std::move(ops.back()));
                         ops.pop_back();
                     } else break;
                 }
-                ops.push_back(t);
+                ops.push_back(std::move(t));
                 break;
             }
 
             case QTokType::LPAREN:
-                ops.push_back(t);
+                ops.push_back(std::move(t));
                 break;
 
             case QTokType::RPAREN:
                 while (!ops.empty() && ops.back().type != QTokType::LPAREN) {
-                    output.push_back(ops.back());
+                    output.push_back(std::move(ops.back()));
                     ops.pop_back();
                 }
                 if (ops.empty() || ops.back().type != QTokType::LPAREN) {
@@ -115,8 +145,26 @@ std::vector<QToken> BooleanQueryParser::toRPN(const std::string& query) {
     while (!ops.empty()) {
         if (ops.back().type == QTokType::LPAREN || ops.back().type == QTokType::RPAREN)
             throw std::runtime_error("Mismatched parentheses in query");
-        output.push_back(ops.back());
+        output.push_back(std::move(ops.back()));
         ops.pop_back();
     }
     return output;
 }
+
+std::string BooleanQueryParser::canonical(const std::string& query) {
+    std::string out;
+    for (const QToken& t : toRPN(query)) {
+        if (!out.empty()) out.push_back(' ');
+        switch (t.type) {
+            case QTokType::TERM:   out += t.text; break;
+            case QTokType::PHRASE: out += '"' + t.text + '"'; break;
+            case QTokType::FILTER: out += t.text; break;
+            case QTokType::AND:    out += "AND"; break;
+            case QTokType::OR:     out += "OR"; break;
+            case QTokType::NOT:    out += "NOT"; break;
+            case QTokType::NEAR:   out += (t.ordered ? "ONEAR/" : "NEAR/") + std::to_string(t.distance); break;
+            default: break;
+        }
+    }
+    return out;
+}
@@ -1,21 +1,33 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
+#include "../structures/query_arena.hpp"
 
-enum class QTokType { TERM, PHRASE, AND, OR, NOT, LPAREN, RPAREN };
+enum class QTokType { TERM, PHRASE, FILTER, AND, OR, NOT, NEAR, LPAREN, RPAREN };
 
 struct QToken {
     QTokType type;
-    std::string text;
+    std::string text;        // FILTER: "site:<host>", "after:<date>" or "before:<date>"
+    uint32_t distance = 0;   // NEAR/k, ONEAR/k: k
+    bool ordered = false;    // ONEAR: left operand first
 };
 
 class BooleanQueryParser {
 public:
 
-    static std::vector<QToken> toRPN(const std::string& query);
+    // Operators by binding strength: NEAR/k and ONEAR/k (proximity of two
+    // terms or phrases, ONEAR in order), NOT, AND, OR. Words of the form
+    // site:, after: and before: are FILTER operands on document metadata.
+    // The token arrays are allocated from `mr`, the heap if null.
+    static ArenaVector<QToken> toRPN(const std::string& query, std::pmr::memory_resource* mr = nullptr);
+
+    // Spelling-independent form of a query (its RPN), so that queries differing
+    // only in spacing, operator case or redundant parentheses compare equal.
+    static std::string canonical(const std::string& query);
 
 private:
-    static std::vector<QToken> tokenizeQuery(const std::string& query);
+    static ArenaVector<QToken> tokenizeQuery(const std::string& query, std::pmr::memory_resource* mr);
     static int precedence(QTokType t);
     static bool isRightAssociative(QTokType t);
 };
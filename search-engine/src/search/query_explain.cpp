@@ -0,0 +1,70 @@
+#include "query_explain.hpp"
+#include <cstdio>
+
+static std::string format_nanos(uint64_t ns) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.3f ms", (double)ns / 1e6);
+    return buf;
+}
+
+static std::string format_bytes(uint64_t b) {
+    char buf[32];
+    if (b < 1024) std::snprintf(buf, sizeof(buf), "%llu B", (unsigned long long)b);
+    else if (b < (1 << 20)) std::snprintf(buf, sizeof(buf), "%.1f KiB", (double)b / 1024.0);
+    else std::snprintf(buf, sizeof(buf), "%.1f MiB", (double)b / (1024.0 * 1024.0));
+    return buf;
+}
+
+static void append_node(const QueryExplain& ex, int i, int depth, std::string& out) {
+    const ExplainNode& n = ex.nodes[i];
+    out.append((size_t)depth * 2, ' ');
+    out += n.label;
+    // leaves are resolved while planning, so only operator children count here
+    std::vector<int> children = n.args;
+    if (children.empty()) {
+        for (int c : {n.lhs, n.rhs}) {
+            if (c >= 0) children.push_back(c);
+        }
+    }
+    uint64_t child_nanos = 0;
+    for (size_t k = 0; k < children.size(); ++k) {
+        const int c = children[k];
+        out += (k == 0 ? "  in=" : ",") + std::to_string(ex.nodes[c].out);
+        if (ex.nodes[c].lhs >= 0) child_nanos += ex.nodes[c].nanos;
+    }
+    out += "  out=" + std::to_string(n.out) + "  " + format_nanos(n.nanos);
+    if (n.lhs >= 0 && n.nanos >= child_nanos) out += " (self " + format_nanos(n.nanos - child_nanos) + ")";
+    out += "  " + format_bytes(n.alloc_bytes) + "\n";
+    for (int c : children) append_node(ex, c, depth + 1, out);
+}
+
+std::string QueryExplain::toText() const {
+    std::string out = "RPN: " + rpn + "\n";
+    if (root >= 0) append_node(*this, root, 0, out);
+    out += "plan " + format_nanos(plan_nanos) + ", eval " + format_nanos(eval_nanos) + ", collect " +
+           format_nanos(collect_nanos) + ", " + format_bytes(alloc_bytes) + " allocated in " +
+           std::to_string(alloc_calls) + " calls\n";
+    return out;
+}
+
+void SlowQueryLog::add(SlowQuery q) {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (ring_.size() < capacity_) ring_.push_back(std::move(q));
+    else ring_[next_] = std::move(q);
+    next_ = (next_ + 1) % capacity_;
+    ++recorded_;
+}
+
+std::vector<SlowQuery> SlowQueryLog::snapshot() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    std::vector<SlowQuery> out;
+    out.reserve(ring_.size());
+    const size_t start = ring_.size() < capacity_ ? 0 : next_;
+    for (size_t i = 0; i < ring_.size(); ++i) out.push_back(ring_[(start + i) % ring_.size()]);
+    return out;
+}
+
+uint64_t SlowQueryLog::recorded() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return recorded_;
+}
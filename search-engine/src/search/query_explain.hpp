@@ -0,0 +1,101 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../structures/alloc_counter.hpp"
+
+// One operator or operand of an evaluated query.
+struct ExplainNode {
+    std::string label;          // "AND", "NOT", "term:foo", "phrase:\"a b\"", "site:x", "NEAR/3(...)"
+    int lhs = -1, rhs = -1;     // children, -1 if none
+    std::vector<int> args;      // operands of an AND/OR folded from a chain, in order
+    uint64_t out = 0;           // posting entries produced
+    uint64_t nanos = 0;         // including children; summed over partitions
+    uint64_t alloc_bytes = 0;   // heap bytes allocated, including children
+};
+
+// EXPLAIN ANALYZE of one query: the plan in RPN order with the measurements
+// of each node, and the time of each phase.
+struct QueryExplain {
+    std::string rpn;
+    std::vector<ExplainNode> nodes;
+    int root = -1;
+    uint64_t plan_nanos = 0;      // parsing and resolving the operands
+    uint64_t eval_nanos = 0;      // operators
+    uint64_t collect_nanos = 0;   // URLs, snippets and facets
+    uint64_t alloc_bytes = 0;     // on the calling thread
+    uint64_t alloc_calls = 0;     // operator new calls behind alloc_bytes
+
+    uint64_t totalNanos() const { return plan_nanos + eval_nanos + collect_nanos; }
+
+    // Indented tree, one node per line: input and output sizes, time and bytes.
+    std::string toText() const;
+};
+
+// Measurements of one plan node while it is being evaluated; partitions
+// evaluated in parallel add to the same node.
+struct NodeTrace {
+    std::atomic<uint64_t> nanos{0};
+    std::atomic<uint64_t> alloc_bytes{0};
+    std::atomic<uint64_t> out{0};
+};
+
+// Charges the wall time and heap bytes of its scope to a node; does nothing
+// for a null node.
+class NodeTimer {
+public:
+    explicit NodeTimer(NodeTrace* t) : t_(t), counting_(t != nullptr) {
+        if (!t_) return;
+        alloc0_ = AllocCounter::bytes();
+        t0_ = std::chrono::steady_clock::now();
+    }
+    ~NodeTimer() {
+        if (!t_) return;
+        t_->nanos += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - t0_).count();
+        t_->alloc_bytes += AllocCounter::bytes() - alloc0_;
+    }
+    NodeTimer(const NodeTimer&) = delete;
+    NodeTimer& operator=(const NodeTimer&) = delete;
+
+private:
+    NodeTrace* t_;
+    AllocCounter::Scope counting_;   // also on pool threads evaluating partitions
+    uint64_t alloc0_ = 0;
+    std::chrono::steady_clock::time_point t0_;
+};
+
+struct SlowQuery {
+    std::string query;
+    int64_t unix_ms = 0;
+    QueryExplain explain;
+};
+
+// The last `capacity` queries that took longer than a threshold, with their
+// per-node breakdown.
+class SlowQueryLog {
+public:
+    SlowQueryLog(uint32_t threshold_ms, size_t capacity)
+        : threshold_nanos_((uint64_t)threshold_ms * 1000000), capacity_(capacity ? capacity : 1) {}
+
+    bool over(uint64_t nanos) const { return nanos >= threshold_nanos_; }
+    uint32_t thresholdMs() const { return (uint32_t)(threshold_nanos_ / 1000000); }
+
+    void add(SlowQuery q);
+
+    // oldest first
+    std::vector<SlowQuery> snapshot() const;
+    uint64_t recorded() const;
+
+private:
+    uint64_t threshold_nanos_;
+    size_t capacity_;
+    mutable std::mutex mu_;
+    std::vector<SlowQuery> ring_;
+    size_t next_ = 0;
+    uint64_t recorded_ = 0;
+};
@@ -2,12 +2,23 @@
 #include "../index/index_builder.hpp"
 #include "../tokenizer/tokenizer.hpp"
 #include "../tokenizer/html_strip.hpp"
+#include "../tokenizer/utf8.hpp"
 #include "../stemmer/stemmer.hpp"
 #include "boolean_query_parser.hpp"
 #include <algorithm>
-#include <sstream>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
+#include <mutex>
+#include <numeric>
+#include <sstream>
 #include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
 
 #ifdef ENABLE_MONGODB
 #include <mongocxx/client.hpp>
@@ -18,38 +29,68 @@
 #include <bsoncxx/config/version.hpp>
 #endif
 
-SearchEngine::SearchEngine()
-    : index_(1<<16) {}
+SearchEngine::SearchEngine() {}
 
-bool SearchEngine::loadFromSampleFile(const std::string& path, std::string* err) {
+void SearchEngine::setShard(uint32_t index, uint32_t count) {
+    shard_count_ = count ? count : 1;
+    shard_index_ = index % shard_count_;
+}
+
+bool SearchEngine::inShard(const std::string& url) const {
+    if (shard_count_ <= 1) return true;
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : url) {
+        h ^= static_cast<uint64_t>(c);
+        h *= 1099511628211ull;
+    }
+    return h % shard_count_ == shard_index_;
+}
+
+bool SearchEngine::readSampleFile(const std::string& path, const std::function<void(Document&&)>& fn,
+                                  StageTiming& timing, std::string* err) const {
     std::ifstream f(path);
     if (!f) {
         if (err) *err = "Cannot open sample file: " + path;
         return false;
     }
-    documents_.clear();
+    timing = StageTiming{};
+    StageClock clk;
     std::string line;
     int id = 0;
+    int64_t pos = 0;
     while (std::getline(f, line)) {
+        timing.bytes += line.size() + 1;
         if (line.empty()) continue;
         size_t t1 = line.find('\t');
         size_t t2 = (t1 == std::string::npos) ? std::string::npos : line.find('\t', t1 + 1);
         if (t1 == std::string::npos || t2 == std::string::npos) continue;
 
+        const int64_t global_id = pos++;
+        if (!inShard(line.substr(0, t1))) continue;
+
         Document d;
         d.id = id++;
+        d.global_id = global_id;
         d.url = line.substr(0, t1);
         d.crawled_at = line.substr(t1 + 1, t2 - (t1 + 1));
         d.html = line.substr(t2 + 1);
-        documents_.push_back(std::move(d));
+        fn(std::move(d));
     }
-    if (documents_.empty()) {
+    timing.nanos = clk.lap();
+    timing.docs = (uint64_t)id;
+    if (id == 0) {
         if (err) *err = "No documents loaded from sample file (bad format?)";
         return false;
     }
     return true;
 }
 
+bool SearchEngine::loadFromSampleFile(const std::string& path, std::string* err) {
+    documents_.clear();
+    return readSampleFile(path, [&](Document&& d) { documents_.push_back(std::move(d)); },
+                          load_timing_, err);
+}
+
 bool SearchEngine::loadFromMongo(const MongoConfig& cfg, std::string* err) {
 #ifndef ENABLE_MONGODB
     if (err) *err = "MongoDB support is disabled. Rebuild with -DENABLE_MONGODB=ON and ensure mongocxx is installed.";
@@ -62,7 +103,10 @@ bool SearchEngine::loadFromMongo(const MongoConfig& cfg, std::string* err) {
         auto coll = client[cfg.db][cfg.collection];
 
         documents_.clear();
+        load_timing_ = StageTiming{};
+        StageClock clk;
         int id = 0;
+        int64_t pos = 0;
 
         auto elem_to_string = [](const bsoncxx::document::element& el) -> std::string {
 #if defined(BSONCXX_VERSION_MAJOR) && ( (BSONCXX_VERSION_MAJOR > 3) || (BSONCXX_VERSION_MAJOR == 3 && BSONCXX_VERSION_MINOR >= 7) )
@@ -76,7 +120,7 @@ bool SearchEngine::loadFromMongo(const MongoConfig& cfg, std::string* err) {
         auto cursor = coll.find({});
         for (auto&& doc : cursor) {
             Document d;
-            d.id = id++;
+            d.global_id = pos++;
 
             if (auto el = doc["text"]; el) {
                 try { d.html = elem_to_string(el); } catch (...) {}
@@ -87,9 +131,14 @@ bool SearchEngine::loadFromMongo(const MongoConfig& cfg, std::string* err) {
             if (auto el = doc["crawled_at"]; el) {
                 try { d.crawled_at = elem_to_string(el); } catch (...) {}
             }
+            if (!inShard(d.url)) continue;
+            d.id = id++;
 
+            load_timing_.bytes += d.html.size() + d.url.size() + d.crawled_at.size();
             documents_.push_back(std::move(d));
         }
+        load_timing_.nanos = clk.lap();
+        load_timing_.docs = documents_.size();
 
         if (documents_.empty()) {
             if (err) *err = "Mongo collection returned 0 documents.";
@@ -105,17 +154,183 @@ bool SearchEngine::loadFromMongo(const MongoConfig& cfg, std::string* err) {
 }
 
 void SearchEngine::buildIndex(bool enable_stemming) {
-    index_.clear();
+    index_ = FrozenIndex{};
     universe_ = PostingList{};
 
+    HashTable<TermData> building(1 << 16);
+    build_stats_ = IndexBuilder::build(documents_, building, enable_stemming, dedup_);
+    build_stats_.profile[BuildStage::Load] = load_timing_;
+    // only the extracted text is served; swapping frees the buffer, assigning "" would keep it
+    for (auto& d : documents_) std::string().swap(d.html);
+    if (reorder_.order != DocOrder::None) reorderDocs_(building);
+    if (prune_.enabled()) {
+        BuildProfile& prof = build_stats_.profile;
+        StageClock clk;
+        prof.prune = IndexPruner::prune(building, documents_.size(), prune_);
+        prof.pruned = true;
+        const uint64_t ns = clk.lap();
+        prof.add(BuildStage::Prune, ns, prof.prune.bytes_before, 0);
+        prof.total_nanos += ns;
+    }
+
+    // ids are dense over the documents that survived dedup
+    for (int i = 0; i < (int)documents_.size(); ++i) universe_.addSortedUnique(i);
+    universe_.optimize(); // full chunks become single runs; NOT flips against them
+
+    build_memory_.clear();
+    IndexBuilder::memoryUsage(building, build_memory_);
+
+    // the build-time hash table is dropped once its lists are frozen
+    BuildProfile& prof = build_stats_.profile;
+    StageClock clk;
+    index_ = FrozenIndex::freeze(building);
+    buildDerived_();
+    const uint64_t ns = clk.lap();
+    prof.add(BuildStage::Freeze, ns, index_.memoryBytes() + doc_values_.memoryBytes() + completions_.memoryBytes() +
+                                     forward_.memoryBytes(), 0);
+    prof.total_nanos += ns;
+#if defined(__GLIBC__)
+    malloc_trim(0); // hand the freed build-time heap back to the OS
+#endif
+    prof.peak_rss_kb = BuildProfile::peakRssKb();
+    prof.final_rss_kb = BuildProfile::currentRssKb();
+}
+
+// Everything served next to the frozen index, derived from it and the documents.
+void SearchEngine::buildDerived_() {
+    doc_values_ = DocValues::build(documents_);
+    completions_ = CompletionTrie::build(index_);
+    forward_ = ForwardIndex::build(index_, documents_.size());
+    by_url_.resize(documents_.size());
+    std::iota(by_url_.begin(), by_url_.end(), 0u);
+    std::stable_sort(by_url_.begin(), by_url_.end(),
+                     [this](uint32_t a, uint32_t b) { return documents_[a].url < documents_[b].url; });
+}
+
+// Renumbers documents before anything else is derived from their ids.
+void SearchEngine::reorderDocs_(HashTable<TermData>& building) {
+    BuildProfile& prof = build_stats_.profile;
+    prof.gaps_before = DocReorder::gaps(building);
+    StageClock clk;
+    const bool url = reorder_.order == DocOrder::Url;
+    const std::vector<uint32_t> ids = url ? DocReorder::byUrl(documents_)
+                                          : DocReorder::bisection(building, documents_.size(), reorder_);
+    DocReorder::apply(ids, documents_, building);
+    const uint64_t ns = clk.lap();
+    prof.add(BuildStage::Reorder, ns, prof.gaps_before.posting_bytes, 0);
+    prof.total_nanos += ns;
+    prof.gaps_after = DocReorder::gaps(building);
+    prof.reorder = url ? "url" : "bp";
+}
+
+bool SearchEngine::buildIndexFile(const std::string& sample_path, const std::string& index_path,
+                                  const SpimiOptions& opt, SpimiStats* stats, std::string* err) const {
+    SpimiBuilder builder(index_path, opt);
+    std::vector<std::string> tokens;
+    HtmlStripper::ExtractedText text;
+    bool ok = true;
+    StageTiming timing;
+
+    const bool read = readSampleFile(sample_path, [&](Document&& d) {
+        if (!ok) return;
+        HtmlStripper::extract_fused(d.html, text);
+        tokens.assign(text.tokens.begin(), text.tokens.end());
+        if (opt.enable_stemming) {
+            for (auto& t : tokens) t = Stemmer::stem(t);
+        }
+        ok = builder.addDocument(tokens, err);
+    }, timing, err);
+
+    if (!read || !ok) return false;
+    if (!builder.finish(err)) return false;
+    if (stats) *stats = builder.stats();
+    return true;
+}
+
+bool SearchEngine::loadIndex(const std::string& index_path, std::string* err) {
+    SpimiIndexReader in;
+    if (!in.open(index_path, err)) return false;
+    if (in.docCount() != documents_.size()) {
+        if (err) *err = "Index was built for " + std::to_string(in.docCount()) + " documents, loaded " +
+                        std::to_string(documents_.size());
+        return false;
+    }
+
+    StageClock clk;
+    index_ = FrozenIndex{};
+    universe_ = PostingList{};
+    build_memory_.clear();
     for (int i = 0; i < (int)documents_.size(); ++i) {
-        documents_[i].id = i;
+        Document& d = documents_[i];
+        d.id = i;
+        IndexBuilder::prepare_text(d);
+        std::string().swap(d.html); // only the extracted text is served
         universe_.addSortedUnique(i);
     }
+    universe_.optimize();
+
+    build_stats_ = BuildStats{};
+    BuildProfile& prof = build_stats_.profile;
+    prof[BuildStage::Load] = load_timing_;
+    prof.add(BuildStage::Extract, clk.lap(), 0, documents_.size());
+
+    if (!FrozenIndex::load(in, index_, err)) return false;
+    buildDerived_();
+    const uint64_t ns = clk.lap();
+    prof.add(BuildStage::Freeze, ns, index_.memoryBytes() + doc_values_.memoryBytes() + completions_.memoryBytes() +
+                                     forward_.memoryBytes(), 0);
+    prof.total_nanos = prof[BuildStage::Extract].nanos + ns;
+    prof.peak_rss_kb = BuildProfile::peakRssKb();
+    prof.final_rss_kb = BuildProfile::currentRssKb();
+    build_stats_.docs_indexed = documents_.size();
+    build_stats_.unique_terms = index_.termCount();
+    return true;
+}
+
+size_t SearchEngine::suggest(std::string_view prefix, Suggestion* out, size_t k) const {
+    // fold the last word the way the tokenizer does; words longer than the buffer get nothing
+    char word[64];
+    size_t len = 0;
+    bool overflow = false;
+    auto put = [&](std::string_view bytes) {
+        if (len + bytes.size() > sizeof(word)) { overflow = true; return; }
+        std::copy(bytes.begin(), bytes.end(), word + len);
+        len += bytes.size();
+    };
+    Utf8::scan(prefix,
+               [&](auto c) {
+                   if constexpr (std::is_same_v<decltype(c), char>) put(std::string_view(&c, 1));
+                   else put(c);
+               },
+               [&] { len = 0; overflow = false; });
+    if (overflow) return 0;
+
+    uint32_t ids[CompletionTrie::kTopK];
+    size_t n = completions_.complete(index_, std::string_view(word, len), ids, k);
+    if (n == 0 && len) {
+        const std::string stem = Stemmer::stem(std::string(word, len));
+        if (stem != std::string_view(word, len)) n = completions_.complete(index_, stem, ids, k);
+    }
+    for (size_t i = 0; i < n; ++i) out[i] = {index_.term(ids[i]), index_.df(ids[i])};
+    return n;
+}
 
-    auto st = IndexBuilder::build(documents_, index_, enable_stemming);
+PostingList SearchEngine::matches(const std::string& query) const {
+    Plan plan = makePlan(query);
+    resolveLeaves_(plan);
+    return evaluate(plan, (int)documents_.size());
+}
 
-    (void)st;
+std::vector<SimilarDoc> SearchEngine::similar(const std::string& url, size_t k) const {
+    auto it = std::lower_bound(by_url_.begin(), by_url_.end(), url,
+                               [this](uint32_t d, const std::string& u) { return documents_[d].url < u; });
+    if (it == by_url_.end() || documents_[*it].url != url) throw std::runtime_error("Unknown document URL: " + url);
+    std::vector<SimilarDoc> out;
+    for (const SimilarHit& h : forward_.similar(index_, (int)*it, k)) {
+        const Document& d = documents_[h.doc];
+        out.push_back({{d.url, makeSnippet(d.plain, 200), d.global_id}, h.score});
+    }
+    return out;
 }
 
 bool SearchEngine::exportZipfCSV(const std::string& path_csv, size_t max_terms, std::string* err) const {
@@ -129,17 +344,72 @@ bool SearchEngine::exportZipfCSV(const std::string& path_csv, size_t max_terms,
 }
 
 
+MemoryReport SearchEngine::memoryReport() const {
+    MemoryReport r;
+    r.items.push_back(MemoryReport::vector("documents", documents_));
+    struct Field { const char* name; std::string Document::*field; const char* per_doc; };
+    const Field fields[] = {{"documents.html", &Document::html, "html bytes per doc"},
+                            {"documents.url", &Document::url, nullptr},
+                            {"documents.crawled_at", &Document::crawled_at, nullptr},
+                            {"documents.plain", &Document::plain, "plain bytes per doc"},
+                            {"documents.normalized", &Document::normalized, "normalized bytes per doc"}};
+    std::vector<uint64_t> doc_bytes(documents_.size());
+    for (const Field& f : fields) {
+        MemoryItem item{f.name};
+        std::vector<uint64_t> sizes(documents_.size());
+        uint64_t over = 0, over_slack = 0;
+        for (size_t i = 0; i < documents_.size(); ++i) {
+            const std::string& s = documents_[i].*f.field;
+            const uint64_t before = item.reserved;
+            item.addString(s);
+            doc_bytes[i] += item.reserved - before;
+            sizes[i] = s.size();
+            const size_t spare = s.capacity() - s.size();
+            if (item.reserved != before && spare >= 64 && spare >= s.size() / 2) {
+                ++over;
+                over_slack += spare;
+            }
+        }
+        if (over_slack >= (64 << 10)) {
+            r.waste.push_back(std::string(f.name) + ": " + std::to_string(over) +
+                              " strings reserve 1.5x their size or more, " + std::to_string(over_slack >> 10) +
+                              " KiB unused");
+        }
+        if (f.per_doc) r.distributions.push_back(SizeDistribution::of(f.per_doc, std::move(sizes)));
+        r.items.push_back(std::move(item));
+    }
+    for (auto& b : doc_bytes) b += sizeof(Document);
+    r.distributions.push_back(SizeDistribution::of("heap bytes per doc", std::move(doc_bytes)));
+    const MemoryItem& html = r.items[1];
+    if (html.reserved >= (64 << 10)) {
+        r.waste.push_back("documents.html: " + std::to_string(html.reserved >> 20) +
+                          " MiB of raw HTML kept after indexing; only plain and normalized are served");
+    }
+
+    r.items.push_back({"universe", universe_.containers().size(), universe_.usedBytes(), universe_.memoryBytes()});
+    index_.memoryUsage(r);
+    doc_values_.memoryUsage(r);
+    completions_.memoryUsage(r);
+    forward_.memoryUsage(r);
+    r.build_items = build_memory_;
+    r.flagSlack();
+    r.rss_kb = BuildProfile::currentRssKb();
+    r.peak_rss_kb = BuildProfile::peakRssKb();
+    return r;
+}
+
+
 PostingList SearchEngine::evalOperandTerm(const std::string& term) const {
-    const TermData* td = index_.find(term);
-    if (!td) return PostingList{};
-    return td->postings;
+    const uint32_t id = index_.find(term);
+    return id == FrozenIndex::kNoTerm ? PostingList{} : index_.postings(id);
 }
 
 std::string SearchEngine::normalizeQueryPhrase(const std::string& phrase) {
     return HtmlStripper::normalize_for_phrase(phrase);
 }
 
-PostingList SearchEngine::evalOperandPhrase(const std::string& phrase) const {
+PostingList SearchEngine::evalOperandPhrase(const std::string& phrase, std::pmr::memory_resource* mr, int hi,
+                                            const Deadline* dl, int* cutoff) const {
     std::string norm_phrase = normalizeQueryPhrase(phrase);
     if (norm_phrase.empty()) return PostingList{};
 
@@ -150,70 +420,770 @@ PostingList SearchEngine::evalOperandPhrase(const std::string& phrase) const {
     for (auto& t : toks) t = Stemmer::stem(t);
 
     PostingList cand = evalOperandTerm(toks[0]);
-    for (size_t i = 1; i < toks.size(); ++i) {
-        PostingList next = evalOperandTerm(toks[i]);
-        cand = PostingList::And(cand, next);
-        if (cand.empty()) break;
+    for (size_t i = 1; i < toks.size() && !cand.empty(); ++i) {
+        cand = PostingList::And(cand, evalOperandTerm(toks[i]), dl, cutoff, mr);
     }
-    if (cand.empty()) return cand;
+    if (cand.empty()) return PostingList(mr);
 
-    PostingList out;
-    for (int doc_id : cand.docs()) {
-        if (doc_id < 0 || doc_id >= (int)documents_.size()) continue;
+    PostingList out(mr);
+    cand.forEach([&](int doc_id) {
+        if (doc_id >= hi) return false;
+        if (dl && dl->expired()) {
+            if (cutoff) *cutoff = std::min(*cutoff, doc_id);
+            return false;
+        }
+        if (doc_id >= (int)documents_.size()) return true;
         const auto& dn = documents_[doc_id].normalized;
         if (dn.find(norm_phrase) != std::string::npos) out.addSortedUnique(doc_id);
+        return true;
+    });
+    return out;
+}
+
+PostingList SearchEngine::evalOperandFilter(const std::string& filter, int hi, const Deadline* dl,
+                                            int* cutoff) const {
+    DocFilter f;
+    std::string err;
+    if (!doc_values_.parseFilter(filter, f, &err)) throw std::runtime_error(err);
+    return doc_values_.apply(f, hi, dl, cutoff);
+}
+
+// Index terms of a NEAR operand: a term's first word, every word of a phrase.
+static std::vector<std::string> near_words(const QToken& t) {
+    TokenizationStats dummy;
+    std::vector<std::string> toks = Tokenizer::tokenize(
+        t.type == QTokType::PHRASE ? HtmlStripper::normalize_for_phrase(t.text) : t.text, &dummy);
+    if (t.type == QTokType::TERM && toks.size() > 1) toks.resize(1);
+    for (auto& w : toks) w = Stemmer::stem(w);
+    return toks;
+}
+
+PostingList SearchEngine::evalOperandNear(const QToken& op, const QToken& a, const QToken& b, int hi,
+                                          const Deadline* dl, int* cutoff) const {
+    if (!index_.hasPositions()) {
+        throw std::runtime_error("NEAR needs word positions, which index files do not store");
+    }
+    const std::vector<std::string> words[2] = {near_words(a), near_words(b)};
+    if (words[0].empty() || words[1].empty()) return PostingList{};
+
+    // distinct terms; slots[side][w] indexes `ids`
+    std::vector<uint32_t> ids;
+    std::vector<size_t> slots[2];
+    for (int side = 0; side < 2; ++side) {
+        for (const auto& w : words[side]) {
+            const uint32_t id = index_.find(w);
+            if (id == FrozenIndex::kNoTerm) return PostingList{};
+            auto it = std::find(ids.begin(), ids.end(), id);
+            slots[side].push_back((size_t)(it - ids.begin()));
+            if (it == ids.end()) ids.push_back(id);
+        }
+    }
+
+    PostingList cand = index_.postings(ids[0]);
+    for (size_t k = 1; k < ids.size() && !cand.empty(); ++k) {
+        cand = PostingList::And(cand, index_.postings(ids[k]), dl, cutoff);
     }
+    if (cand.empty()) return PostingList{};
+
+    // positions are decoded one candidate at a time, never for all of them
+    std::vector<FrozenIndex::PositionCursor> cursors;
+    for (uint32_t id : ids) cursors.emplace_back(index_, id);
+    std::vector<std::vector<uint32_t>> pos(ids.size());
+
+    PostingList out;
+    std::vector<std::vector<uint32_t>> lists;
+    std::vector<uint32_t> spans[2];
+    cand.forEach([&](int doc) {
+        if (doc >= hi) return false;
+        if (dl && dl->expired()) {
+            if (cutoff) *cutoff = std::min(*cutoff, doc);
+            return false;
+        }
+        for (size_t k = 0; k < ids.size(); ++k) cursors[k].seek(doc, pos[k]);
+        for (int side = 0; side < 2; ++side) {
+            if (slots[side].size() == 1) {
+                spans[side].swap(pos[slots[side][0]]);
+                continue;
+            }
+            lists.clear();
+            for (size_t s : slots[side]) lists.push_back(pos[s]);
+            Positions::phraseStarts(lists, spans[side]);
+        }
+        if (Positions::near(spans[0], (uint32_t)words[0].size(), spans[1], (uint32_t)words[1].size(),
+                            op.distance, op.ordered)) {
+            out.addSortedUnique(doc);
+        }
+        return true;
+    });
     return out;
 }
 
 std::string SearchEngine::makeSnippet(const std::string& plain, size_t n) {
     if (plain.size() <= n) return plain;
-    return plain.substr(0, n) + "...";
+    std::string out;
+    out.reserve(n + 3);
+    out.append(plain, 0, n).append("...");
+    return out;
 }
 
-std::vector<SearchResult> SearchEngine::search(const std::string& query, size_t max_results) const {
-    std::vector<SearchResult> results;
-    if (documents_.empty()) return results;
-
-    std::vector<QToken> rpn = BooleanQueryParser::toRPN(query);
-    std::vector<PostingList> stack;
-    stack.reserve(rpn.size());
-
-    auto eval_term_token = [&](const std::string& raw) -> PostingList {
-        TokenizationStats dummy;
-        std::vector<std::string> toks = Tokenizer::tokenize(raw, &dummy);
-        if (toks.empty()) return PostingList{};
-        std::string t = Stemmer::stem(toks[0]);
-        return evalOperandTerm(t);
+void SearchEngine::setParallelism(const ParallelOptions& opt) {
+    parallel_ = opt;
+    if (parallel_.partitions == 0) parallel_.partitions = parallel_.threads;
+    pool_.reset();
+    if (parallel_.threads > 1) pool_ = std::make_shared<ThreadPool>(parallel_.threads);
+}
+
+// Batch-wide operand cache: each distinct raw term is tokenized, stemmed and
+// looked up once, each distinct phrase is verified once.
+struct SearchEngine::OperandCache {
+    std::unordered_map<std::string, PostingList> terms;   // views into the index
+    std::unordered_map<std::string, std::unique_ptr<PostingList>> phrases;
+};
+
+// Subexpressions that occur more than once in a batch get a slot; the first
+// query that needs one computes it while concurrent users wait on call_once.
+struct SearchEngine::BatchCache {
+    struct Slot {
+        std::once_flag once;
+        PostingList value;
     };
+    std::unique_ptr<Slot[]> slots;
+};
+
+SearchEngine::Plan SearchEngine::makePlan(const std::string& query, OperandCache* operands, bool trace,
+                                          std::pmr::memory_resource* mr) const {
+    Plan p(mr);
+    p.rpn = BooleanQueryParser::toRPN(query, mr);
+    const size_t n = p.rpn.size();
+    p.lhs.assign(n, -1);
+    p.rhs.assign(n, -1);
+    p.ops.resize(n);
+    if (trace) p.trace = std::make_unique<NodeTrace[]>(n);
 
-    for (const auto& t : rpn) {
+    ArenaVector<int> stack(mr);
+    stack.reserve(n);
+
+    // NEAR operands are matched from positions, never resolved on their own
+    ArenaVector<char> near_operand(n, 0, mr);
+    for (size_t i = 0; i < n; ++i) {
+        const QTokType ty = p.rpn[i].type;
+        if (ty == QTokType::NEAR && stack.size() >= 2) {
+            near_operand[stack.back()] = 1;
+            stack.pop_back();
+            near_operand[stack.back()] = 1;
+            stack.back() = (int)i;
+        } else if ((ty == QTokType::AND || ty == QTokType::OR) && stack.size() >= 2) {
+            stack.pop_back();
+            stack.back() = (int)i;
+        } else if (ty == QTokType::NOT && !stack.empty()) {
+            stack.back() = (int)i;
+        } else if (ty == QTokType::TERM || ty == QTokType::PHRASE || ty == QTokType::FILTER) {
+            stack.push_back((int)i);
+        }
+    }
+    stack.clear();
+
+    // Cost: an upper bound on the posting entries evaluation reads, from list
+    // sizes alone. Every operator walks its inputs, NOT walks the universe, a
+    // phrase reads the lists of its words and NEAR also every position of
+    // them. Sizes propagate as upper bounds.
+    const uint64_t universe = universe_.size();
+    ArenaVector<uint64_t> size(n, 0, mr), positions(n, 0, mr);
+    auto term_id = [this](const std::string& text) {
+        thread_local std::vector<std::string> toks;   // keeps its capacity between queries
+        toks.clear();
+        Tokenizer::tokenize_into(text, toks);
+        return toks.empty() ? FrozenIndex::kNoTerm : index_.find(Stemmer::stem(toks[0]));
+    };
+
+    for (size_t i = 0; i < n; ++i) {
+        const QToken& t = p.rpn[i];
         if (t.type == QTokType::TERM) {
-            stack.push_back(eval_term_token(t.text));
+            NodeTimer timer(p.trace ? &p.trace[i] : nullptr);
+            if (near_operand[i]) {
+                const uint32_t id = term_id(t.text);   // left unresolved
+                if (id != FrozenIndex::kNoTerm) {
+                    size[i] = index_.df(id);
+                    positions[i] = index_.totalTf(id);
+                }
+            } else {
+                PostingList* slot = nullptr;
+                bool fresh = true;
+                if (operands) {
+                    auto r = operands->terms.try_emplace(t.text);
+                    slot = &r.first->second;
+                    fresh = r.second;
+                }
+                if (fresh) {
+                    const uint32_t id = term_id(t.text);
+                    PostingList list = id == FrozenIndex::kNoTerm ? PostingList{} : index_.postings(id);
+                    if (slot) *slot = std::move(list);
+                    else p.ops[i].owned = std::move(list);
+                }
+                if (slot) p.ops[i].list = slot;
+                size[i] = p.ops[i].get().size();
+            }
+            p.cost += size[i];
         } else if (t.type == QTokType::PHRASE) {
-            stack.push_back(evalOperandPhrase(t.text));
+            TokenizationStats dummy;
+            const std::vector<std::string> toks = Tokenizer::tokenize(normalizeQueryPhrase(t.text), &dummy);
+            size[i] = toks.empty() ? 0 : UINT64_MAX;
+            for (const auto& tok : toks) {
+                const uint32_t id = index_.find(Stemmer::stem(tok));
+                const uint64_t df = id == FrozenIndex::kNoTerm ? 0 : index_.df(id);
+                p.cost += df;
+                size[i] = std::min(size[i], df);
+                positions[i] += id == FrozenIndex::kNoTerm ? 0 : index_.totalTf(id);
+            }
+        } else if (t.type == QTokType::FILTER) {
+            DocFilter f;
+            std::string err;
+            if (!doc_values_.parseFilter(t.text, f, &err)) throw std::runtime_error(err);
+            size[i] = doc_values_.count(f);
+            p.cost += size[i];
+        } else if (t.type == QTokType::NEAR) {
+            if (stack.size() < 2) throw std::runtime_error("Binary operator operand missing");
+            const int b = stack.back();
+            stack.pop_back();
+            const int a = stack.back();
+            stack.pop_back();
+            auto leaf = [&](int j) { return p.rpn[j].type == QTokType::TERM || p.rpn[j].type == QTokType::PHRASE; };
+            if (!leaf(a) || !leaf(b)) throw std::runtime_error("NEAR operands must be terms or phrases");
+            p.cost += size[a] + size[b] + positions[a] + positions[b];
+            size[i] = std::min(size[a], size[b]);
         } else if (t.type == QTokType::NOT) {
             if (stack.empty()) throw std::runtime_error("NOT operand missing");
-            PostingList a = std::move(stack.back());
-            stack.pop_back();
-            stack.push_back(PostingList::Not(universe_, a));
+            p.lhs[i] = stack.back();
+            p.cost += universe + size[p.lhs[i]];
+            size[i] = universe;
+            stack.back() = (int)i;
+            continue;
         } else if (t.type == QTokType::AND || t.type == QTokType::OR) {
             if (stack.size() < 2) throw std::runtime_error("Binary operator operand missing");
-            PostingList b = std::move(stack.back()); stack.pop_back();
-            PostingList a = std::move(stack.back()); stack.pop_back();
-            stack.push_back(t.type == QTokType::AND ? PostingList::And(a, b) : PostingList::Or(a, b));
+            p.rhs[i] = stack.back(); stack.pop_back();
+            p.lhs[i] = stack.back();
+            const uint64_t a = size[p.lhs[i]], b = size[p.rhs[i]];
+            p.cost += a + b;
+            size[i] = (t.type == QTokType::OR) ? std::min(universe, a + b) : std::min(a, b);
+            stack.back() = (int)i;
+            continue;
+        }
+        stack.push_back((int)i);
+    }
+    if (!stack.empty()) p.root = stack.back();
+    return p;
+}
+
+void SearchEngine::resolveLeaves_(Plan& p, OperandCache* operands, int hi, const Deadline* dl) const {
+    const size_t n = p.rpn.size();
+    // makePlan checked that a NEAR's operands are the two leaves right before it
+    ArenaVector<char> near_operand(n, 0, p.resource());
+    for (size_t i = 2; i < n; ++i) {
+        if (p.rpn[i].type == QTokType::NEAR) near_operand[i - 1] = near_operand[i - 2] = 1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const QToken& t = p.rpn[i];
+        if (t.type != QTokType::PHRASE && t.type != QTokType::FILTER && t.type != QTokType::NEAR) continue;
+        if (near_operand[i]) continue;   // matched from positions by the NEAR
+        NodeTimer timer(p.trace ? &p.trace[i] : nullptr);
+        if (t.type == QTokType::PHRASE) {
+            if (operands) {
+                auto& cached = operands->phrases[t.text];
+                if (!cached) cached = std::make_unique<PostingList>(evalOperandPhrase(t.text));
+                p.ops[i].list = cached.get();
+            } else {
+                p.ops[i].owned = evalOperandPhrase(t.text, p.resource(), hi, dl, &p.ops[i].exact_below);
+            }
+        } else if (t.type == QTokType::FILTER) {
+            p.ops[i].owned = evalOperandFilter(t.text, hi, dl, &p.ops[i].exact_below);
+        } else {
+            p.ops[i].owned = evalOperandNear(t, p.rpn[i - 2], p.rpn[i - 1], hi, dl, &p.ops[i].exact_below);
+        }
+    }
+    foldNary_(p);
+    if (p.trace) {
+        for (size_t i = 0; i < n; ++i) {
+            if (p.lhs[i] < 0) p.trace[i].out = p.ops[i].get().size();
+        }
+    }
+}
+
+// "a OR b OR c OR d" parses left-deep; evaluated pairwise it would copy a
+// growing intermediate at every step. An AND/OR child of a node with the same
+// operator is folded into it, unless the batch cache shares its result.
+void SearchEngine::foldNary_(Plan& p) {
+    const size_t n = p.rpn.size();
+    ArenaVector<int> parent(n, -1, p.resource());
+    for (size_t i = 0; i < n; ++i) {
+        if (p.lhs[i] >= 0) parent[p.lhs[i]] = (int)i;
+        if (p.rhs[i] >= 0) parent[p.rhs[i]] = (int)i;
+    }
+    auto binary = [&](int i) { return p.rpn[i].type == QTokType::AND || p.rpn[i].type == QTokType::OR; };
+    auto folded = [&](int i) {
+        return binary(i) && parent[i] >= 0 && p.rpn[parent[i]].type == p.rpn[i].type &&
+               (p.shared.empty() || p.shared[i] < 0);
+    };
+
+    p.args.clear();
+    p.args_at.assign(n + 1, 0);
+    ArenaVector<int> todo(p.resource());
+    for (size_t i = 0; i < n; ++i) {
+        p.args_at[i] = (int)p.args.size();
+        if (!binary((int)i) || folded((int)i)) continue;
+        todo.assign({p.rhs[i], p.lhs[i]});   // popped left to right
+        while (!todo.empty()) {
+            const int c = todo.back();
+            todo.pop_back();
+            if (folded(c)) {
+                todo.push_back(p.rhs[c]);
+                todo.push_back(p.lhs[c]);
+            } else {
+                p.args.push_back(c);
+            }
         }
     }
+    p.args_at[n] = (int)p.args.size();
+}
 
-    PostingList final_docs;
-    if (!stack.empty()) final_docs = std::move(stack.back());
+// Evaluates the subtree rooted at `node`, restricted to doc ids in [lo, hi).
+// Leaves borrow index posting lists unless they have to be sliced.
+SearchEngine::Operand SearchEngine::evalNode(const Plan& plan, int node, int lo, int hi,
+                                             BatchCache* cache, const Deadline* dl,
+                                             std::pmr::memory_resource* mr) const {
+    const QToken& t = plan.rpn[node];
+    const bool full = (lo <= 0 && hi >= (int)documents_.size());
+    Operand out;
 
-    size_t count = 0;
-    for (int doc_id : final_docs.docs()) {
-        if ((int)documents_.size() <= doc_id) continue;
-        const auto& d = documents_[doc_id];
-        results.push_back({d.url, makeSnippet(d.plain, 200)});
-        if (++count >= max_results) break;
+    if (t.type == QTokType::TERM || t.type == QTokType::PHRASE || t.type == QTokType::FILTER ||
+        t.type == QTokType::NEAR) {
+        const PostingList& src = plan.ops[node].get();
+        if (full) out.list = &src;
+        else out.owned = src.slice(lo, hi, mr);
+        out.exact_below = plan.ops[node].exact_below;   // a leaf cut short by the deadline
+        return out;
+    }
+
+    if (cache && full && plan.shared[node] >= 0) {
+        BatchCache::Slot& slot = cache->slots[plan.shared[node]];
+        std::call_once(slot.once, [&] {
+            Operand r = evalOperator(plan, node, lo, hi, cache, nullptr, nullptr);
+            slot.value = r.list ? *r.list : std::move(r.owned);
+        });
+        out.list = &slot.value;
+        return out;
+    }
+    if (!plan.trace) return evalOperator(plan, node, lo, hi, cache, dl, mr);
+
+    {
+        NodeTimer timer(&plan.trace[node]);
+        out = evalOperator(plan, node, lo, hi, cache, dl, mr);
+    }
+    plan.trace[node].out += out.get().size();
+    return out;
+}
+
+SearchEngine::Operand SearchEngine::evalOperator(const Plan& plan, int node, int lo, int hi,
+                                                 BatchCache* cache, const Deadline* dl,
+                                                 std::pmr::memory_resource* mr) const {
+    const QToken& t = plan.rpn[node];
+    const bool full = (lo <= 0 && hi >= (int)documents_.size());
+    Operand out;
+    int cut = INT_MAX;
+
+    if (t.type == QTokType::NOT) {
+        Operand a = evalNode(plan, plan.lhs[node], lo, hi, cache, dl, mr);
+        if (full) {
+            out.owned = PostingList::Not(universe_, a.get(), dl, &cut, mr);
+        } else {
+            out.owned = PostingList::Not(universe_.slice(lo, hi, mr), a.get(), dl, &cut, mr);
+        }
+        out.exact_below = std::min(a.exact_below, cut);
+    } else {
+        return evalArgs_(plan, t.type, plan.args_at[node], plan.args_at[node + 1], lo, hi, cache, dl, mr);
+    }
+    return out;
+}
+
+// AND or OR of the operands plan.args[first, last) in one pass.
+SearchEngine::Operand SearchEngine::evalArgs_(const Plan& plan, QTokType type, int first, int last, int lo, int hi,
+                                              BatchCache* cache, const Deadline* dl,
+                                              std::pmr::memory_resource* mr) const {
+    if (last - first == 1) return evalNode(plan, plan.args[first], lo, hi, cache, dl, mr);
+    ArenaVector<Operand> in(mr);
+    ArenaVector<const PostingList*> lists(mr);
+    in.reserve((size_t)(last - first));
+    lists.reserve((size_t)(last - first));
+    Operand out;
+    for (int a = first; a < last; ++a) {
+        in.push_back(evalNode(plan, plan.args[a], lo, hi, cache, dl, mr));
+        lists.push_back(&in.back().get());
+        out.exact_below = std::min(out.exact_below, in.back().exact_below);
     }
+    int cut = INT_MAX;
+    out.owned = (type == QTokType::AND) ? PostingList::AndMany(lists, dl, &cut, mr)
+                                        : PostingList::OrMany(lists, dl, &cut, mr);
+    out.exact_below = std::min(out.exact_below, cut);
+    return out;
+}
+
+PostingList SearchEngine::evaluate(const Plan& plan, int hi, const Deadline* dl, int* exact_below,
+                                   std::pmr::memory_resource* mr) const {
+    if (exact_below) *exact_below = hi;
+    if (plan.root < 0 || hi <= 0) return PostingList(mr);
+
+    const size_t k = std::min<size_t>(parallel_.partitions, (size_t)hi);
+
+    // Doc-id partitions are independent; concatenating them keeps the order.
+    // A partition cut short by the deadline ends the exact prefix. Pool
+    // threads cannot share the arena, so partitions allocate from the heap.
+    ArenaVector<Operand> parts(k < 2 ? 1 : k, mr);
+    ArenaVector<int> bounds(parts.size() + 1, mr);
+    for (size_t p = 0; p <= parts.size(); ++p) {
+        bounds[p] = (int)((int64_t)hi * (int64_t)p / (int64_t)parts.size());
+    }
+    if (!pool_ || k < 2 || plan.cost < parallel_.min_cost) {
+        parts.resize(1);
+        bounds = {0, hi};
+        parts[0] = evalNode(plan, plan.root, 0, hi, nullptr, dl, mr);
+    } else {
+        pool_->parallelFor(parts.size(), [&](size_t p) {
+            parts[p] = evalNode(plan, plan.root, bounds[p], bounds[p + 1], nullptr, dl);
+        });
+    }
+
+    PostingList out(mr);
+    for (size_t p = 0; p < parts.size(); ++p) {
+        Operand& r = parts[p];
+        if (r.exact_below < bounds[p + 1]) {
+            out.appendSorted(r.get().slice(bounds[p], r.exact_below, mr));
+            if (exact_below) *exact_below = std::max(bounds[p], r.exact_below);
+            break;
+        }
+        if (p == 0 && !r.list) out = std::move(r.owned);
+        else out.appendSorted(r.get());
+    }
+    return out;
+}
+
+std::vector<SearchResult> SearchEngine::collectResults(const PostingList& docs, size_t max_results) const {
+    std::vector<SearchResult> results;
+    if (max_results == 0) return results;
+    results.reserve(std::min(max_results, docs.size()));
+    docs.forEach([&](int doc_id) {
+        if ((int)documents_.size() <= doc_id) return true;
+        const auto& d = documents_[doc_id];
+        results.push_back({d.url, makeSnippet(d.plain, 200), d.global_id});
+        return results.size() < max_results;
+    });
     return results;
 }
+
+static std::string over_budget(uint64_t cost, uint64_t budget) {
+    return "Query too expensive: estimated cost " + std::to_string(cost) + " over budget " + std::to_string(budget);
+}
+
+uint64_t SearchEngine::estimateQueryCost(const std::string& query) const {
+    QueryArena::Scope arena(arena_);
+    return makePlan(query, nullptr, false, arena.resource()).cost;
+}
+
+SearchResponse SearchEngine::execute(const std::string& query, size_t max_results, size_t facets,
+                                     QueryExplain* explain) const {
+    SearchResponse out;
+    if (documents_.empty()) return out;
+    QueryArena::Scope arena(arena_);   // outlives the plan and every posting list below
+
+    // measured only when asked for or when the slow-query log is on
+    const bool trace = explain || slow_log_;
+    AllocCounter::Scope counting(trace);
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point t0, t1, t2;
+    uint64_t alloc0 = 0, calls0 = 0;
+    if (trace) {
+        t0 = Clock::now();
+        alloc0 = AllocCounter::bytes();
+        calls0 = AllocCounter::calls();
+    }
+
+    // terms are looked up, nothing is verified or decoded before the budget check
+    Plan plan = makePlan(query, nullptr, trace, arena.resource());
+    const int n = (int)documents_.size();
+    int hi = n;
+    if (budget_.max_cost) {
+        const uint64_t cost = plan.cost;
+        if (cost > budget_.max_cost) {
+            if (!budget_.degrade) throw QueryRejected(over_budget(cost, budget_.max_cost), false);
+            // cost is roughly linear in the doc-id range searched
+            hi = std::max(1, (int)((double)n * (double)budget_.max_cost / (double)cost));
+            out.partial = true;
+            out.errors.push_back("over cost budget: searched " + std::to_string(hi) + " of " +
+                                 std::to_string(n) + " documents");
+        }
+    }
+
+    Deadline dl;
+    if (budget_.deadline_ms) dl = Deadline::after(std::chrono::milliseconds(budget_.deadline_ms));
+    const Deadline* dlp = budget_.deadline_ms ? &dl : nullptr;
+
+    resolveLeaves_(plan, nullptr, hi, dlp);
+    if (trace) t1 = Clock::now();
+    int exact_below = hi;
+    PostingList docs = evaluate(plan, hi, dlp, &exact_below, arena.resource());
+    if (trace) t2 = Clock::now();
+    if (exact_below < hi) {
+        out.partial = true;
+        out.errors.push_back("deadline of " + std::to_string(budget_.deadline_ms) + " ms: searched " +
+                             std::to_string(exact_below) + " of " + std::to_string(n) + " documents");
+    }
+    out.results = collectResults(docs, max_results);
+    out.total = docs.size();
+    if (facets) out.hosts = doc_values_.hostFacets(docs, facets);
+
+    if (trace) {
+        auto nanos = [](Clock::duration d) {
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        };
+        QueryExplain ex = explainPlan_(plan);
+        ex.plan_nanos = nanos(t1 - t0);
+        ex.eval_nanos = nanos(t2 - t1);
+        ex.collect_nanos = nanos(Clock::now() - t2);
+        ex.alloc_bytes = AllocCounter::bytes() - alloc0;
+        ex.alloc_calls = AllocCounter::calls() - calls0;
+        if (explain) *explain = ex;
+        if (slow_log_ && slow_log_->over(ex.totalNanos())) {
+            SlowQuery sq;
+            sq.query = query;
+            sq.unix_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::system_clock::now().time_since_epoch()).count();
+            sq.explain = std::move(ex);
+            slow_log_->add(std::move(sq));
+        }
+    }
+    return out;
+}
+
+static std::string explain_label(const QToken& t) {
+    switch (t.type) {
+    case QTokType::TERM: return "term:" + t.text;
+    case QTokType::PHRASE: return "phrase:\"" + t.text + "\"";
+    case QTokType::FILTER: return t.text;
+    case QTokType::AND: return "AND";
+    case QTokType::OR: return "OR";
+    case QTokType::NOT: return "NOT";
+    case QTokType::NEAR: return (t.ordered ? "ONEAR/" : "NEAR/") + std::to_string(t.distance);
+    default: return t.text;
+    }
+}
+
+QueryExplain SearchEngine::explainPlan_(const Plan& plan) const {
+    QueryExplain ex;
+    ex.root = plan.root;
+    ex.nodes.resize(plan.rpn.size());
+    for (size_t i = 0; i < plan.rpn.size(); ++i) {
+        const QToken& t = plan.rpn[i];
+        ExplainNode& e = ex.nodes[i];
+        e.label = explain_label(t);
+        e.lhs = plan.lhs[i];
+        e.rhs = plan.rhs[i];
+        if (plan.args_at[i + 1] - plan.args_at[i] > 2) {
+            e.args.assign(plan.args.begin() + plan.args_at[i], plan.args.begin() + plan.args_at[i + 1]);
+        }
+        e.out = plan.trace[i].out;
+        e.nanos = plan.trace[i].nanos;
+        e.alloc_bytes = plan.trace[i].alloc_bytes;
+        if (!ex.rpn.empty()) ex.rpn += ' ';
+        ex.rpn += e.label;
+        if (t.type == QTokType::NEAR && i >= 2) {
+            // its operands are matched inside it, not evaluated as nodes
+            e.label += "(" + explain_label(plan.rpn[i - 2]) + ", " + explain_label(plan.rpn[i - 1]) + ")";
+        }
+    }
+    return ex;
+}
+
+std::vector<SearchResult> SearchEngine::search(const std::string& query, size_t max_results) const {
+    return execute(query, max_results).results;
+}
+
+// |NOT a| = n - |a|, |a AND b| and |a OR b| = |a| + |b| - |a AND b| from
+// AndCount, |a AND NOT b| = |a| - |a AND b|; only the operands are built.
+uint64_t SearchEngine::countNode(const Plan& plan, int node, std::pmr::memory_resource* mr) const {
+    const QToken& t = plan.rpn[node];
+    const int n = (int)documents_.size();
+
+    if (t.type == QTokType::NOT) return universe_.size() - countNode(plan, plan.lhs[node], mr);
+    if (t.type == QTokType::AND || t.type == QTokType::OR) {
+        // all operands but the last are materialized, the last only counted
+        const int first = plan.args_at[node], last = plan.args_at[node + 1] - 1;
+        const int r = plan.args[last];
+        const bool lnot = last - first == 1 && plan.rpn[plan.args[first]].type == QTokType::NOT;
+        const bool rnot = plan.rpn[r].type == QTokType::NOT;
+        if (t.type == QTokType::AND && lnot != rnot) {
+            const Operand a = lnot ? evalNode(plan, r, 0, n, nullptr, nullptr, mr)
+                                   : evalArgs_(plan, t.type, first, last, 0, n, nullptr, nullptr, mr);
+            const Operand b = evalNode(plan, plan.lhs[lnot ? plan.args[first] : r], 0, n, nullptr, nullptr, mr);
+            return a.get().size() - PostingList::AndCount(a.get(), b.get());
+        }
+        const Operand a = evalArgs_(plan, t.type, first, last, 0, n, nullptr, nullptr, mr);
+        const Operand b = evalNode(plan, r, 0, n, nullptr, nullptr, mr);
+        const uint64_t both = PostingList::AndCount(a.get(), b.get());
+        return t.type == QTokType::AND ? both : a.get().size() + b.get().size() - both;
+    }
+    // leaves; a term's list is a view into the index, its size the df
+    return plan.ops[node].get().size();
+}
+
+uint64_t SearchEngine::count(const std::string& query) const {
+    if (documents_.empty()) return 0;
+    QueryArena::Scope arena(arena_);
+    Plan plan = makePlan(query, nullptr, false, arena.resource());
+    if (budget_.max_cost && plan.cost > budget_.max_cost) {
+        throw QueryRejected(over_budget(plan.cost, budget_.max_cost), false);
+    }
+    resolveLeaves_(plan);
+    return plan.root < 0 ? 0 : countNode(plan, plan.root, arena.resource());
+}
+
+// Canonical key of every subtree; AND/OR operands are ordered so that
+// "a AND b" and "b AND a" share one entry.
+static void subexpression_keys(const ArenaVector<QToken>& rpn, const ArenaVector<int>& lhs,
+                               const ArenaVector<int>& rhs, std::vector<std::string>& keys) {
+    keys.assign(rpn.size(), std::string());
+    for (size_t i = 0; i < rpn.size(); ++i) {
+        const QToken& t = rpn[i];
+        switch (t.type) {
+            case QTokType::TERM:   keys[i] = "t:" + t.text; break;
+            case QTokType::PHRASE: keys[i] = "p:" + t.text; break;
+            case QTokType::FILTER: keys[i] = "f:" + t.text; break;
+            case QTokType::NOT:    keys[i] = "!(" + keys[lhs[i]] + ")"; break;
+            case QTokType::NEAR: {
+                // NEAR leaves have no child links; its operands are the two entries before it
+                std::string a = keys[i - 2], b = keys[i - 1];
+                if (!t.ordered && b < a) std::swap(a, b);
+                keys[i] = (t.ordered ? "o" : "n") + std::to_string(t.distance) + "(" + a + "," + b + ")";
+                break;
+            }
+            case QTokType::AND:
+            case QTokType::OR: {
+                const std::string& a = keys[lhs[i]];
+                const std::string& b = keys[rhs[i]];
+                const char* op = (t.type == QTokType::AND) ? "&(" : "|(";
+                keys[i] = (a < b) ? op + a + "," + b + ")" : op + b + "," + a + ")";
+                break;
+            }
+            default: break;
+        }
+    }
+}
+
+void SearchEngine::searchBatch(const std::vector<std::string>& queries, size_t max_results,
+                               const BatchSink& sink) const {
+    const size_t n = queries.size();
+    if (n == 0) return;
+
+    // 1. identical queries are answered once
+    std::unordered_map<std::string, size_t> first_of;
+    std::vector<size_t> unique_of(n);
+    std::vector<size_t> uniques;
+    for (size_t i = 0; i < n; ++i) {
+        auto [it, inserted] = first_of.emplace(queries[i], uniques.size());
+        if (inserted) uniques.push_back(i);
+        unique_of[i] = it->second;
+    }
+
+    // 2. parse once, resolve each distinct term/phrase once, find shared subexpressions
+    const size_t u = uniques.size();
+    std::vector<Plan> plans(u);
+    std::vector<std::string> errors(u);
+    OperandCache operands;
+    std::vector<std::vector<std::string>> keys(u);
+    std::unordered_map<std::string, int> key_uses;
+
+    for (size_t j = 0; j < u; ++j) {
+        try {
+            plans[j] = makePlan(queries[uniques[j]], &operands);
+            // no degrading or deadlines here: shared subexpressions must be complete
+            if (budget_.max_cost && plans[j].cost > budget_.max_cost) {
+                errors[j] = over_budget(plans[j].cost, budget_.max_cost);
+                continue;
+            }
+            resolveLeaves_(plans[j], &operands);
+        } catch (const std::exception& e) {
+            errors[j] = e.what();
+            continue;
+        }
+        const Plan& p = plans[j];
+        subexpression_keys(p.rpn, p.lhs, p.rhs, keys[j]);
+        for (size_t i = 0; i < p.rpn.size(); ++i) {
+            QTokType ty = p.rpn[i].type;
+            if (ty == QTokType::NOT || ty == QTokType::AND || ty == QTokType::OR) ++key_uses[keys[j][i]];
+        }
+    }
+    int slot_count = 0;
+    for (auto& [key, uses] : key_uses) uses = (uses > 1) ? slot_count++ : -1;
+
+    BatchCache cache;
+    cache.slots = std::make_unique<BatchCache::Slot[]>((size_t)slot_count);
+    for (size_t j = 0; j < u; ++j) {
+        Plan& p = plans[j];
+        p.shared.assign(p.rpn.size(), -1);
+        for (size_t i = 0; i < keys[j].size(); ++i) {
+            auto it = key_uses.find(keys[j][i]);
+            if (it != key_uses.end()) p.shared[i] = it->second;
+        }
+        foldNary_(p);   // shared subexpressions stay nodes of their own
+    }
+
+    // 3. evaluate distinct queries on the pool, emit in input order
+    std::vector<BatchItem> items(u);
+    std::vector<char> ready(u, 0);
+    std::mutex mu;
+    std::condition_variable cv;
+
+    auto run_one = [&](size_t j) {
+        BatchItem item;
+        item.query = queries[uniques[j]];
+        item.error = errors[j];
+        if (item.error.empty() && !documents_.empty()) {
+            try {
+                const Plan& p = plans[j];
+                PostingList docs;
+                if (p.root >= 0) {
+                    Operand r = evalNode(p, p.root, 0, (int)documents_.size(), &cache);
+                    docs = r.list ? *r.list : std::move(r.owned);
+                }
+                item.response.results = collectResults(docs, max_results);
+                item.response.total = docs.size();
+            } catch (const std::exception& e) {
+                item.error = e.what();
+            }
+        }
+        std::lock_guard<std::mutex> lk(mu);
+        items[j] = std::move(item);
+        ready[j] = 1;
+        cv.notify_all();
+    };
+
+    if (pool_) {
+        for (size_t j = 0; j < u; ++j) pool_->submit([&run_one, j] { run_one(j); });
+    }
+
+    std::exception_ptr sink_error;
+    for (size_t i = 0; i < n; ++i) {
+        const size_t j = unique_of[i];
+        if (!pool_) {
+            if (!ready[j]) run_one(j);
+        } else {
+            std::unique_lock<std::mutex> lk(mu);
+            cv.wait(lk, [&] { return ready[j] != 0; });
+        }
+        if (sink_error) continue;
+        try {
+            sink(i, items[j]);
+        } catch (...) {
+            sink_error = std::current_exception();
+        }
+    }
+    // every submitted task has finished by now: all slots were waited for
+    if (sink_error) std::rethrow_exception(sink_error);
+}
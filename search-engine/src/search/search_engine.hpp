@@ -1,11 +1,27 @@
 #pragma once
+#include <climits>
 #include <vector>
 #include <string>
+#include <functional>
+#include <memory>
 #include <optional>
+#include <stdexcept>
 #include "../document.hpp"
 #include "../structures/hash_table.hpp"
 #include "../index/term_data.hpp"
+#include "../index/index_builder.hpp"
+#include "../index/frozen_index.hpp"
+#include "../index/spimi.hpp"
+#include "../index/doc_values.hpp"
+#include "../index/completion_trie.hpp"
+#include "../index/doc_reorder.hpp"
+#include "../index/forward_index.hpp"
+#include "../index/index_pruner.hpp"
 #include "../structures/posting_list.hpp"
+#include "../structures/query_arena.hpp"
+#include "../structures/thread_pool.hpp"
+#include "boolean_query_parser.hpp"
+#include "query_explain.hpp"
 
 struct MongoConfig {
     std::string uri = "mongodb://localhost:27017";
@@ -13,28 +29,247 @@ struct MongoConfig {
     std::string collection = "documents";
 };
 
+// Intra-query parallelism: an expensive query is evaluated on `partitions`
+// doc-id ranges in parallel and the results are concatenated in order.
+struct ParallelOptions {
+    size_t threads = 0;            // shared pool size; < 2 disables parallel evaluation
+    size_t partitions = 0;         // 0 = one per thread
+    uint64_t min_cost = 1 << 20;   // estimated posting entries read before it pays off
+};
+
+// Per-query limits; 0 means unlimited.
+struct QueryBudget {
+    uint64_t max_cost = 0;        // estimated posting entries read (see estimateQueryCost)
+    bool degrade = false;         // over budget: search a doc-id prefix instead of rejecting
+    uint32_t deadline_ms = 0;     // cooperative; on expiry results so far are returned as partial
+};
+
+// A query refused before evaluation: over the cost budget, or (retryable)
+// turned away by admission control.
+class QueryRejected : public std::runtime_error {
+public:
+    QueryRejected(const std::string& what, bool retryable)
+        : std::runtime_error(what), retryable_(retryable) {}
+    bool retryable() const { return retryable_; }
+
+private:
+    bool retryable_;
+};
+
+// One answer of a batch; `error` is set instead when the query failed to parse.
+struct BatchItem {
+    std::string query;
+    SearchResponse response;
+    std::string error;
+};
+
+using BatchSink = std::function<void(size_t index, const BatchItem& item)>;
+
+// A completion: a term of the index (a view into it) and its document frequency.
+struct Suggestion {
+    std::string_view term;
+    uint32_t df = 0;
+};
+
+// A "more like this" answer: the document and its cosine to the source.
+struct SimilarDoc {
+    SearchResult result;
+    float score = 0.0f;
+};
+
 class SearchEngine {
 public:
     SearchEngine();
 
+    // Keep only documents whose URL hashes to shard `index` of `count`
+    // (document-partitioned serving behind a ShardCoordinator).
+    void setShard(uint32_t index, uint32_t count);
+
     bool loadFromMongo(const MongoConfig& cfg, std::string* err = nullptr);
     bool loadFromSampleFile(const std::string& path, std::string* err = nullptr);
 
     void buildIndex(bool enable_stemming);
 
+    // Offline external-memory build: streams the sample file through a
+    // SpimiBuilder, so neither the corpus nor the index is held in memory.
+    bool buildIndexFile(const std::string& sample_path, const std::string& index_path,
+                        const SpimiOptions& opt, SpimiStats* stats = nullptr,
+                        std::string* err = nullptr) const;
+
+    // Serves from an index file instead of buildIndex(). The loaded documents
+    // must be the ones the file was built from (same source and shard).
+    bool loadIndex(const std::string& index_path, std::string* err = nullptr);
+
+    void setParallelism(const ParallelOptions& opt);
+
+    void setQueryBudget(const QueryBudget& budget) { budget_ = budget; }
+
+    // Scratch memory of execute() and count(): parser tokens, the plan and
+    // intermediate posting lists come from a per-thread QueryArena reset after
+    // each query. Batches and partitions evaluated on the pool use the heap.
+    void setQueryArena(const ArenaOptions& opt) { arena_ = opt; }
+
+    // Keeps the last `capacity` queries taking at least `threshold_ms`, with
+    // their explain; queries are only measured while it is on.
+    void setSlowQueryLog(uint32_t threshold_ms, size_t capacity = 64) {
+        slow_log_ = std::make_shared<SlowQueryLog>(threshold_ms, capacity);
+    }
+    const SlowQueryLog* slowQueryLog() const { return slow_log_.get(); }
+
+    // Near-duplicate removal for buildIndex (not applied to SPIMI index files).
+    void setDedup(const DedupOptions& opt) { dedup_ = opt; }
+
+    // Doc-id reassignment for buildIndex (see DocReorder); results come back
+    // in the new id order. Not applied to SPIMI index files.
+    void setDocOrder(const ReorderOptions& opt) { reorder_ = opt; }
+
+    // Static pruning for buildIndex (see IndexPruner), after any reordering;
+    // what it removed is in buildStats().profile. Not applied to SPIMI index files.
+    void setPruning(const PruneOptions& opt) { prune_ = opt; }
+
+    // Upper bound on the posting entries a query reads, from list sizes alone
+    // (phrases are not verified); the budget checks this. Throws on a malformed query.
+    uint64_t estimateQueryCost(const std::string& query) const;
+
+    // Evaluates under the query budget: throws QueryRejected when over it, or
+    // returns partial results (degraded or cut by the deadline) marked as such.
+    // With `facets` > 0 the response also counts the top hosts over all matches.
+    // With `explain` set, it receives the plan with per-node sizes, times and
+    // allocations (EXPLAIN ANALYZE).
+    SearchResponse execute(const std::string& query, size_t max_results = 50, size_t facets = 0,
+                           QueryExplain* explain = nullptr) const;
+
     std::vector<SearchResult> search(const std::string& query, size_t max_results = 50) const;
 
+    // Exact number of matching documents without collecting them: the top
+    // AND/OR/NOT operators only count, and a lone term is its document
+    // frequency. Rejected over the cost budget, never degraded.
+    uint64_t count(const std::string& query) const;
+
+    // Evaluates many queries together: duplicate queries, terms and common
+    // subexpressions are computed once, queries run on the shared pool, and
+    // `sink` is called on the calling thread in input order as results become ready.
+    void searchBatch(const std::vector<std::string>& queries, size_t max_results,
+                     const BatchSink& sink) const;
+
+    // Up to k (at most CompletionTrie::kTopK) index terms completing the last
+    // word of `prefix`, most frequent first; falls back to the stemmed word
+    // when nothing starts with it as typed. Does not allocate in the common case.
+    size_t suggest(std::string_view prefix, Suggestion* out, size_t k = CompletionTrie::kTopK) const;
+
+    // Up to k documents most like the one at `url`, by cosine of their
+    // TF-IDF vectors (see ForwardIndex). Throws if no document has that URL.
+    std::vector<SimilarDoc> similar(const std::string& url, size_t k = 10) const;
+
+    // Every matching document, without limit or budget; for comparing two
+    // indexes over the same documents. Throws on a malformed query.
+    PostingList matches(const std::string& query) const;
+
     bool exportZipfCSV(const std::string& path_csv, size_t max_terms = 0, std::string* err = nullptr) const;
 
+    // Heap of the documents, the index and the other serving structures,
+    // with size distributions and the slack worth reclaiming.
+    MemoryReport memoryReport() const;
+
     const std::vector<Document>& documents() const { return documents_; }
+    const BuildStats& buildStats() const { return build_stats_; }
 
 private:
-    HashTable<TermData> index_;
+    FrozenIndex index_;
+    DocValues doc_values_;
+    CompletionTrie completions_;
+    ForwardIndex forward_;
+    std::vector<uint32_t> by_url_;       // doc ids ordered by URL
     std::vector<Document> documents_;
     PostingList universe_;
+    StageTiming load_timing_;
+    BuildStats build_stats_;
+    std::vector<MemoryItem> build_memory_;   // the build-time dictionary just before freezing
+    uint32_t shard_index_ = 0;
+    uint32_t shard_count_ = 1;
+
+    ParallelOptions parallel_;
+    std::shared_ptr<ThreadPool> pool_;
+    QueryBudget budget_;
+    ArenaOptions arena_;
+    DedupOptions dedup_;
+    ReorderOptions reorder_;
+    PruneOptions prune_;
+    std::shared_ptr<SlowQueryLog> slow_log_;
+
+    bool inShard(const std::string& url) const;
+    void buildDerived_();
+    void reorderDocs_(HashTable<TermData>& building);
+    bool readSampleFile(const std::string& path, const std::function<void(Document&&)>& fn,
+                        StageTiming& timing, std::string* err) const;
+
+    // An evaluation value: either borrowed (from the index or a cache) or owned.
+    struct Operand {
+        const PostingList* list = nullptr;
+        PostingList owned;
+        int exact_below = INT_MAX;     // lower when a deadline cut the evaluation short
+
+        const PostingList& get() const { return list ? *list : owned; }
+    };
+
+    // Parsed query: RPN with child links and resolved leaves, its arrays
+    // allocated from the resource it was made with.
+    struct Plan {
+        explicit Plan(std::pmr::memory_resource* mr = nullptr)
+            : rpn(mr), lhs(mr), rhs(mr), args_at(mr), args(mr), ops(mr), shared(mr) {}
+
+        ArenaVector<QToken> rpn;
+        ArenaVector<int> lhs, rhs;     // child positions in rpn, -1 if none
+        // Operands of AND/OR node i, chains of the same operator folded into
+        // one n-ary node: args[args_at[i], args_at[i + 1]). Empty for a node
+        // folded into its parent, which is never evaluated on its own.
+        ArenaVector<int> args_at, args;
+        int root = -1;
+        uint64_t cost = 0;             // estimated posting entries read, known before leaves resolve
+        ArenaVector<Operand> ops;      // filled for leaves: TERM/PHRASE/FILTER/NEAR (NEAR is a leaf)
+        ArenaVector<int> shared;       // batch cache slot per position, -1 if not shared
+        std::unique_ptr<NodeTrace[]> trace;  // per position, only when measuring
+
+        std::pmr::memory_resource* resource() const { return rpn.get_allocator().resource(); }
+    };
+
+    struct OperandCache;
+    struct BatchCache;
+
+    // `mr` (null: the heap) holds the plan and its leaves. Only terms are
+    // resolved; the cost is estimated from list sizes.
+    Plan makePlan(const std::string& query, OperandCache* operands = nullptr, bool trace = false,
+                  std::pmr::memory_resource* mr = nullptr) const;
+    // Resolves phrase, NEAR and filter leaves below doc id `hi` only, cut
+    // short once `dl` passes (their Operand::exact_below).
+    void resolveLeaves_(Plan& plan, OperandCache* operands = nullptr, int hi = INT_MAX,
+                        const Deadline* dl = nullptr) const;
+    static void foldNary_(Plan& plan);
+    QueryExplain explainPlan_(const Plan& plan) const;
+    // intermediates are allocated from `mr`, the heap if null
+    Operand evalNode(const Plan& plan, int node, int lo, int hi, BatchCache* cache = nullptr,
+                     const Deadline* dl = nullptr, std::pmr::memory_resource* mr = nullptr) const;
+    Operand evalOperator(const Plan& plan, int node, int lo, int hi, BatchCache* cache,
+                         const Deadline* dl, std::pmr::memory_resource* mr) const;
+    // AND or OR (`type`) of the operands args[first, last) of a plan
+    Operand evalArgs_(const Plan& plan, QTokType type, int first, int last, int lo, int hi, BatchCache* cache,
+                      const Deadline* dl, std::pmr::memory_resource* mr) const;
+    uint64_t countNode(const Plan& plan, int node, std::pmr::memory_resource* mr = nullptr) const;
+    // docs in [0, hi) matching the plan; *exact_below < hi if the deadline hit
+    PostingList evaluate(const Plan& plan, int hi, const Deadline* dl = nullptr,
+                         int* exact_below = nullptr, std::pmr::memory_resource* mr = nullptr) const;
 
     PostingList evalOperandTerm(const std::string& term) const;
-    PostingList evalOperandPhrase(const std::string& phrase) const;
+    // Leaves below doc id `hi`; a passed `dl` stops them and sets *cutoff
+    // to the first doc id not verified.
+    PostingList evalOperandPhrase(const std::string& phrase, std::pmr::memory_resource* mr = nullptr,
+                                  int hi = INT_MAX, const Deadline* dl = nullptr, int* cutoff = nullptr) const;
+    PostingList evalOperandFilter(const std::string& filter, int hi = INT_MAX, const Deadline* dl = nullptr,
+                                  int* cutoff = nullptr) const;
+    // From word positions only; `a` and `b` are TERM or PHRASE tokens.
+    PostingList evalOperandNear(const QToken& op, const QToken& a, const QToken& b, int hi = INT_MAX,
+                                const Deadline* dl = nullptr, int* cutoff = nullptr) const;
+    std::vector<SearchResult> collectResults(const PostingList& docs, size_t max_results) const;
     static std::string makeSnippet(const std::string& plain, size_t n = 200);
 
     // Helpers for phrase:
@@ -0,0 +1,25 @@
+#include "alloc_counter.hpp"
+
+namespace {
+
+thread_local uint64_t t_bytes = 0;
+thread_local uint64_t t_calls = 0;
+thread_local uint32_t t_scopes = 0;   // open AllocCounter::Scopes
+
+} // namespace
+
+uint64_t AllocCounter::bytes() { return t_bytes; }
+uint64_t AllocCounter::calls() { return t_calls; }
+
+void AllocCounter::record(std::size_t n) {
+    if (t_scopes == 0) return;
+    t_bytes += n;
+    ++t_calls;
+}
+
+AllocCounter::Scope::Scope(bool on) : on_(on) {
+    if (on_) ++t_scopes;
+}
+AllocCounter::Scope::~Scope() {
+    if (on_) --t_scopes;
+}
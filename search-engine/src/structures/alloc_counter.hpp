@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Heap bytes and calls requested through operator new on the calling thread.
+// The global operators are replaced in alloc_hook.cpp, which only the
+// executables reporting allocations link; without it the readings stay 0.
+// Only allocations made inside a Scope are counted; elsewhere operator new
+// costs one thread-local test. Take the difference of two readings within a
+// scope to charge allocations to a piece of work.
+struct AllocCounter {
+    static uint64_t bytes();
+    static uint64_t calls();
+
+    // called by the replaced operator new
+    static void record(std::size_t n);
+
+    // Counts this thread's allocations while alive; scopes nest.
+    class Scope {
+    public:
+        explicit Scope(bool on = true);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        bool on_;
+    };
+};
@@ -0,0 +1,60 @@
+// Replaces the global operator new/delete to feed AllocCounter. Linked into
+// the executables that report allocations, not into search_core, so nothing
+// else that links the library has its allocator replaced.
+#include "alloc_counter.hpp"
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// as the standard operator new: retry through the new_handler until it gives up
+void* allocate(std::size_t n) {
+    AllocCounter::record(n);
+    if (n == 0) n = 1;
+    while (true) {
+        if (void* p = std::malloc(n)) return p;
+        std::new_handler h = std::get_new_handler();
+        if (!h) throw std::bad_alloc();
+        h();
+    }
+}
+
+void* allocate_aligned(std::size_t n, std::align_val_t al) {
+    AllocCounter::record(n);
+    const std::size_t a = static_cast<std::size_t>(al);
+    const std::size_t size = n ? (n + a - 1) / a * a : a;
+    while (true) {
+        if (void* p = std::aligned_alloc(a, size)) return p;
+        std::new_handler h = std::get_new_handler();
+        if (!h) throw std::bad_alloc();
+        h();
+    }
+}
+
+void* allocate_nothrow(std::size_t n) noexcept {
+    try {
+        return allocate(n);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+} // namespace
+
+void* operator new(std::size_t n) { return allocate(n); }
+void* operator new[](std::size_t n) { return allocate(n); }
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept { return allocate_nothrow(n); }
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept { return allocate_nothrow(n); }
+void* operator new(std::size_t n, std::align_val_t al) { return allocate_aligned(n, al); }
+void* operator new[](std::size_t n, std::align_val_t al) { return allocate_aligned(n, al); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
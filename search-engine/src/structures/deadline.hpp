@@ -0,0 +1,13 @@
+#pragma once
+#include <chrono>
+
+// Cooperative time limit for long set operations. PostingList merges check
+// it once per container; once it has passed they stop and report the first
+// doc id they did not process, so their output is exact below that id.
+struct Deadline {
+    using clock = std::chrono::steady_clock;
+    clock::time_point at = clock::time_point::max();
+
+    static Deadline after(std::chrono::milliseconds ms) { return {clock::now() + ms}; }
+    bool expired() const { return clock::now() >= at; }
+};
@@ -3,6 +3,7 @@
 #include <string>
 #include <cstdint>
 #include <utility>
+#include "memory_report.hpp"
 
 template <typename Value>
 class HashTable {
@@ -101,6 +102,21 @@ public:
         ++size_;
     }
 
+    // Heap held by the table itself, appended as `name`.buckets (empty ones
+    // are slack), .nodes and .keys (those too long to be stored inline).
+    // Heap owned by the values is theirs to report.
+    void memoryUsage(const std::string& name, std::vector<MemoryItem>& out) const {
+        MemoryItem buckets{name + ".buckets", buckets_.size(), 0, buckets_.capacity() * sizeof(Node*)};
+        MemoryItem keys{name + ".keys"};
+        for (auto* head : buckets_) {
+            if (head) buckets.used += sizeof(Node*);
+            for (Node* n = head; n; n = n->next) keys.addString(n->key);
+        }
+        out.push_back(std::move(buckets));
+        out.push_back({name + ".nodes", size_, size_ * sizeof(Node), size_ * sizeof(Node)});
+        out.push_back(std::move(keys));
+    }
+
     template <typename Fn>
     void forEach(Fn&& fn) const {
         for (auto* head : buckets_) {
@@ -110,6 +126,15 @@ public:
         }
     }
 
+    template <typename Fn>
+    void forEach(Fn&& fn) {
+        for (auto* head : buckets_) {
+            for (Node* n = head; n; n = n->next) {
+                fn(n->key, n->value);
+            }
+        }
+    }
+
 private:
     struct Node {
         std::string key;
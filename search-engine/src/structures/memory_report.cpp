@@ -0,0 +1,133 @@
+#include "memory_report.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+void MemoryItem::addString(const std::string& s) {
+    // the small-string buffer lives inside the object, counted with its owner
+    const char* self = reinterpret_cast<const char*>(&s);
+    if (s.data() >= self && s.data() < self + sizeof(s)) return;
+    ++count;
+    used += s.size() + 1;
+    reserved += s.capacity() + 1;
+}
+
+SizeDistribution SizeDistribution::of(std::string name, std::vector<uint64_t> values) {
+    SizeDistribution d;
+    d.name = std::move(name);
+    d.count = values.size();
+    if (values.empty()) return d;
+    std::sort(values.begin(), values.end());
+    for (uint64_t v : values) d.sum += v;
+    auto at = [&](double q) { return values[std::min(values.size() - 1, (size_t)(q * (double)values.size()))]; };
+    d.min = values.front();
+    d.p50 = at(0.50);
+    d.p90 = at(0.90);
+    d.p99 = at(0.99);
+    d.max = values.back();
+    return d;
+}
+
+uint64_t MemoryReport::used(const std::vector<MemoryItem>& items) {
+    uint64_t b = 0;
+    for (const auto& it : items) b += it.used;
+    return b;
+}
+
+uint64_t MemoryReport::reserved(const std::vector<MemoryItem>& items) {
+    uint64_t b = 0;
+    for (const auto& it : items) b += it.reserved;
+    return b;
+}
+
+static std::string mib(uint64_t bytes) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(2) << (double)bytes / (1024.0 * 1024.0) << " MiB";
+    return oss.str();
+}
+
+void MemoryReport::flagSlack(uint64_t min_slack) {
+    for (const auto* group : {&items, &build_items}) {
+        for (const auto& it : *group) {
+            if (it.slack() < min_slack || it.slack() * 4 < it.reserved) continue;
+            waste.push_back((group == &build_items ? "build " : "") + it.name + ": " + mib(it.slack()) + " of " +
+                            mib(it.reserved) + " reserved is unused");
+        }
+    }
+}
+
+static void print_items(std::ostream& out, const std::vector<MemoryItem>& items) {
+    out << "  " << std::left << std::setw(26) << "group" << std::right << std::setw(12) << "count"
+        << std::setw(12) << "used MiB" << std::setw(12) << "resv MiB" << std::setw(8) << "slack%" << "\n";
+    auto row = [&](const std::string& name, const std::string& count, uint64_t used, uint64_t reserved) {
+        out << "  " << std::left << std::setw(26) << name << std::right << std::setw(12) << count
+            << std::fixed << std::setprecision(2) << std::setw(12) << (double)used / (1024.0 * 1024.0)
+            << std::setw(12) << (double)reserved / (1024.0 * 1024.0) << std::setprecision(1) << std::setw(8)
+            << (reserved ? 100.0 * (double)(reserved - std::min(used, reserved)) / (double)reserved : 0.0) << "\n";
+    };
+    for (const auto& it : items) row(it.name, std::to_string(it.count), it.used, it.reserved);
+    row("total", "", MemoryReport::used(items), MemoryReport::reserved(items));
+}
+
+void MemoryReport::print(std::ostream& out) const {
+    out << "Memory report\n";
+    print_items(out, items);
+    out << "  RSS: " << rss_kb / 1024 << " MiB (accounted " << mib(reserved(items)) << "), peak "
+        << peak_rss_kb / 1024 << " MiB\n";
+    if (!build_items.empty()) {
+        out << "  build-time dictionary before freeze (released):\n";
+        print_items(out, build_items);
+    }
+    if (!distributions.empty()) {
+        out << "  " << std::left << std::setw(26) << "distribution" << std::right << std::setw(12) << "count"
+            << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10)
+            << "p99" << std::setw(12) << "max" << "\n";
+        for (const auto& d : distributions) {
+            out << "  " << std::left << std::setw(26) << d.name << std::right << std::setw(12) << d.count
+                << std::fixed << std::setprecision(1) << std::setw(10)
+                << (d.count ? (double)d.sum / (double)d.count : 0.0) << std::setw(10) << d.p50 << std::setw(10)
+                << d.p90 << std::setw(10) << d.p99 << std::setw(12) << d.max << "\n";
+        }
+    }
+    for (const auto& w : waste) out << "  waste: " << w << "\n";
+}
+
+static void append_items(std::ostringstream& oss, const std::vector<MemoryItem>& items) {
+    oss << "[";
+    for (size_t i = 0; i < items.size(); ++i) {
+        const MemoryItem& it = items[i];
+        if (i) oss << ",";
+        oss << "{\"name\":\"" << it.name << "\",\"count\":" << it.count << ",\"used\":" << it.used
+            << ",\"reserved\":" << it.reserved << "}";
+    }
+    oss << "]";
+}
+
+std::string MemoryReport::toJson() const {
+    std::ostringstream oss;
+    oss << "{\"rss_kb\":" << rss_kb << ",\"peak_rss_kb\":" << peak_rss_kb << ",\"used\":" << used(items)
+        << ",\"reserved\":" << reserved(items) << ",\"items\":";
+    append_items(oss, items);
+    oss << ",\"build_items\":";
+    append_items(oss, build_items);
+    oss << ",\"distributions\":[";
+    for (size_t i = 0; i < distributions.size(); ++i) {
+        const SizeDistribution& d = distributions[i];
+        if (i) oss << ",";
+        oss << "{\"name\":\"" << d.name << "\",\"count\":" << d.count << ",\"sum\":" << d.sum
+            << ",\"min\":" << d.min << ",\"p50\":" << d.p50 << ",\"p90\":" << d.p90 << ",\"p99\":" << d.p99
+            << ",\"max\":" << d.max << "}";
+    }
+    oss << "],\"waste\":[";
+    for (size_t i = 0; i < waste.size(); ++i) {
+        if (i) oss << ",";
+        oss << "\"";
+        for (char c : waste[i]) {
+            if (c == '"' || c == '\\') oss << '\\';
+            oss << c;
+        }
+        oss << "\"";
+    }
+    oss << "]}";
+    return oss.str();
+}
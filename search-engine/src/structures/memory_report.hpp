@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// A group of heap allocations: `used` bytes hold data and `reserved` bytes
+// are allocated for them. The difference is slack: vector and string
+// capacity, empty hash buckets.
+struct MemoryItem {
+    std::string name;
+    uint64_t count = 0;       // elements, strings or nodes in the group
+    uint64_t used = 0;
+    uint64_t reserved = 0;
+
+    uint64_t slack() const { return reserved > used ? reserved - used : 0; }
+
+    // counts the heap block of `s`, if it does not fit the small-string buffer
+    void addString(const std::string& s);
+};
+
+// Spread of a per-element size (postings per term, bytes per document).
+struct SizeDistribution {
+    std::string name;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t min = 0, p50 = 0, p90 = 0, p99 = 0, max = 0;
+
+    static SizeDistribution of(std::string name, std::vector<uint64_t> values);
+};
+
+// Exact heap accounting, group by group, as the structures report it.
+// Allocator headers and freed-but-unreturned heap are not included; the RSS
+// readings show how far apart the two are.
+struct MemoryReport {
+    std::vector<MemoryItem> items;            // live structures
+    std::vector<MemoryItem> build_items;      // build-time dictionary, just before it was frozen and freed
+    std::vector<SizeDistribution> distributions;
+    std::vector<std::string> waste;
+    uint64_t rss_kb = 0;
+    uint64_t peak_rss_kb = 0;
+
+    template <class T>
+    static MemoryItem vector(std::string name, const std::vector<T>& v) {
+        return {std::move(name), v.size(), v.size() * sizeof(T), v.capacity() * sizeof(T)};
+    }
+
+    static uint64_t used(const std::vector<MemoryItem>& items);
+    static uint64_t reserved(const std::vector<MemoryItem>& items);
+
+    // Adds a waste line for each group whose slack is at least `min_slack`
+    // bytes and a quarter of what it reserves.
+    void flagSlack(uint64_t min_slack = 64 << 10);
+
+    void print(std::ostream& os) const;
+    std::string toJson() const;
+};
@@ -1,82 +1,953 @@
 #pragma once
 #include <vector>
 #include <algorithm>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <span>
+#include "deadline.hpp"
+#include "query_arena.hpp"
 
+// Sorted set of doc ids in roaring-style hybrid containers. Ids are split into
+// 2^16-wide chunks by their high half; each chunk keeps its low halves as a
+// sorted array, a 65536-bit bitmap or a list of runs. Appends build arrays and
+// bitmaps; optimize() then picks the smallest kind per chunk. Set operations
+// work container by container, bitmaps with word-wide ops and popcount.
+// A list can also be a read-only view over storage owned by a FrozenIndex.
+// Results and slices are allocated from an optional memory resource (a query
+// arena); a moved list keeps its resource, a copied one is on the heap.
 class PostingList {
 public:
+    enum class Kind : uint8_t { Array, Bitmap, Run };
+
+    struct Container {
+        uint32_t key = 0;       // doc_id >> 16
+        Kind kind = Kind::Array;
+        uint32_t card = 0;
+        uint32_t offset = 0;    // into shorts_ (Array, Run) or words_ (Bitmap)
+        uint32_t length = 0;    // pool elements used; a run is two shorts (start, len - 1)
+    };
+
+    static constexpr uint32_t kArrayMax = 4096;      // above this a bitmap is smaller
+    static constexpr uint32_t kBitmapWords = 1024;   // 65536 bits
+
+    PostingList() = default;
+    explicit PostingList(std::pmr::memory_resource* mr) : containers_(mr), shorts_(mr), words_(mr) {}
+
+    // View over containers whose offsets point into the given pools. The
+    // storage must outlive the view; mutating a view copies it first.
+    static PostingList view(std::span<const Container> dir, const uint16_t* shorts,
+                            const uint64_t* words, size_t size) {
+        PostingList v;
+        v.view_dir_ = dir;
+        v.view_shorts_ = shorts;
+        v.view_words_ = words;
+        v.view_ = true;
+        v.size_ = size;
+        return v;
+    }
+
     void add(int doc_id) {
-        if (docs_.empty() || doc_id > docs_.back()) {
-            docs_.push_back(doc_id);
+        detach_();
+        if (containers_.empty() || doc_id > back_()) {
+            addSortedUnique(doc_id);
             return;
         }
-        auto it = std::lower_bound(docs_.begin(), docs_.end(), doc_id);
-        if (it == docs_.end() || *it != doc_id) {
-            docs_.insert(it, doc_id);
-        }
+        if (contains(doc_id)) return;
+        std::vector<int> all = toVector();
+        all.insert(std::lower_bound(all.begin(), all.end(), doc_id), doc_id);
+        PostingList rebuilt;
+        for (int d : all) rebuilt.addSortedUnique(d);
+        *this = std::move(rebuilt);
     }
 
+    // ids must arrive in non-decreasing order; repeats of the last id are ignored
     void addSortedUnique(int doc_id) {
-        if (docs_.empty() || docs_.back() != doc_id) {
-            docs_.push_back(doc_id);
+        detach_();
+        const uint32_t key = (uint32_t)doc_id >> 16;
+        const uint16_t low = (uint16_t)(doc_id & 0xFFFF);
+
+        if (containers_.empty() || containers_.back().key != key) {
+            Container c;
+            c.key = key;
+            c.offset = (uint32_t)shorts_.size();
+            containers_.push_back(c);
+        }
+        Container& c = containers_.back();
+        if (c.kind == Kind::Run) toBitmapInPlace_(c);
+
+        if (c.kind == Kind::Array) {
+            if (c.card && shorts_[c.offset + c.length - 1] == low) return;
+            shorts_.push_back(low);
+            ++c.card;
+            ++c.length;
+            if (c.card > kArrayMax) toBitmapInPlace_(c);
+        } else {
+            uint64_t& w = words_[c.offset + (low >> 6)];
+            const uint64_t bit = uint64_t{1} << (low & 63);
+            if (w & bit) return;
+            w |= bit;
+            ++c.card;
         }
+        ++size_;
     }
 
-    const std::vector<int>& docs() const { return docs_; }
-    bool empty() const { return docs_.empty(); }
-    size_t size() const { return docs_.size(); }
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+    bool isView() const { return view_; }
+    std::pmr::memory_resource* resource() const { return containers_.get_allocator().resource(); }
+    std::span<const Container> containers() const { return dir_(); }
 
-    // AND
-    static PostingList And(const PostingList& a, const PostingList& b) {
-        PostingList out;
-        const auto& A = a.docs_;
-        const auto& B = b.docs_;
-        out.docs_.reserve(std::min(A.size(), B.size()));
+    bool contains(int doc_id) const {
+        const uint32_t key = (uint32_t)doc_id >> 16;
+        const auto dir = dir_();
+        auto it = std::lower_bound(dir.begin(), dir.end(), key,
+                                   [](const Container& c, uint32_t k) { return c.key < k; });
+        if (it == dir.end() || it->key != key) return false;
+        return ref_(*it).contains((uint16_t)(doc_id & 0xFFFF));
+    }
 
-        size_t i = 0, j = 0;
-        while (i < A.size() && j < B.size()) {
-            if (A[i] == B[j]) { out.docs_.push_back(A[i]); ++i; ++j; }
-            else if (A[i] < B[j]) ++i;
-            else ++j;
+    // Calls fn(doc_id) in increasing order while it returns true.
+    template <typename Fn>
+    bool forEach(Fn&& fn) const {
+        for (const Container& c : dir_()) {
+            const int base = (int)(c.key << 16);
+            const Ref r = ref_(c);
+            if (c.kind == Kind::Array) {
+                for (uint32_t i = 0; i < c.card; ++i) {
+                    if (!fn(base | r.s[i])) return false;
+                }
+            } else if (c.kind == Kind::Bitmap) {
+                for (uint32_t wi = 0; wi < kBitmapWords; ++wi) {
+                    uint64_t w = r.w[wi];
+                    while (w) {
+                        int bit = std::countr_zero(w);
+                        if (!fn(base | (int)(wi * 64 + bit))) return false;
+                        w &= w - 1;
+                    }
+                }
+            } else {
+                for (uint32_t i = 0; i < r.len; i += 2) {
+                    const int start = base | r.s[i];
+                    const int end = start + r.s[i + 1];
+                    for (int d = start; d <= end; ++d) {
+                        if (!fn(d)) return false;
+                    }
+                }
+            }
         }
+        return true;
+    }
+
+    std::vector<int> toVector() const {
+        std::vector<int> out;
+        out.reserve(size_);
+        forEach([&](int d) { out.push_back(d); return true; });
         return out;
     }
 
-    // OR
-    static PostingList Or(const PostingList& a, const PostingList& b) {
+    // Re-encodes every chunk in its smallest form (array, bitmap or runs) and
+    // releases slack capacity. Called once a list is complete.
+    void optimize() {
         PostingList out;
-        const auto& A = a.docs_;
-        const auto& B = b.docs_;
-        out.docs_.reserve(A.size() + B.size());
+        out.containers_.reserve(dir_().size());
+        for (const Container& c : dir_()) {
+            const Ref r = ref_(c);
+            const uint32_t runs = countRuns_(r);
+            const size_t array_bytes = (size_t)c.card * 2;
+            const size_t bitmap_bytes = (size_t)kBitmapWords * 8;
+            const size_t run_bytes = (size_t)runs * 4;
+
+            if (run_bytes < array_bytes && run_bytes < bitmap_bytes) out.pushRuns_(c.key, r, runs);
+            else if (array_bytes <= bitmap_bytes) out.pushArrayFrom_(c.key, r);
+            else out.pushCopy_(c.key, r);
+        }
+        out.containers_.shrink_to_fit();
+        out.shorts_.shrink_to_fit();
+        out.words_.shrink_to_fit();
+        *this = std::move(out);
+    }
+
+    // heap bytes owned by this list (0 for views)
+    size_t memoryBytes() const {
+        return containers_.capacity() * sizeof(Container)
+             + shorts_.capacity() * sizeof(uint16_t)
+             + words_.capacity() * sizeof(uint64_t);
+    }
+
+    // the part of memoryBytes() holding containers and payload
+    size_t usedBytes() const {
+        return containers_.size() * sizeof(Container)
+             + shorts_.size() * sizeof(uint16_t)
+             + words_.size() * sizeof(uint64_t);
+    }
 
+    // Copies the containers to the end of shared pools with offsets rebased
+    // onto them, so a view() over the pools reads the same set.
+    void appendTo(std::vector<Container>& dir, std::vector<uint16_t>& shorts,
+                  std::vector<uint64_t>& words) const {
+        for (const Container& c : dir_()) {
+            Container out = c;
+            const Ref r = ref_(c);
+            if (c.kind == Kind::Bitmap) {
+                out.offset = (uint32_t)words.size();
+                words.insert(words.end(), r.w, r.w + kBitmapWords);
+            } else {
+                out.offset = (uint32_t)shorts.size();
+                shorts.insert(shorts.end(), r.s, r.s + c.length);
+            }
+            dir.push_back(out);
+        }
+    }
+
+    // docs in [lo, hi); whole containers are copied, edge containers masked
+    PostingList slice(int lo, int hi, std::pmr::memory_resource* mr = nullptr) const {
+        PostingList out(mr);
+        if (lo >= hi) return out;
+        const uint32_t klo = (uint32_t)lo >> 16;
+        const uint32_t khi = (uint32_t)(hi - 1) >> 16;
+        const auto dir = dir_();
+        auto it = std::lower_bound(dir.begin(), dir.end(), klo,
+                                   [](const Container& c, uint32_t k) { return c.key < k; });
+        for (; it != dir.end() && it->key <= khi; ++it) {
+            const uint32_t from = (it->key == klo) ? (uint32_t)(lo & 0xFFFF) : 0;
+            const uint32_t to = (it->key == khi) ? (uint32_t)((hi - 1) & 0xFFFF) : 0xFFFF;
+            const Ref r = ref_(*it);
+            if (from == 0 && to == 0xFFFF) {
+                out.pushCopy_(it->key, r);
+            } else if (it->kind == Kind::Array) {
+                const uint16_t* b = std::lower_bound(r.s, r.s + r.card, (uint16_t)from);
+                const uint16_t* e = std::upper_bound(b, r.s + r.card, (uint16_t)to);
+                out.pushArray_(it->key, b, (uint32_t)(e - b));
+            } else {
+                uint64_t bm[kBitmapWords];
+                toBitmap_(r, bm);
+                uint64_t mask[kBitmapWords] = {};
+                setRange_(mask, from, to);
+                out.pushBitmapAnd_(it->key, bm, mask);
+            }
+        }
+        return out;
+    }
+
+    // tail must only hold ids greater than any id in this list
+    void appendSorted(const PostingList& tail) {
+        detach_();
+        for (const Container& c : tail.dir_()) {
+            const Ref r = tail.ref_(c);
+            if (!containers_.empty() && containers_.back().key == c.key) {
+                // partitions split mid-chunk: merge the two halves
+                PostingList last(resource());
+                last.pushCopy_(c.key, ref_(containers_.back()));
+                popBack_();
+                uint64_t a[kBitmapWords], b[kBitmapWords];
+                toBitmap_(last.ref_(last.containers_[0]), a);
+                toBitmap_(r, b);
+                for (uint32_t i = 0; i < kBitmapWords; ++i) a[i] |= b[i];
+                pushBitmap_(c.key, a, last.size_ + c.card);
+            } else {
+                pushCopy_(c.key, r);
+            }
+        }
+    }
+
+    // Set operations take an optional deadline; if it passes they return
+    // early with *cutoff set to the first doc id left unprocessed. The result
+    // is allocated from `mr`, the heap if null.
+
+    // AND
+    static PostingList And(const PostingList& a, const PostingList& b, const Deadline* dl = nullptr,
+                           int* cutoff = nullptr, std::pmr::memory_resource* mr = nullptr) {
+        PostingList out(mr);
+        const auto da = a.dir_(), db = b.dir_();
         size_t i = 0, j = 0;
-        while (i < A.size() && j < B.size()) {
-            if (A[i] == B[j]) { out.docs_.push_back(A[i]); ++i; ++j; }
-            else if (A[i] < B[j]) { out.docs_.push_back(A[i]); ++i; }
-            else { out.docs_.push_back(B[j]); ++j; }
+        while (i < da.size() && j < db.size()) {
+            const Container& x = da[i];
+            const Container& y = db[j];
+            if (stop_(dl, cutoff, std::min(x.key, y.key))) break;
+            if (x.key < y.key) { ++i; continue; }
+            if (y.key < x.key) { ++j; continue; }
+            out.andContainers_(x.key, a.ref_(x), b.ref_(y));
+            ++i; ++j;
         }
-        while (i < A.size()) out.docs_.push_back(A[i++]);
-        while (j < B.size()) out.docs_.push_back(B[j++]);
         return out;
     }
 
-    // NOT
-    static PostingList Not(const PostingList& universe, const PostingList& a) {
-        PostingList out;
-        const auto& U = universe.docs_;
-        const auto& A = a.docs_;
-        out.docs_.reserve(U.size());
+    // |a AND b| without building the intersection
+    static uint64_t AndCount(const PostingList& a, const PostingList& b) {
+        uint64_t n = 0;
+        const auto da = a.dir_(), db = b.dir_();
+        size_t i = 0, j = 0;
+        while (i < da.size() && j < db.size()) {
+            if (da[i].key < db[j].key) { ++i; continue; }
+            if (db[j].key < da[i].key) { ++j; continue; }
+            n += andCount_(a.ref_(da[i]), b.ref_(db[j]));
+            ++i; ++j;
+        }
+        return n;
+    }
 
+    // OR
+    static PostingList Or(const PostingList& a, const PostingList& b, const Deadline* dl = nullptr,
+                          int* cutoff = nullptr, std::pmr::memory_resource* mr = nullptr) {
+        PostingList out(mr);
+        const auto da = a.dir_(), db = b.dir_();
         size_t i = 0, j = 0;
-        while (i < U.size() && j < A.size()) {
-            if (U[i] == A[j]) { ++i; ++j; }
-            else if (U[i] < A[j]) { out.docs_.push_back(U[i]); ++i; }
-            else { ++j; }
+        while (i < da.size() || j < db.size()) {
+            const uint32_t next = (j == db.size()) ? da[i].key
+                                : (i == da.size()) ? db[j].key : std::min(da[i].key, db[j].key);
+            if (stop_(dl, cutoff, next)) break;
+            if (j == db.size() || (i < da.size() && da[i].key < db[j].key)) {
+                out.pushCopy_(da[i].key, a.ref_(da[i]));
+                ++i;
+            } else if (i == da.size() || db[j].key < da[i].key) {
+                out.pushCopy_(db[j].key, b.ref_(db[j]));
+                ++j;
+            } else {
+                out.orContainers_(da[i].key, a.ref_(da[i]), b.ref_(db[j]));
+                ++i; ++j;
+            }
+        }
+        return out;
+    }
+
+    // a minus b
+    static PostingList AndNot(const PostingList& a, const PostingList& b, const Deadline* dl = nullptr,
+                              int* cutoff = nullptr, std::pmr::memory_resource* mr = nullptr) {
+        PostingList out(mr);
+        const auto db = b.dir_();
+        size_t j = 0;
+        for (const Container& x : a.dir_()) {
+            if (stop_(dl, cutoff, x.key)) break;
+            while (j < db.size() && db[j].key < x.key) ++j;
+            if (j < db.size() && db[j].key == x.key) {
+                out.andNotContainers_(x.key, a.ref_(x), b.ref_(db[j]));
+            } else {
+                out.pushCopy_(x.key, a.ref_(x));
+            }
+        }
+        return out;
+    }
+
+    // Intersection of any number of lists. The smallest drives: only its
+    // chunks are visited, each probed in the others in increasing size order
+    // and dropped at the first miss; a chunk's survivors are narrowed as an
+    // array, or as a bitmap while every container so far is dense.
+    static PostingList AndMany(std::span<const PostingList* const> lists, const Deadline* dl = nullptr,
+                               int* cutoff = nullptr, std::pmr::memory_resource* mr = nullptr) {
+        if (lists.size() == 2) return And(*lists[0], *lists[1], dl, cutoff, mr);
+        PostingList out(mr);
+        if (lists.empty()) return out;
+        ArenaVector<const PostingList*> by_size(lists.begin(), lists.end(), mr);
+        std::stable_sort(by_size.begin(), by_size.end(),
+                         [](const PostingList* a, const PostingList* b) { return a->size() < b->size(); });
+        ArenaVector<size_t> at(by_size.size(), 0, mr);   // directory position per list, only moves forward
+
+        uint16_t arr[kArrayMax];
+        uint64_t bm[kBitmapWords], tmp[kBitmapWords];
+        for (const Container& x : by_size[0]->dir_()) {
+            if (stop_(dl, cutoff, x.key)) break;
+            bool all = true;
+            for (size_t j = 1; j < by_size.size() && all; ++j) {
+                const auto dir = by_size[j]->dir_();
+                at[j] = (size_t)(std::lower_bound(dir.begin() + (std::ptrdiff_t)at[j], dir.end(), x.key,
+                                                  [](const Container& c, uint32_t k) { return c.key < k; }) -
+                                 dir.begin());
+                if (at[j] == dir.size()) return out;   // no later chunk can match either
+                all = dir[at[j]].key == x.key;
+            }
+            if (!all) continue;
+
+            const Ref r0 = by_size[0]->ref_(x);
+            bool dense = r0.kind != Kind::Array;
+            uint32_t n = 0;
+            if (dense) toBitmap_(r0, bm);
+            else n = (uint32_t)(std::copy(r0.s, r0.s + r0.card, arr) - arr);
+            for (size_t j = 1; j < by_size.size() && (dense || n); ++j) {
+                const Ref y = by_size[j]->ref_(by_size[j]->dir_()[at[j]]);
+                if (isFull_(y)) continue;
+                if (!dense) {
+                    n = narrowArray_(arr, n, y);
+                } else if (y.kind == Kind::Array) {
+                    // the survivors become the (smaller) array side
+                    for (uint32_t i = 0; i < y.card; ++i) {
+                        if ((bm[y.s[i] >> 6] >> (y.s[i] & 63)) & 1) arr[n++] = y.s[i];
+                    }
+                    dense = false;
+                } else {
+                    const uint64_t* w = y.w;
+                    if (y.kind == Kind::Run) {
+                        toBitmap_(y, tmp);
+                        w = tmp;
+                    }
+                    for (uint32_t i = 0; i < kBitmapWords; ++i) bm[i] &= w[i];
+                }
+            }
+            if (!dense) {
+                out.pushArray_(x.key, arr, n);
+            } else {
+                uint32_t card = 0;
+                for (uint32_t i = 0; i < kBitmapWords; ++i) card += (uint32_t)std::popcount(bm[i]);
+                out.pushBitmap_(x.key, bm, card);
+            }
+        }
+        return out;
+    }
+
+    // Union of any number of lists in one pass: a heap over the lists' next
+    // chunk keys visits each chunk once. A chunk in a single list is copied;
+    // sparse ones (arrays, at most kArrayMax ids in total) are merged k ways
+    // through a heap; denser ones are OR-ed into one bitmap.
+    static PostingList OrMany(std::span<const PostingList* const> lists, const Deadline* dl = nullptr,
+                              int* cutoff = nullptr, std::pmr::memory_resource* mr = nullptr) {
+        if (lists.size() == 2) return Or(*lists[0], *lists[1], dl, cutoff, mr);
+        PostingList out(mr);
+        struct Next {
+            uint32_t key;
+            uint32_t list;
+        };
+        auto later = [](const Next& a, const Next& b) { return a.key > b.key || (a.key == b.key && a.list > b.list); };
+        ArenaVector<Next> heap(mr);
+        ArenaVector<size_t> at(lists.size(), 0, mr);
+        ArenaVector<Ref> chunk(mr);
+        ArenaVector<Head> merge(mr);
+        heap.reserve(lists.size());
+        for (uint32_t i = 0; i < lists.size(); ++i) {
+            if (!lists[i]->dir_().empty()) heap.push_back({lists[i]->dir_()[0].key, i});
+        }
+        std::make_heap(heap.begin(), heap.end(), later);
+
+        while (!heap.empty()) {
+            const uint32_t key = heap.front().key;
+            if (stop_(dl, cutoff, key)) break;
+            chunk.clear();
+            while (!heap.empty() && heap.front().key == key) {
+                std::pop_heap(heap.begin(), heap.end(), later);
+                const uint32_t l = heap.back().list;
+                const auto dir = lists[l]->dir_();
+                chunk.push_back(lists[l]->ref_(dir[at[l]]));
+                if (++at[l] < dir.size()) {
+                    heap.back().key = dir[at[l]].key;
+                    std::push_heap(heap.begin(), heap.end(), later);
+                } else {
+                    heap.pop_back();
+                }
+            }
+            out.unionChunk_(key, chunk, merge);
         }
-        while (i < U.size()) out.docs_.push_back(U[i++]);
         return out;
     }
 
+    // NOT: the universe is stored as full runs, so this flips a's chunks
+    // word by word instead of merging against a list of every doc id.
+    static PostingList Not(const PostingList& universe, const PostingList& a, const Deadline* dl = nullptr,
+                           int* cutoff = nullptr, std::pmr::memory_resource* mr = nullptr) {
+        return AndNot(universe, a, dl, cutoff, mr);
+    }
+
 private:
-    std::vector<int> docs_;
+    ArenaVector<Container> containers_;
+    ArenaVector<uint16_t> shorts_;
+    ArenaVector<uint64_t> words_;
+    size_t size_ = 0;
+
+    // set for views: containers and payload live elsewhere
+    bool view_ = false;
+    std::span<const Container> view_dir_;
+    const uint16_t* view_shorts_ = nullptr;
+    const uint64_t* view_words_ = nullptr;
+
+    std::span<const Container> dir_() const {
+        return view_ ? view_dir_ : std::span<const Container>(containers_);
+    }
+    const uint16_t* shortsBase_() const { return view_ ? view_shorts_ : shorts_.data(); }
+    const uint64_t* wordsBase_() const { return view_ ? view_words_ : words_.data(); }
+
+    static bool stop_(const Deadline* dl, int* cutoff, uint32_t key) {
+        if (!dl || !dl->expired()) return false;
+        if (cutoff) *cutoff = (int)(key << 16);
+        return true;
+    }
+
+    void detach_() {
+        if (!view_) return;
+        PostingList owned;
+        for (const Container& c : view_dir_) owned.pushCopy_(c.key, ref_(c));
+        *this = std::move(owned);
+    }
+
+    // read-only view of one container's payload
+    struct Ref {
+        Kind kind;
+        uint32_t card;
+        uint32_t len;
+        const uint16_t* s;
+        const uint64_t* w;
+
+        bool contains(uint16_t low) const {
+            if (kind == Kind::Array) return std::binary_search(s, s + card, low);
+            if (kind == Kind::Bitmap) return (w[low >> 6] >> (low & 63)) & 1;
+            for (uint32_t i = 0; i < len; i += 2) {
+                if (low < s[i]) return false;
+                if (low <= (uint32_t)s[i] + s[i + 1]) return true;
+            }
+            return false;
+        }
+    };
+
+    Ref ref_(const Container& c) const {
+        Ref r{c.kind, c.card, c.length, nullptr, nullptr};
+        if (c.kind == Kind::Bitmap) r.w = wordsBase_() + c.offset;
+        else r.s = shortsBase_() + c.offset;
+        return r;
+    }
+
+    int back_() const {
+        const Container& c = containers_.back();
+        const Ref r = ref_(c);
+        int low = 0;
+        if (c.kind == Kind::Array) low = r.s[c.card - 1];
+        else if (c.kind == Kind::Run) low = r.s[r.len - 2] + r.s[r.len - 1];
+        else {
+            for (int wi = (int)kBitmapWords - 1; wi >= 0; --wi) {
+                if (r.w[wi]) { low = wi * 64 + 63 - std::countl_zero(r.w[wi]); break; }
+            }
+        }
+        return (int)(c.key << 16) | low;
+    }
+
+    // The last container's payload is always at the end of its pool.
+    void popBack_() {
+        const Container& c = containers_.back();
+        if (c.kind == Kind::Bitmap) words_.resize(c.offset);
+        else shorts_.resize(c.offset);
+        size_ -= c.card;
+        containers_.pop_back();
+    }
+
+    void toBitmapInPlace_(Container& c) {
+        uint64_t bm[kBitmapWords];
+        toBitmap_(ref_(c), bm);
+        shorts_.resize(c.offset);
+        c.kind = Kind::Bitmap;
+        c.offset = (uint32_t)words_.size();
+        c.length = kBitmapWords;
+        words_.insert(words_.end(), bm, bm + kBitmapWords);
+    }
+
+    static void setRange_(uint64_t* bm, uint32_t from, uint32_t to) { // inclusive
+        const uint32_t wf = from >> 6, wt = to >> 6;
+        const uint64_t first = ~uint64_t{0} << (from & 63);
+        const uint64_t last = ~uint64_t{0} >> (63 - (to & 63));
+        if (wf == wt) { bm[wf] |= first & last; return; }
+        bm[wf] |= first;
+        for (uint32_t i = wf + 1; i < wt; ++i) bm[i] = ~uint64_t{0};
+        bm[wt] |= last;
+    }
+
+    static void toBitmap_(const Ref& r, uint64_t* bm) {
+        if (r.kind == Kind::Bitmap) {
+            std::copy(r.w, r.w + kBitmapWords, bm);
+            return;
+        }
+        std::fill(bm, bm + kBitmapWords, uint64_t{0});
+        if (r.kind == Kind::Array) {
+            for (uint32_t i = 0; i < r.card; ++i) bm[r.s[i] >> 6] |= uint64_t{1} << (r.s[i] & 63);
+        } else {
+            for (uint32_t i = 0; i < r.len; i += 2) setRange_(bm, r.s[i], (uint32_t)r.s[i] + r.s[i + 1]);
+        }
+    }
+
+    static uint32_t countRuns_(const Ref& r) {
+        if (r.kind == Kind::Run) return r.len / 2;
+        if (r.kind == Kind::Array) {
+            uint32_t runs = r.card ? 1 : 0;
+            for (uint32_t i = 1; i < r.card; ++i) runs += (r.s[i] != r.s[i - 1] + 1);
+            return runs;
+        }
+        uint32_t runs = 0;
+        uint64_t carry = 0; // top bit of the previous word
+        for (uint32_t i = 0; i < kBitmapWords; ++i) {
+            const uint64_t w = r.w[i];
+            runs += (uint32_t)std::popcount(w & ~((w << 1) | carry));
+            carry = w >> 63;
+        }
+        return runs;
+    }
+
+    // --- output builders (append a container for `key`) ---
+
+    void pushArray_(uint32_t key, const uint16_t* lows, uint32_t n) {
+        if (n == 0) return;
+        Container c;
+        c.key = key;
+        c.kind = Kind::Array;
+        c.card = n;
+        c.offset = (uint32_t)shorts_.size();
+        c.length = n;
+        shorts_.insert(shorts_.end(), lows, lows + n);
+        containers_.push_back(c);
+        size_ += n;
+    }
+
+    // stores a bitmap result, as an array when that is smaller
+    void pushBitmap_(uint32_t key, const uint64_t* bm, uint32_t card) {
+        if (card == 0) return;
+        Container c;
+        c.key = key;
+        c.card = card;
+        if (card <= kArrayMax) {
+            c.kind = Kind::Array;
+            c.offset = (uint32_t)shorts_.size();
+            c.length = card;
+            for (uint32_t wi = 0; wi < kBitmapWords; ++wi) {
+                uint64_t w = bm[wi];
+                while (w) {
+                    shorts_.push_back((uint16_t)(wi * 64 + std::countr_zero(w)));
+                    w &= w - 1;
+                }
+            }
+        } else {
+            c.kind = Kind::Bitmap;
+            c.offset = (uint32_t)words_.size();
+            c.length = kBitmapWords;
+            words_.insert(words_.end(), bm, bm + kBitmapWords);
+        }
+        containers_.push_back(c);
+        size_ += card;
+    }
+
+    void pushBitmapAnd_(uint32_t key, uint64_t* a, const uint64_t* b) {
+        uint32_t card = 0;
+        for (uint32_t i = 0; i < kBitmapWords; ++i) {
+            a[i] &= b[i];
+            card += (uint32_t)std::popcount(a[i]);
+        }
+        pushBitmap_(key, a, card);
+    }
+
+    void pushCopy_(uint32_t key, const Ref& r) {
+        if (r.card == 0) return;
+        Container c;
+        c.key = key;
+        c.kind = r.kind;
+        c.card = r.card;
+        c.length = r.len;
+        if (r.kind == Kind::Bitmap) {
+            c.offset = (uint32_t)words_.size();
+            words_.insert(words_.end(), r.w, r.w + kBitmapWords);
+        } else {
+            c.offset = (uint32_t)shorts_.size();
+            shorts_.insert(shorts_.end(), r.s, r.s + r.len);
+        }
+        containers_.push_back(c);
+        size_ += r.card;
+    }
+
+    void pushArrayFrom_(uint32_t key, const Ref& r) {
+        if (r.kind == Kind::Array) { pushCopy_(key, r); return; }
+        Container c;
+        c.key = key;
+        c.kind = Kind::Array;
+        c.card = r.card;
+        c.offset = (uint32_t)shorts_.size();
+        c.length = r.card;
+        PostingList tmp;
+        tmp.pushCopy_(key, r);
+        tmp.forEach([&](int d) { shorts_.push_back((uint16_t)(d & 0xFFFF)); return true; });
+        containers_.push_back(c);
+        size_ += r.card;
+    }
+
+    void pushRuns_(uint32_t key, const Ref& r, uint32_t runs) {
+        if (r.kind == Kind::Run) { pushCopy_(key, r); return; }
+        Container c;
+        c.key = key;
+        c.kind = Kind::Run;
+        c.card = r.card;
+        c.offset = (uint32_t)shorts_.size();
+        c.length = runs * 2;
+        PostingList tmp;
+        tmp.pushCopy_(key, r);
+        int start = -1, prev = -2;
+        tmp.forEach([&](int d) {
+            const int low = d & 0xFFFF;
+            if (low != prev + 1) {
+                if (start >= 0) { shorts_.push_back((uint16_t)start); shorts_.push_back((uint16_t)(prev - start)); }
+                start = low;
+            }
+            prev = low;
+            return true;
+        });
+        if (start >= 0) { shorts_.push_back((uint16_t)start); shorts_.push_back((uint16_t)(prev - start)); }
+        containers_.push_back(c);
+        size_ += r.card;
+    }
+
+    // --- n-ary helpers ---
+
+    // keeps the ids of arr[0, n) that y holds, in place; returns the new count
+    static uint32_t narrowArray_(uint16_t* arr, uint32_t n, const Ref& y) {
+        uint32_t k = 0;
+        if (y.kind != Kind::Array) {
+            for (uint32_t i = 0; i < n; ++i) {
+                if (y.contains(arr[i])) arr[k++] = arr[i];
+            }
+        } else if (y.card > n * 32) {
+            const uint16_t* p = y.s;
+            const uint16_t* end = y.s + y.card;
+            for (uint32_t i = 0; i < n && p < end; ++i) {
+                p = std::lower_bound(p, end, arr[i]);
+                if (p < end && *p == arr[i]) arr[k++] = arr[i];
+            }
+        } else {
+            uint32_t i = 0, j = 0;
+            while (i < n && j < y.card) {
+                if (arr[i] == y.s[j]) { arr[k++] = arr[i]; ++i; ++j; }
+                else if (arr[i] < y.s[j]) ++i;
+                else ++j;
+            }
+        }
+        return k;
+    }
+
+    // merge heap entry: the next id of one array
+    struct Head {
+        uint16_t low;
+        uint32_t ref;
+        uint32_t pos;
+    };
+
+    void unionChunk_(uint32_t key, const ArenaVector<Ref>& refs, ArenaVector<Head>& merge) {
+        if (refs.size() == 1) { pushCopy_(key, refs[0]); return; }
+        uint64_t total = 0;
+        bool arrays = true;
+        for (const Ref& r : refs) {
+            if (isFull_(r)) { pushCopy_(key, r); return; }
+            total += r.card;
+            arrays &= r.kind == Kind::Array;
+        }
+        if (arrays && total <= kArrayMax) {
+            auto later = [](const Head& a, const Head& b) { return a.low > b.low; };
+            merge.clear();
+            for (uint32_t i = 0; i < refs.size(); ++i) merge.push_back({refs[i].s[0], i, 0});
+            std::make_heap(merge.begin(), merge.end(), later);
+            uint16_t tmp[kArrayMax];
+            uint32_t n = 0;
+            while (!merge.empty()) {
+                std::pop_heap(merge.begin(), merge.end(), later);
+                Head& h = merge.back();
+                if (n == 0 || tmp[n - 1] != h.low) tmp[n++] = h.low;
+                const Ref& r = refs[h.ref];
+                if (++h.pos < r.card) {
+                    h.low = r.s[h.pos];
+                    std::push_heap(merge.begin(), merge.end(), later);
+                } else {
+                    merge.pop_back();
+                }
+            }
+            pushArray_(key, tmp, n);
+            return;
+        }
+        uint64_t acc[kBitmapWords] = {};
+        for (const Ref& r : refs) {
+            if (r.kind == Kind::Array) {
+                for (uint32_t i = 0; i < r.card; ++i) acc[r.s[i] >> 6] |= uint64_t{1} << (r.s[i] & 63);
+            } else if (r.kind == Kind::Bitmap) {
+                for (uint32_t i = 0; i < kBitmapWords; ++i) acc[i] |= r.w[i];
+            } else {
+                for (uint32_t i = 0; i < r.len; i += 2) setRange_(acc, r.s[i], (uint32_t)r.s[i] + r.s[i + 1]);
+            }
+        }
+        uint32_t card = 0;
+        for (uint32_t i = 0; i < kBitmapWords; ++i) card += (uint32_t)std::popcount(acc[i]);
+        pushBitmap_(key, acc, card);
+    }
+
+    // --- container-pair operations ---
+
+    static bool isFull_(const Ref& r) { return r.card == 65536; }
+
+    void andContainers_(uint32_t key, const Ref& x, const Ref& y) {
+        if (isFull_(x)) { pushCopy_(key, y); return; }
+        if (isFull_(y)) { pushCopy_(key, x); return; }
+
+        if (x.kind == Kind::Array || y.kind == Kind::Array) {
+            const Ref& arr = (x.kind == Kind::Array) ? x : y;
+            const Ref& other = (x.kind == Kind::Array) ? y : x;
+            uint16_t tmp[kArrayMax];
+            uint32_t n = 0;
+            if (other.kind == Kind::Array) {
+                // merge, galloping through the longer side when sizes are skewed
+                const Ref& sm = (arr.card <= other.card) ? arr : other;
+                const Ref& lg = (arr.card <= other.card) ? other : arr;
+                if (lg.card > sm.card * 32) {
+                    const uint16_t* p = lg.s;
+                    const uint16_t* end = lg.s + lg.card;
+                    for (uint32_t i = 0; i < sm.card && p < end; ++i) {
+                        p = std::lower_bound(p, end, sm.s[i]);
+                        if (p < end && *p == sm.s[i]) tmp[n++] = sm.s[i];
+                    }
+                } else {
+                    uint32_t i = 0, j = 0;
+                    while (i < sm.card && j < lg.card) {
+                        if (sm.s[i] == lg.s[j]) { tmp[n++] = sm.s[i]; ++i; ++j; }
+                        else if (sm.s[i] < lg.s[j]) ++i;
+                        else ++j;
+                    }
+                }
+            } else {
+                for (uint32_t i = 0; i < arr.card; ++i) {
+                    if (other.contains(arr.s[i])) tmp[n++] = arr.s[i];
+                }
+            }
+            pushArray_(key, tmp, n);
+            return;
+        }
+
+        uint64_t a[kBitmapWords], b[kBitmapWords];
+        toBitmap_(x, a);
+        toBitmap_(y, b);
+        pushBitmapAnd_(key, a, b);
+    }
+
+    // bits set in [from, to] (inclusive)
+    static uint32_t countRange_(const uint64_t* bm, uint32_t from, uint32_t to) {
+        const uint32_t wf = from >> 6, wt = to >> 6;
+        const uint64_t first = ~uint64_t{0} << (from & 63);
+        const uint64_t last = ~uint64_t{0} >> (63 - (to & 63));
+        if (wf == wt) return (uint32_t)std::popcount(bm[wf] & first & last);
+        uint32_t n = (uint32_t)std::popcount(bm[wf] & first) + (uint32_t)std::popcount(bm[wt] & last);
+        for (uint32_t i = wf + 1; i < wt; ++i) n += (uint32_t)std::popcount(bm[i]);
+        return n;
+    }
+
+    static uint32_t andCount_(const Ref& x, const Ref& y) {
+        if (isFull_(x)) return y.card;
+        if (isFull_(y)) return x.card;
+
+        if (x.kind == Kind::Array || y.kind == Kind::Array) {
+            const Ref& arr = (x.kind == Kind::Array) ? x : y;
+            const Ref& other = (x.kind == Kind::Array) ? y : x;
+            uint32_t n = 0;
+            if (other.kind == Kind::Array) {
+                const Ref& sm = (arr.card <= other.card) ? arr : other;
+                const Ref& lg = (arr.card <= other.card) ? other : arr;
+                if (lg.card > sm.card * 32) {
+                    const uint16_t* p = lg.s;
+                    const uint16_t* end = lg.s + lg.card;
+                    for (uint32_t i = 0; i < sm.card && p < end; ++i) {
+                        p = std::lower_bound(p, end, sm.s[i]);
+                        n += (p < end && *p == sm.s[i]);
+                    }
+                } else {
+                    uint32_t i = 0, j = 0;
+                    while (i < sm.card && j < lg.card) {
+                        const uint16_t u = sm.s[i], v = lg.s[j];
+                        n += (u == v);
+                        i += (u <= v);
+                        j += (v <= u);
+                    }
+                }
+            } else {
+                for (uint32_t i = 0; i < arr.card; ++i) n += other.contains(arr.s[i]);
+            }
+            return n;
+        }
+
+        if (x.kind == Kind::Bitmap && y.kind == Kind::Bitmap) {
+            uint32_t n = 0;
+            for (uint32_t i = 0; i < kBitmapWords; ++i) n += (uint32_t)std::popcount(x.w[i] & y.w[i]);
+            return n;
+        }
+
+        // runs against a bitmap: count the bits under each run
+        if (x.kind != y.kind) {
+            const Ref& runs = (x.kind == Kind::Run) ? x : y;
+            const Ref& bm = (x.kind == Kind::Run) ? y : x;
+            uint32_t n = 0;
+            for (uint32_t i = 0; i < runs.len; i += 2) {
+                n += countRange_(bm.w, runs.s[i], (uint32_t)runs.s[i] + runs.s[i + 1]);
+            }
+            return n;
+        }
+
+        // runs against runs: sum of overlaps
+        uint32_t n = 0, i = 0, j = 0;
+        while (i < x.len && j < y.len) {
+            const uint32_t xs = x.s[i], xe = xs + x.s[i + 1];
+            const uint32_t ys = y.s[j], ye = ys + y.s[j + 1];
+            const uint32_t lo = std::max(xs, ys), hi = std::min(xe, ye);
+            if (lo <= hi) n += hi - lo + 1;
+            if (xe < ye) i += 2;
+            else j += 2;
+        }
+        return n;
+    }
+
+    void orContainers_(uint32_t key, const Ref& x, const Ref& y) {
+        if (isFull_(x)) { pushCopy_(key, x); return; }
+        if (isFull_(y)) { pushCopy_(key, y); return; }
+
+        if (x.kind == Kind::Array && y.kind == Kind::Array && x.card + y.card <= kArrayMax) {
+            uint16_t tmp[kArrayMax];
+            uint16_t* e = std::set_union(x.s, x.s + x.card, y.s, y.s + y.card, tmp);
+            pushArray_(key, tmp, (uint32_t)(e - tmp));
+            return;
+        }
+
+        uint64_t a[kBitmapWords];
+        toBitmap_(x, a);
+        if (y.kind == Kind::Array) {
+            for (uint32_t i = 0; i < y.card; ++i) a[y.s[i] >> 6] |= uint64_t{1} << (y.s[i] & 63);
+        } else {
+            uint64_t b[kBitmapWords];
+            toBitmap_(y, b);
+            for (uint32_t i = 0; i < kBitmapWords; ++i) a[i] |= b[i];
+        }
+        uint32_t card = 0;
+        for (uint32_t i = 0; i < kBitmapWords; ++i) card += (uint32_t)std::popcount(a[i]);
+        pushBitmap_(key, a, card);
+    }
+
+    void andNotContainers_(uint32_t key, const Ref& x, const Ref& y) {
+        if (isFull_(y)) return;
+
+        if (x.kind == Kind::Array) {
+            uint16_t tmp[kArrayMax];
+            uint32_t n = 0;
+            if (y.kind == Kind::Array) {
+                uint16_t* e = std::set_difference(x.s, x.s + x.card, y.s, y.s + y.card, tmp);
+                n = (uint32_t)(e - tmp);
+            } else {
+                for (uint32_t i = 0; i < x.card; ++i) {
+                    if (!y.contains(x.s[i])) tmp[n++] = x.s[i];
+                }
+            }
+            pushArray_(key, tmp, n);
+            return;
+        }
+
+        // bitmap or runs on the left: flip y's bits out of x
+        uint64_t a[kBitmapWords];
+        toBitmap_(x, a);
+        uint32_t card = x.card;
+        if (y.kind == Kind::Array) {
+            for (uint32_t i = 0; i < y.card; ++i) {
+                uint64_t& w = a[y.s[i] >> 6];
+                const uint64_t bit = uint64_t{1} << (y.s[i] & 63);
+                card -= (w & bit) ? 1 : 0;
+                w &= ~bit;
+            }
+        } else {
+            uint64_t b[kBitmapWords];
+            toBitmap_(y, b);
+            card = 0;
+            for (uint32_t i = 0; i < kBitmapWords; ++i) {
+                a[i] &= ~b[i];
+                card += (uint32_t)std::popcount(a[i]);
+            }
+        }
+        pushBitmap_(key, a, card);
+    }
 };
@@ -0,0 +1,61 @@
+#include "query_arena.hpp"
+#include <algorithm>
+#include <memory>
+#include <optional>
+
+namespace {
+
+// Upstream of the arena: the heap, counting what the block did not hold.
+class Overflow : public std::pmr::memory_resource {
+public:
+    size_t bytes = 0;
+
+private:
+    void* do_allocate(size_t n, size_t align) override {
+        bytes += n;
+        return std::pmr::new_delete_resource()->allocate(n, align);
+    }
+    void do_deallocate(void* p, size_t n, size_t align) override {
+        std::pmr::new_delete_resource()->deallocate(p, n, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& o) const noexcept override { return this == &o; }
+};
+
+struct ThreadArena {
+    std::unique_ptr<std::byte[]> block;
+    size_t size = 0;
+    size_t wanted = 0;   // block size for the next query
+    Overflow overflow;
+    std::optional<std::pmr::monotonic_buffer_resource> bump;
+};
+
+thread_local ThreadArena t_arena;
+
+} // namespace
+
+QueryArena::Scope::Scope(const ArenaOptions& opt) {
+    if (opt.initial_bytes == 0) return;
+    ThreadArena& a = t_arena;
+    if (a.bump) {
+        mr_ = &*a.bump;
+        return;
+    }
+    const size_t size = std::max(opt.initial_bytes, std::min(a.wanted, opt.max_bytes));
+    if (a.size != size) {
+        a.block.reset();
+        a.block.reset(new std::byte[size]);
+        a.size = size;
+    }
+    a.overflow.bytes = 0;
+    a.bump.emplace(a.block.get(), a.size, &a.overflow);
+    mr_ = &*a.bump;
+    owner_ = true;
+    max_bytes_ = opt.max_bytes;
+}
+
+QueryArena::Scope::~Scope() {
+    if (!owner_) return;
+    ThreadArena& a = t_arena;
+    a.bump.reset();   // returns the overflow chunks to the heap
+    if (a.overflow.bytes && a.size < max_bytes_) a.wanted = a.size + a.overflow.bytes;
+}
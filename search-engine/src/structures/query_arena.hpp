@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+#include <type_traits>
+#include <vector>
+
+// Allocator over a memory_resource (the heap when none is given) whose memory
+// moves with the container: a container moved out of a query arena still
+// points into it, while a copy always goes to the heap. That keeps moves of
+// intermediates free and makes anything copied out of a query outlive it.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    ArenaAllocator() noexcept = default;
+    ArenaAllocator(std::pmr::memory_resource* mr) noexcept : mr_(mr ? mr : std::pmr::new_delete_resource()) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& o) noexcept : mr_(o.resource()) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(mr_->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T* p, size_t n) noexcept { mr_->deallocate(p, n * sizeof(T), alignof(T)); }
+
+    ArenaAllocator select_on_container_copy_construction() const noexcept { return {}; }
+    std::pmr::memory_resource* resource() const noexcept { return mr_; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& o) const noexcept {
+        return mr_ == o.resource() || mr_->is_equal(*o.resource());
+    }
+
+private:
+    std::pmr::memory_resource* mr_ = std::pmr::new_delete_resource();
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+struct ArenaOptions {
+    size_t initial_bytes = 64 << 10;   // first block per thread; 0 = queries allocate from the heap
+    size_t max_bytes = 4 << 20;        // the block grows to the largest query seen, up to this
+};
+
+// Per-thread bump allocator for the scratch data of one query: parser tokens,
+// plan arrays and intermediate posting lists. Nothing is freed while the
+// query runs; everything is dropped at once when its Scope ends. The block is
+// kept by the thread and grown to fit what overflowed it, so a steady stream
+// of queries stops calling malloc for scratch data. Not thread-safe: work
+// handed to other threads must not allocate from it.
+class QueryArena {
+public:
+    class Scope {
+    public:
+        // A scope opened inside another one on the same thread shares it.
+        explicit Scope(const ArenaOptions& opt);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        // nullptr when the arena is off
+        std::pmr::memory_resource* resource() const { return mr_; }
+
+    private:
+        std::pmr::memory_resource* mr_ = nullptr;
+        bool owner_ = false;
+        size_t max_bytes_ = 0;
+    };
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Collapses concurrent calls with the same key into one: the first caller
+// runs fn, later callers arriving before it finishes wait for its result
+// (or exception). Nothing is cached once the call completes.
+template <typename Value>
+class SingleFlight {
+public:
+    using Result = std::shared_ptr<const Value>;
+
+    template <typename Fn>
+    Result run(const std::string& key, Fn&& fn, bool* shared = nullptr) {
+        std::promise<Result> promise;
+        std::shared_future<Result> pending;
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            auto it = calls_.find(key);
+            if (it != calls_.end()) {
+                pending = it->second;
+            } else {
+                calls_.emplace(key, promise.get_future().share());
+            }
+        }
+        if (pending.valid()) {
+            followers_.fetch_add(1, std::memory_order_relaxed);
+            if (shared) *shared = true;
+            return pending.get();
+        }
+
+        leaders_.fetch_add(1, std::memory_order_relaxed);
+        if (shared) *shared = false;
+        Result result;
+        std::exception_ptr error;
+        try {
+            result = std::make_shared<const Value>(fn());
+        } catch (...) {
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            calls_.erase(key);
+        }
+        if (error) {
+            promise.set_exception(error);
+            std::rethrow_exception(error);
+        }
+        promise.set_value(result);
+        return result;
+    }
+
+    uint64_t leaders() const { return leaders_.load(std::memory_order_relaxed); }
+    uint64_t followers() const { return followers_.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex mu_;
+    std::unordered_map<std::string, std::shared_future<Result>> calls_;
+    std::atomic<uint64_t> leaders_{0};
+    std::atomic<uint64_t> followers_{0};
+};
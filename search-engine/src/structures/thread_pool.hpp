@@ -0,0 +1,114 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool shared by the query paths. parallelFor lets the calling
+// thread take part in the work, so it is safe to call from inside a pool task.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads) {
+        if (threads == 0) threads = 1;
+        workers_.reserve(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] { workerLoop_(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : workers_) t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers_.size(); }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            tasks_.push_back(std::move(task));
+        }
+        cv_.notify_one();
+    }
+
+    // Runs fn(i) for every i in [0, n) and returns when all are done.
+    // The first exception thrown by fn is rethrown here.
+    template <typename Fn>
+    void parallelFor(size_t n, Fn&& fn) {
+        if (n == 0) return;
+        if (n == 1) { fn(size_t{0}); return; }
+
+        auto job = std::make_shared<Job_>();
+        job->n = n;
+        job->fn = [&fn](size_t i) { fn(i); };
+
+        const size_t helpers = std::min(n - 1, workers_.size());
+        for (size_t h = 0; h < helpers; ++h) {
+            submit([job] { job->run(); });
+        }
+        job->run();
+
+        std::unique_lock<std::mutex> lk(job->mu);
+        job->cv.wait(lk, [&] { return job->done == job->n; });
+        if (job->error) std::rethrow_exception(job->error);
+    }
+
+private:
+    struct Job_ {
+        size_t n = 0;
+        std::function<void(size_t)> fn;
+        std::atomic<size_t> next{0};
+
+        std::mutex mu;
+        std::condition_variable cv;
+        size_t done = 0;
+        std::exception_ptr error;
+
+        void run() {
+            while (true) {
+                size_t i = next.fetch_add(1, std::memory_order_relaxed);
+                if (i >= n) return;
+                std::exception_ptr err;
+                try { fn(i); } catch (...) { err = std::current_exception(); }
+
+                std::lock_guard<std::mutex> lk(mu);
+                if (err && !error) error = err;
+                if (++done == n) cv.notify_all();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+
+    void workerLoop_() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lk(mu_);
+                cv_.wait(lk, [&] { return stop_ || !tasks_.empty(); });
+                if (stop_ && tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+};
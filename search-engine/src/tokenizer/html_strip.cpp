@@ -1,5 +1,8 @@
 #include "html_strip.hpp"
+#include "utf8.hpp"
+#include <array>
 #include <cctype>
+#include <cstdint>
 #include <string>
 
 static inline bool ieq(char a, char b) {
@@ -44,18 +47,24 @@ void HtmlStripper::decode_entities_inplace(std::string& s) {
         else if (ent == "&#39;") out.push_back('\'');
         else if (ent == "&nbsp;") out.push_back(' ');
         else {
-            if (ent.size() >= 4 && ent[1] == '#' ) {
-                int val = 0;
-                bool ok = true;
-                for (size_t k = 2; k + 1 < ent.size(); ++k) {
-                    if (!std::isdigit(static_cast<unsigned char>(ent[k]))) { ok = false; break; }
-                    val = val * 10 + (ent[k] - '0');
-                    if (val > 0x10FFFF) { ok = false; break; }
+            // numeric references, decimal or hex, are re-encoded as UTF-8
+            if (ent.size() >= 4 && ent[1] == '#') {
+                const bool hex = ent[2] == 'x' || ent[2] == 'X';
+                uint32_t val = 0;
+                bool ok = ent.size() > (hex ? 4u : 3u);
+                for (size_t k = hex ? 3 : 2; ok && k + 1 < ent.size(); ++k) {
+                    const unsigned char d = static_cast<unsigned char>(ent[k]);
+                    if (std::isdigit(d)) val = val * (hex ? 16 : 10) + (d - '0');
+                    else if (hex && std::isxdigit(d)) val = val * 16 + (std::tolower(d) - 'a' + 10);
+                    else ok = false;
+                    if (val > 0x10FFFF) ok = false;
                 }
-                if (ok && val > 0 && val <= 255) out.push_back(static_cast<char>(val));
-                else out.append(ent);
+                if (ok && val > 0 && !(val >= 0xD800 && val <= 0xDFFF)) Utf8::append(out, val);
+                else { out.push_back('&'); continue; }
             } else {
-                out.append(ent);
+                // not an entity: keep the '&' and rescan what follows it
+                out.push_back('&');
+                continue;
             }
         }
         i = semi;
@@ -126,7 +135,7 @@ std::string HtmlStripper::strip(const std::string& html) {
 }
 
 
-std::string HtmlStripper::extract_span_text(const std::string& html) {
+std::string HtmlStripper::extract_span_raw(const std::string& html) {
     std::string out;
     out.reserve(html.size() / 2);
 
@@ -203,13 +212,14 @@ std::string HtmlStripper::extract_span_text(const std::string& html) {
         }
     }
 
-    decode_entities_inplace(out);
+    return out;
+}
 
-    // normalize whitespace
+void HtmlStripper::collapse_whitespace_inplace(std::string& s) {
     std::string norm;
-    norm.reserve(out.size());
+    norm.reserve(s.size());
     bool ws = false;
-    for (char c3 : out) {
+    for (char c3 : s) {
         unsigned char uc = static_cast<unsigned char>(c3);
         if (std::isspace(uc)) {
             if (!ws) norm.push_back(' ');
@@ -221,7 +231,14 @@ std::string HtmlStripper::extract_span_text(const std::string& html) {
     }
     if (!norm.empty() && norm.front() == ' ') norm.erase(norm.begin());
     if (!norm.empty() && norm.back() == ' ') norm.pop_back();
-    return norm;
+    s.swap(norm);
+}
+
+std::string HtmlStripper::extract_span_text(const std::string& html) {
+    std::string out = extract_span_raw(html);
+    decode_entities_inplace(out);
+    collapse_whitespace_inplace(out);
+    return out;
 }
 
 std::string HtmlStripper::normalize_for_phrase(const std::string& text) {
@@ -229,19 +246,211 @@ std::string HtmlStripper::normalize_for_phrase(const std::string& text) {
     out.reserve(text.size());
     bool ws = false;
 
-    for (char ch : text) {
-        unsigned char uc = static_cast<unsigned char>(ch);
-        if (std::isalnum(uc)) {
-            out.push_back(static_cast<char>(std::tolower(uc)));
-            ws = false;
-        } else {
-            if (!ws) out.push_back(' ');
-            ws = true;
-        }
-    }
+    Utf8::scan(text,
+               [&](auto folded) { out += folded; ws = false; },
+               [&] { if (!ws) out.push_back(' '); ws = true; });
 
     // trim/collapse
     if (!out.empty() && out.front() == ' ') out.erase(out.begin());
     if (!out.empty() && out.back() == ' ') out.pop_back();
     return out;
 }
+
+namespace {
+
+enum : uint8_t { kText = 0, kLt = 1, kAmp = 2, kSpace = 3 };
+
+// same set as std::isspace in the "C" locale
+constexpr std::array<uint8_t, 256> kTextClass = [] {
+    std::array<uint8_t, 256> t{};
+    t['<'] = kLt;
+    t['&'] = kAmp;
+    for (char c : {' ', '\t', '\n', '\v', '\f', '\r'}) t[(unsigned char)c] = kSpace;
+    return t;
+}();
+
+// lower-cased ASCII letter or digit, 0 otherwise
+constexpr std::array<char, 256> kTagChar = [] {
+    std::array<char, 256> t{};
+    for (int c = '0'; c <= '9'; ++c) t[c] = (char)c;
+    for (int c = 'a'; c <= 'z'; ++c) t[c] = (char)c;
+    for (int c = 'A'; c <= 'Z'; ++c) t[c] = (char)(c - 'A' + 'a');
+    return t;
+}();
+
+bool starts_with_lower(std::string_view s, size_t pos, std::string_view kw) {
+    if (s.size() - pos < kw.size()) return false;
+    for (size_t i = 0; i < kw.size(); ++i) {
+        const char c = s[pos + i];
+        if (c != kw[i] && kTagChar[(unsigned char)c] != kw[i]) return false;
+    }
+    return true;
+}
+
+// position of the closing tag `kw` (lower case, starting with '<') at or after `from`
+size_t find_close(std::string_view s, size_t from, std::string_view kw) {
+    for (size_t i = s.find('<', from); i != std::string_view::npos; i = s.find('<', i + 1)) {
+        if (starts_with_lower(s, i, kw)) return i;
+    }
+    return std::string_view::npos;
+}
+
+// Collects decoded span text: collapses whitespace into `plain` and folds
+// every finished stretch into `normalized` and the token list.
+class FusedSink {
+public:
+    explicit FusedSink(HtmlStripper::ExtractedText& out) : out_(out) {}
+
+    void put(char c) {
+        if (kTextClass[(unsigned char)c] == kSpace) {
+            pending_space_ = !out_.plain.empty();
+            return;
+        }
+        if (pending_space_) {
+            out_.plain.push_back(' ');
+            pending_space_ = false;
+            normalize_();
+        }
+        out_.plain.push_back(c);
+    }
+
+    void put(std::string_view s) {
+        for (char c : s) put(c);
+    }
+
+    void space() { pending_space_ = !out_.plain.empty(); }
+
+    void finish() {
+        normalize_();
+        endToken_();
+        if (!out_.normalized.empty() && out_.normalized.back() == ' ') out_.normalized.pop_back();
+    }
+
+private:
+    HtmlStripper::ExtractedText& out_;
+    bool pending_space_ = false;
+    size_t norm_pos_ = 0;       // plain[0, norm_pos_) has been normalized
+    size_t token_start_ = 0;
+    bool in_token_ = false;
+
+    // A stretch always ends right after a space, and UTF-8 sequences never
+    // contain one, so no character is split between two stretches.
+    void normalize_() {
+        std::string& norm = out_.normalized;
+        Utf8::scan(std::string_view(out_.plain).substr(norm_pos_),
+                   [&](auto folded) {
+                       if (!in_token_) {
+                           in_token_ = true;
+                           token_start_ = norm.size();
+                       }
+                       norm += folded;
+                   },
+                   [&] {
+                       endToken_();
+                       if (!norm.empty() && norm.back() != ' ') norm.push_back(' ');
+                   });
+        norm_pos_ = out_.plain.size();
+    }
+
+    void endToken_() {
+        if (!in_token_) return;
+        in_token_ = false;
+        out_.tokens.emplace_back(out_.normalized.data() + token_start_, out_.normalized.size() - token_start_);
+    }
+};
+
+// Decodes the entity at s[i] == '&' into `sink`; returns the index after it.
+// Same rules as decode_entities_inplace, on the HTML rather than extracted text.
+size_t put_entity(std::string_view s, size_t i, FusedSink& sink) {
+    size_t semi = std::string_view::npos;
+    for (size_t j = i + 1; j < s.size() && j - i <= 10 && s[j] != '<'; ++j) {
+        if (s[j] == ';') { semi = j; break; }
+    }
+    if (semi == std::string_view::npos) {
+        sink.put('&');
+        return i + 1;
+    }
+    std::string ent(s.substr(i, semi - i + 1));
+    HtmlStripper::decode_entities_inplace(ent);
+    if (ent.size() == semi - i + 1) {   // unknown: emit the '&' and rescan after it
+        sink.put('&');
+        return i + 1;
+    }
+    sink.put(ent);
+    return semi + 1;
+}
+
+} // namespace
+
+void HtmlStripper::extract_fused(const std::string& html, ExtractedText& out) {
+    // every stage only shrinks its input, so these never regrow and the
+    // token views into `normalized` stay valid
+    out.plain.clear();
+    out.normalized.clear();
+    out.tokens.clear();
+    out.plain.reserve(html.size());
+    out.normalized.reserve(html.size());
+
+    const std::string_view s(html);
+    FusedSink sink(out);
+    int span_depth = 0;
+    size_t i = 0;
+
+    while (i < s.size()) {
+        if (s[i] != '<') {
+            if (span_depth == 0) {
+                i = s.find('<', i);
+                if (i == std::string_view::npos) break;
+                continue;
+            }
+            switch (kTextClass[(unsigned char)s[i]]) {
+                case kAmp:   i = put_entity(s, i, sink); break;
+                case kSpace: sink.space(); ++i; break;
+                default:     sink.put(s[i]); ++i; break;
+            }
+            continue;
+        }
+
+        if (starts_with_lower(s, i, "<script")) {
+            const size_t end = find_close(s, i, "</script>");
+            if (end == std::string_view::npos) break;
+            i = end + 9;
+            continue;
+        }
+        if (starts_with_lower(s, i, "<style")) {
+            const size_t end = find_close(s, i, "</style>");
+            if (end == std::string_view::npos) break;
+            i = end + 8;
+            continue;
+        }
+
+        size_t j = i + 1;
+        if (j < s.size() && (s[j] == '!' || s[j] == '?')) {
+            const size_t gt = s.find('>', j);
+            if (gt == std::string_view::npos) break;
+            i = gt + 1;
+            if (span_depth > 0) sink.space();
+            continue;
+        }
+
+        bool closing = false;
+        if (j < s.size() && s[j] == '/') { closing = true; ++j; }
+        while (j < s.size() && kTextClass[(unsigned char)s[j]] == kSpace) ++j;
+
+        size_t name = j;
+        while (j < s.size() && kTagChar[(unsigned char)s[j]]) ++j;
+        if (j - name == 4 && starts_with_lower(s, name, "span")) {
+            if (closing) {
+                if (span_depth > 0) --span_depth;
+            } else {
+                ++span_depth;
+            }
+        }
+
+        const size_t gt = s.find('>', j);
+        if (gt == std::string_view::npos) break;
+        i = gt + 1;
+        if (span_depth > 0) sink.space();
+    }
+    sink.finish();
+}
@@ -1,14 +1,33 @@
 #pragma once
 #include <string>
+#include <string_view>
+#include <vector>
 
 class HtmlStripper {
 public:
+    // Output of extract_fused. Reuse one across documents: its buffers keep
+    // their capacity, so steady-state extraction allocates nothing.
+    struct ExtractedText {
+        std::string plain;                      // as extract_span_text(html)
+        std::string normalized;                 // as normalize_for_phrase(plain)
+        std::vector<std::string_view> tokens;   // as Tokenizer::tokenize(plain); views into `normalized`
+    };
+
+    // One pass over the HTML producing all three of the above: span text is
+    // entity-decoded and whitespace-collapsed as it is copied, and each
+    // finished stretch of plain text is folded into `normalized` and split
+    // into tokens while still in cache.
+    static void extract_fused(const std::string& html, ExtractedText& out);
+
     static std::string strip(const std::string& html);
 
     static std::string extract_span_text(const std::string& html);
 
     static std::string normalize_for_phrase(const std::string& text);
 
-private:
+    // The steps of extract_span_text, one pass each:
+    // raw span text -> entity decoding -> whitespace collapsing.
+    static std::string extract_span_raw(const std::string& html);
     static void decode_entities_inplace(std::string& s);
+    static void collapse_whitespace_inplace(std::string& s);
 };
@@ -1,15 +1,7 @@
 #include "tokenizer.hpp"
-#include <cctype>
+#include "utf8.hpp"
 #include <chrono>
 
-static inline bool is_word_char(unsigned char c) {
-    return std::isalnum(c) != 0;
-}
-
-static inline char to_lower_ascii(unsigned char c) {
-    return static_cast<char>(std::tolower(c));
-}
-
 void Tokenizer::tokenize_into(const std::string& plain, std::vector<std::string>& out, TokenizationStats* stats) {
     using clock = std::chrono::steady_clock;
     auto t0 = clock::now();
@@ -17,33 +9,22 @@ void Tokenizer::tokenize_into(const std::string& plain, std::vector<std::string>
     std::string cur;
     cur.reserve(32);
 
-    for (size_t i = 0; i < plain.size(); ++i) {
-        unsigned char c = static_cast<unsigned char>(plain[i]);
-        if (is_word_char(c)) {
-            cur.push_back(to_lower_ascii(c));
-        } else {
-            if (!cur.empty()) {
-                out.push_back(cur);
-                if (stats) {
-                    stats->total_tokens += 1;
-                    stats->total_token_chars += cur.size();
-                }
-                cur.clear();
-            }
-        }
-    }
-    if (!cur.empty()) {
+    auto flush = [&] {
+        if (cur.empty()) return;
         out.push_back(cur);
         if (stats) {
             stats->total_tokens += 1;
             stats->total_token_chars += cur.size();
         }
-    }
+        cur.clear();
+    };
+    Utf8::scan(plain, [&](auto folded) { cur += folded; }, flush);
+    flush();
 
     if (stats) {
         stats->bytes_processed += plain.size();
         auto t1 = clock::now();
-        stats->millis += (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
+        stats->nanos += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
     }
 }
 
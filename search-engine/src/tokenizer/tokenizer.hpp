@@ -8,14 +8,14 @@ struct TokenizationStats {
     uint64_t total_tokens = 0;
     uint64_t total_token_chars = 0;
     uint64_t bytes_processed = 0;
-    uint64_t millis = 0;
+    uint64_t nanos = 0;
 
     double avg_token_len() const {
         return total_tokens ? (double)total_token_chars / (double)total_tokens : 0.0;
     }
     double kb_per_sec() const {
-        if (millis == 0) return 0.0;
-        double sec = (double)millis / 1000.0;
+        if (nanos == 0) return 0.0;
+        double sec = (double)nanos / 1e9;
         return ((double)bytes_processed / 1024.0) / sec;
     }
 };
@@ -0,0 +1,42 @@
+#include "utf8.hpp"
+
+static uint32_t fold_latin(uint32_t c) {
+    if (c <= 0xFF) {
+        if (c == 0xD7 || c == 0xF7) return 0;           // multiplication and division signs
+        return c <= 0xDE ? c + 0x20 : c;
+    }
+    if (c <= 0x17F) {                                   // Latin Extended-A: case pairs
+        if (c == 0x130) return 'i';
+        if (c == 0x178) return 0xFF;
+        if (c == 0x17F) return 's';
+        if (c == 0x138 || c == 0x149) return c;
+        if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E)) return (c & 1) ? c + 1 : c;
+        return (c & 1) ? c : c + 1;
+    }
+    return c;                                           // Extended-B, IPA: not folded
+}
+
+static uint32_t fold_cyrillic(uint32_t c) {
+    if (c <= 0x40F) c += 0x50;
+    else if (c <= 0x42F) c += 0x20;
+    else if (c <= 0x45F) {}
+    else if (c == 0x482) return 0;                      // thousands sign
+    else if (c >= 0x483 && c <= 0x489) {}               // combining marks
+    else if (c == 0x4C0) c = 0x4CF;
+    else if (c >= 0x4C1 && c <= 0x4CE) c += (c & 1);
+    else if (c != 0x4CF) c += !(c & 1);
+    return c == 0x451 ? 0x435 : c;                      // ё -> е
+}
+
+uint32_t Utf8::foldNonAscii_(uint32_t c) {
+    if (c < 0xC0) return 0;                             // C1 controls, Latin-1 punctuation and signs
+    if (c < 0x250) return fold_latin(c);
+    if (c >= 0x400 && c <= 0x52F) return fold_cyrillic(c);
+    if (c >= 0x2000 && c <= 0x2BFF) return 0;           // punctuation, symbols, arrows, box drawing
+    if (c >= 0x2E00 && c <= 0x2E7F) return 0;
+    if (c >= 0x3000 && c <= 0x303F) return 0;           // CJK punctuation
+    if (c >= 0xFE30 && c <= 0xFE4F) return 0;
+    if (c == 0xFEFF || (c >= 0xFFF0 && c <= 0xFFFF)) return 0;
+    if (c >= 0x1F000 && c <= 0x1FAFF) return 0;         // emoji and pictographs
+    return c;
+}
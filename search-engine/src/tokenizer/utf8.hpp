@@ -0,0 +1,158 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// UTF-8 decoding and word-character folding shared by the tokenizer and the
+// phrase normalizer. A word character is a letter or digit; Latin and
+// Cyrillic letters are lower-cased (and Cyrillic yo folded to ye), other
+// scripts are kept as is. Punctuation, symbols, spaces and invalid bytes
+// separate words.
+class Utf8 {
+public:
+    static constexpr uint32_t kReplacement = 0xFFFD;
+
+    // Length of the all-ASCII prefix of [p, p + n), checked 16/32 bytes at a time.
+    static size_t asciiPrefix(const char* p, size_t n) {
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 32 <= n; i += 32) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+            if (const unsigned m = (unsigned)_mm256_movemask_epi8(v)) return i + std::countr_zero(m);
+        }
+#endif
+#if defined(__SSE2__)
+        for (; i + 16 <= n; i += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            if (const unsigned m = (unsigned)_mm_movemask_epi8(v)) return i + std::countr_zero(m);
+        }
+#else
+        for (; i + 8 <= n; i += 8) {
+            uint64_t w;
+            std::memcpy(&w, p + i, 8);
+            if (w & 0x8080808080808080ull) break;
+        }
+#endif
+        while (i < n && (unsigned char)p[i] < 0x80) ++i;
+        return i;
+    }
+
+    // Decodes the code point at p (n > 0 bytes left) and sets `len` to the
+    // bytes consumed. Malformed input yields kReplacement with len = 1.
+    static uint32_t decode(const char* p, size_t n, size_t& len) {
+        const unsigned char b0 = (unsigned char)p[0];
+        const size_t need = kSeqLen[b0];
+        len = 1;
+        if (need <= 1) return need ? b0 : kReplacement;
+        if (n < need) return kReplacement;
+
+        // second-byte bounds reject overlongs, surrogates and values past U+10FFFF
+        const unsigned char b1 = (unsigned char)p[1];
+        unsigned char lo = 0x80, hi = 0xBF;
+        if (b0 == 0xE0) lo = 0xA0;
+        else if (b0 == 0xED) hi = 0x9F;
+        else if (b0 == 0xF0) lo = 0x90;
+        else if (b0 == 0xF4) hi = 0x8F;
+        if (b1 < lo || b1 > hi) return kReplacement;
+
+        uint32_t cp = ((b0 & (0x7Fu >> need)) << 6) | (b1 & 0x3Fu);
+        for (size_t k = 2; k < need; ++k) {
+            const unsigned char b = (unsigned char)p[k];
+            if ((b & 0xC0) != 0x80) return kReplacement;
+            cp = (cp << 6) | (b & 0x3Fu);
+        }
+        len = need;
+        return cp;
+    }
+
+    static void append(std::string& out, uint32_t cp) {
+        char buf[4];
+        out.append(buf, encode_(cp, buf));
+    }
+
+    // Folded form of a word character, 0 if `cp` separates words.
+    static uint32_t foldWordChar(uint32_t cp) {
+        return cp < 0x80 ? (uint32_t)(unsigned char)kAsciiFold[cp] : foldNonAscii_(cp);
+    }
+
+    // Walks `s` calling word(c) with the folded bytes of each word character
+    // (a char for ASCII, a std::string_view otherwise) and sep() for every
+    // other character. ASCII runs skip the decoder entirely.
+    template <class Word, class Sep>
+    static void scan(std::string_view s, Word&& word, Sep&& sep) {
+        const char* p = s.data();
+        const size_t n = s.size();
+        size_t i = 0;
+        while (i < n) {
+            const size_t run = i + asciiPrefix(p + i, n - i);
+            for (; i < run; ++i) {
+                if (const char f = kAsciiFold[(unsigned char)p[i]]) word(f);
+                else sep();
+            }
+            if (i == n) break;
+
+            size_t len = 0;
+            const uint32_t cp = decode(p + i, n - i, len);
+            i += len;
+            const uint32_t f = foldNonAscii_(cp);
+            if (!f) {
+                sep();
+            } else if (f < 0x80) {
+                word((char)f);
+            } else {
+                char buf[4];
+                word(std::string_view(buf, encode_(f, buf)));
+            }
+        }
+    }
+
+private:
+    static constexpr std::array<uint8_t, 256> kSeqLen = [] {
+        std::array<uint8_t, 256> t{};
+        for (int b = 0; b < 0x80; ++b) t[b] = 1;
+        for (int b = 0xC2; b <= 0xDF; ++b) t[b] = 2;
+        for (int b = 0xE0; b <= 0xEF; ++b) t[b] = 3;
+        for (int b = 0xF0; b <= 0xF4; ++b) t[b] = 4;
+        return t;
+    }();
+
+    static constexpr std::array<char, 256> kAsciiFold = [] {
+        std::array<char, 256> t{};
+        for (int c = '0'; c <= '9'; ++c) t[c] = (char)c;
+        for (int c = 'a'; c <= 'z'; ++c) t[c] = (char)c;
+        for (int c = 'A'; c <= 'Z'; ++c) t[c] = (char)(c - 'A' + 'a');
+        return t;
+    }();
+
+    static uint32_t foldNonAscii_(uint32_t cp);
+
+    static size_t encode_(uint32_t cp, char* buf) {
+        if (cp < 0x80) {
+            buf[0] = (char)cp;
+            return 1;
+        }
+        if (cp < 0x800) {
+            buf[0] = (char)(0xC0 | (cp >> 6));
+            buf[1] = (char)(0x80 | (cp & 0x3F));
+            return 2;
+        }
+        if (cp < 0x10000) {
+            buf[0] = (char)(0xE0 | (cp >> 12));
+            buf[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            buf[2] = (char)(0x80 | (cp & 0x3F));
+            return 3;
+        }
+        buf[0] = (char)(0xF0 | (cp >> 18));
+        buf[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        buf[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        buf[3] = (char)(0x80 | (cp & 0x3F));
+        return 4;
+    }
+};
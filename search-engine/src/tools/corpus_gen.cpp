@@ -0,0 +1,458 @@
+// Synthetic corpus generator for scale testing.
+//
+// Writes TSV (url \t crawled_at \t html, the --sample format) or NDJSON
+// ({"url","crawled_at","text"}, importable into the Mongo collection) with
+// HTML shaped like the crawled pages. Term frequencies follow a Zipf law
+// whose exponent is fitted from data/zipf.csv.
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Args {
+    std::string out = "-";
+    std::string format = "tsv";
+    std::string zipf_path = "data/zipf.csv";
+    uint64_t docs = 1000;
+    uint64_t seed = 42;
+    size_t vocab = 0;          // 0 = as many terms as zipf.csv has
+    uint32_t min_words = 50;
+    uint32_t max_words = 600;
+    uint32_t hosts = 1000;
+    double exponent = 0.0;     // 0 = fit from zipf.csv
+};
+
+void print_usage(const char* argv0) {
+    std::cout
+        << "Usage:\n"
+        << "  " << argv0 << " [--docs N] [--out path|-] [--format tsv|ndjson] [--seed S]\n"
+        << "      [--zipf-path data/zipf.csv] [--vocab V] [--exponent s]\n"
+        << "      [--min-words N] [--max-words N] [--hosts N]\n\n"
+        << "Examples:\n"
+        << "  " << argv0 << " --docs 10000000 --out data/synthetic.tsv\n"
+        << "  " << argv0 << " --docs 100000 --format ndjson --seed 7 --out data/synthetic.ndjson\n\n";
+}
+
+bool parse_args(int argc, char** argv, Args& a) {
+    for (int i = 1; i < argc; ++i) {
+        std::string s = argv[i];
+        if (s == "--out" && i + 1 < argc) a.out = argv[++i];
+        else if (s == "--format" && i + 1 < argc) a.format = argv[++i];
+        else if (s == "--zipf-path" && i + 1 < argc) a.zipf_path = argv[++i];
+        else if (s == "--docs" && i + 1 < argc) a.docs = std::stoull(argv[++i]);
+        else if (s == "--seed" && i + 1 < argc) a.seed = std::stoull(argv[++i]);
+        else if (s == "--vocab" && i + 1 < argc) a.vocab = std::stoull(argv[++i]);
+        else if (s == "--exponent" && i + 1 < argc) a.exponent = std::stod(argv[++i]);
+        else if (s == "--min-words" && i + 1 < argc) a.min_words = (uint32_t)std::stoul(argv[++i]);
+        else if (s == "--max-words" && i + 1 < argc) a.max_words = (uint32_t)std::stoul(argv[++i]);
+        else if (s == "--hosts" && i + 1 < argc) a.hosts = (uint32_t)std::stoul(argv[++i]);
+        else if (s == "--help" || s == "-h") { print_usage(argv[0]); return false; }
+        else {
+            std::cerr << "Unknown arg: " << s << "\n";
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+    if (a.format != "tsv" && a.format != "ndjson") {
+        std::cerr << "Unknown format: " << a.format << "\n";
+        return false;
+    }
+    if (a.min_words == 0) a.min_words = 1;
+    if (a.max_words < a.min_words) a.max_words = a.min_words;
+    if (a.hosts == 0) a.hosts = 1;
+    return true;
+}
+
+// xoshiro256** seeded through splitmix64: fast and identical on every platform,
+// unlike the std:: distributions.
+class Rng {
+public:
+    explicit Rng(uint64_t seed) {
+        for (auto& w : s_) {
+            seed += 0x9e3779b97f4a7c15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            w = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next() {
+        const uint64_t result = rotl_(s_[1] * 5, 7) * 9;
+        const uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl_(s_[3], 45);
+        return result;
+    }
+
+    // uniform in [0, n)
+    uint32_t below(uint32_t n) {
+        return (uint32_t)(((next() >> 32) * (uint64_t)n) >> 32);
+    }
+
+    double unit() { return (double)(next() >> 11) * (1.0 / 9007199254740992.0); }
+
+private:
+    uint64_t s_[4];
+    static uint64_t rotl_(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+// Walker/Vose alias table: O(1) sampling from a fixed discrete distribution.
+class AliasTable {
+public:
+    explicit AliasTable(const std::vector<double>& weights) {
+        const size_t n = weights.size();
+        prob_.assign(n, 0);
+        alias_.assign(n, 0);
+
+        double sum = 0.0;
+        for (double w : weights) sum += w;
+
+        std::vector<double> scaled(n);
+        std::vector<uint32_t> small, large;
+        small.reserve(n);
+        large.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            scaled[i] = weights[i] * (double)n / sum;
+            (scaled[i] < 1.0 ? small : large).push_back((uint32_t)i);
+        }
+        while (!small.empty() && !large.empty()) {
+            uint32_t s = small.back(); small.pop_back();
+            uint32_t l = large.back();
+            prob_[s] = to_fixed_(scaled[s]);
+            alias_[s] = l;
+            scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+            if (scaled[l] < 1.0) { large.pop_back(); small.push_back(l); }
+        }
+        for (uint32_t l : large) prob_[l] = UINT32_MAX;
+        for (uint32_t s : small) prob_[s] = UINT32_MAX;
+    }
+
+    uint32_t sample(Rng& rng) const {
+        const uint64_t r = rng.next();
+        const uint32_t col = (uint32_t)(((r >> 32) * (uint64_t)prob_.size()) >> 32);
+        return ((uint32_t)r <= prob_[col]) ? col : alias_[col];
+    }
+
+private:
+    std::vector<uint32_t> prob_;   // acceptance threshold scaled to 2^32
+    std::vector<uint32_t> alias_;
+
+    static uint32_t to_fixed_(double p) {
+        if (p >= 1.0) return UINT32_MAX;
+        return (uint32_t)(p * 4294967296.0);
+    }
+};
+
+struct ZipfRow { std::string term; uint64_t tf; };
+
+bool load_zipf_csv(const std::string& path, std::vector<ZipfRow>& rows, std::string* err) {
+    std::ifstream f(path);
+    if (!f) {
+        if (err) *err = "Cannot open zipf CSV: " + path;
+        return false;
+    }
+    std::string line;
+    std::getline(f, line); // header
+    while (std::getline(f, line)) {
+        size_t c1 = line.find(',');
+        size_t c2 = line.rfind(',');
+        if (c1 == std::string::npos || c2 == c1) continue;
+        std::string term = line.substr(c1 + 1, c2 - c1 - 1);
+        if (term.empty()) continue;
+        // terms end up inside HTML/TSV/JSON: keep only plain word bytes
+        bool ok = true;
+        for (unsigned char ch : term) {
+            if (ch < 0x21 || ch == '<' || ch == '>' || ch == '&' || ch == '"' || ch == '\\') { ok = false; break; }
+        }
+        if (!ok) continue;
+        rows.push_back({std::move(term), std::stoull(line.substr(c2 + 1))});
+    }
+    if (rows.empty()) {
+        if (err) *err = "No rows in zipf CSV: " + path;
+        return false;
+    }
+    return true;
+}
+
+// Least-squares fit of log(tf) = c - s * log(rank). Points are averaged into
+// log-spaced rank buckets first, otherwise the long hapax tail dominates the fit.
+double fit_zipf_exponent(const std::vector<ZipfRow>& rows) {
+    const double bucket_width = 0.05; // in log(rank)
+    std::vector<double> xs, ys;
+    double bx = 0.0, by = 0.0;
+    size_t bn = 0;
+    long cur_bucket = -1;
+
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (rows[i].tf < 2) break; // singletons sit on a plateau, not on the curve
+        double x = std::log((double)(i + 1));
+        double y = std::log((double)rows[i].tf);
+        long b = (long)(x / bucket_width);
+        if (b != cur_bucket && bn > 0) {
+            xs.push_back(bx / (double)bn);
+            ys.push_back(by / (double)bn);
+            bx = by = 0.0;
+            bn = 0;
+        }
+        cur_bucket = b;
+        bx += x; by += y; ++bn;
+    }
+    if (bn > 0) { xs.push_back(bx / (double)bn); ys.push_back(by / (double)bn); }
+    if (xs.size() < 2) return 1.0;
+
+    double mx = 0.0, my = 0.0;
+    for (size_t i = 0; i < xs.size(); ++i) { mx += xs[i]; my += ys[i]; }
+    mx /= (double)xs.size();
+    my /= (double)xs.size();
+    double num = 0.0, den = 0.0;
+    for (size_t i = 0; i < xs.size(); ++i) {
+        num += (xs[i] - mx) * (ys[i] - my);
+        den += (xs[i] - mx) * (xs[i] - mx);
+    }
+    if (den == 0.0) return 1.0;
+    return -num / den;
+}
+
+// Pronounceable filler words for ranks beyond the CSV vocabulary.
+std::string synth_word(uint64_t n) {
+    static const char* syl[] = {"ka","ri","to","me","su","lo","na","vi","de","po",
+                                "ra","ne","zu","fi","go","la","mi","so","te","bu"};
+    std::string w;
+    do {
+        w += syl[n % 20];
+        n /= 20;
+    } while (n);
+    w += "x";
+    return w;
+}
+
+// Buffered writer: one fwrite per 1 MiB keeps generation at disk speed.
+class Writer {
+public:
+    explicit Writer(std::FILE* f) : f_(f) { buf_.reserve(kCap + 65536); }
+    ~Writer() { flush(); }
+
+    void put(char c) { buf_.push_back(c); }
+    void put(const char* s, size_t n) { buf_.append(s, n); }
+    void put(const char* s) { buf_.append(s); }
+    void put(const std::string& s) { buf_.append(s); }
+
+    void putUInt(uint64_t v) {
+        char tmp[20];
+        int n = 0;
+        do { tmp[n++] = (char)('0' + v % 10); v /= 10; } while (v);
+        while (n) buf_.push_back(tmp[--n]);
+    }
+
+    void putPadded(uint32_t v, int width) {
+        char tmp[10];
+        for (int i = width - 1; i >= 0; --i) { tmp[i] = (char)('0' + v % 10); v /= 10; }
+        buf_.append(tmp, (size_t)width);
+    }
+
+    void endRecord() {
+        buf_.push_back('\n');
+        if (buf_.size() >= kCap) flush();
+    }
+
+    void flush() {
+        if (!buf_.empty()) {
+            if (std::fwrite(buf_.data(), 1, buf_.size(), f_) != buf_.size()) failed_ = true;
+            buf_.clear();
+        }
+    }
+
+    // false once a write came up short (disk full, closed pipe, ...)
+    bool ok() const { return !failed_; }
+
+private:
+    static constexpr size_t kCap = 1 << 20;
+    std::FILE* f_;
+    std::string buf_;
+    bool failed_ = false;
+};
+
+// Generates one document's HTML with the structures the extractor has to deal
+// with: nested spans, text outside spans, <script>/<style> blocks, comments and
+// entities. In NDJSON mode quotes are written pre-escaped.
+class PageGenerator {
+public:
+    PageGenerator(const std::vector<std::string>& vocab, const AliasTable& terms,
+                  const Args& args, bool json)
+        : vocab_(vocab), terms_(terms), args_(args), q_(json ? "\\\"" : "\"") {}
+
+    void write(Writer& w, Rng& rng, uint64_t doc_no) {
+        const uint32_t span = args_.max_words - args_.min_words + 1;
+        uint32_t words = args_.min_words + rng.below(span);
+
+        w.put("<html><head><title>");
+        words_(w, rng, 3 + rng.below(6));
+        w.put("</title><style>.c"); w.putUInt(doc_no % 97);
+        w.put("{color:#333;margin:0 auto}</style>");
+        w.put("<script>var page="); w.putUInt(doc_no);
+        w.put(";if(page<10&&page>0){track(");
+        w.put(q_); w.put("view"); w.put(q_);
+        w.put(");}</script></head><body>");
+        w.put("<div class="); w.put(q_); w.put("nav"); w.put(q_); w.put(">");
+        words_(w, rng, 4);
+        w.put("</div><!-- content --><div class="); w.put(q_); w.put("content"); w.put(q_); w.put(">");
+
+        int depth = 0;
+        while (words > 0) {
+            uint32_t chunk = std::min<uint32_t>(words, 4 + rng.below(24));
+            words -= chunk;
+
+            switch (rng.below(8)) {
+                case 0:
+                    if (depth < 3) { w.put("<span class="); w.put(q_); w.put("s"); w.put(q_); w.put(">"); ++depth; }
+                    break;
+                case 1:
+                    if (depth > 0) { w.put("</span>"); --depth; }
+                    break;
+                case 2:
+                    w.put("<p>"); words_(w, rng, 3); w.put("</p>");
+                    break;
+                case 3:
+                    w.put("<script>x=1;</script>");
+                    break;
+                default:
+                    break;
+            }
+            if (depth == 0) { w.put("<span>"); ++depth; }
+            words_(w, rng, chunk);
+            w.put(' ');
+        }
+        while (depth-- > 0) w.put("</span>");
+        w.put("</div></body></html>");
+    }
+
+private:
+    const std::vector<std::string>& vocab_;
+    const AliasTable& terms_;
+    const Args& args_;
+    const char* q_;
+
+    void words_(Writer& w, Rng& rng, uint32_t n) {
+        static const char* entities[] = {"&amp;", "&quot;", "&#39;", "&nbsp;", "&lt;", "&gt;", "&#169;"};
+        static const char* punct[] = {".", ",", ";", ":", "!", "?"};
+        for (uint32_t i = 0; i < n; ++i) {
+            if (i) w.put(' ');
+            const uint64_t r = rng.next();
+            if ((r & 63) == 0) {
+                w.put(entities[(r >> 8) % 7]);
+                w.put(' ');
+            }
+            w.put(vocab_[terms_.sample(rng)]);
+            if (((r >> 16) & 15) == 0) w.put(punct[(r >> 24) % 6]);
+        }
+    }
+};
+
+void write_url(Writer& w, uint32_t host, uint64_t doc_no) {
+    w.put("https://site");
+    w.putUInt(host);
+    w.put(".example/page/");
+    w.putUInt(doc_no);
+}
+
+void write_timestamp(Writer& w, Rng& rng) {
+    // 2024-01-01 .. 2025-12-28, days kept <= 28 to stay valid in every month
+    w.putPadded(2024 + rng.below(2), 4); w.put('-');
+    w.putPadded(1 + rng.below(12), 2);   w.put('-');
+    w.putPadded(1 + rng.below(28), 2);   w.put('T');
+    w.putPadded(rng.below(24), 2);       w.put(':');
+    w.putPadded(rng.below(60), 2);       w.put(':');
+    w.putPadded(rng.below(60), 2);       w.put('Z');
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Args args;
+    if (!parse_args(argc, argv, args)) return 1;
+
+    std::vector<ZipfRow> rows;
+    std::string err;
+    if (!load_zipf_csv(args.zipf_path, rows, &err)) {
+        std::cerr << "Load error: " << err << "\n";
+        return 2;
+    }
+
+    const double s = (args.exponent > 0.0) ? args.exponent : fit_zipf_exponent(rows);
+    const size_t vocab_size = args.vocab ? args.vocab : rows.size();
+
+    std::vector<std::string> vocab;
+    vocab.reserve(vocab_size);
+    for (size_t i = 0; i < vocab_size; ++i) {
+        vocab.push_back(i < rows.size() ? rows[i].term : synth_word(i));
+    }
+
+    std::vector<double> weights(vocab_size);
+    for (size_t i = 0; i < vocab_size; ++i) weights[i] = std::pow((double)(i + 1), -s);
+    AliasTable terms(weights);
+
+    // hosts are Zipfian too: a few big sites, a long tail of small ones
+    std::vector<double> host_weights(args.hosts);
+    for (uint32_t i = 0; i < args.hosts; ++i) host_weights[i] = 1.0 / (double)(i + 1);
+    AliasTable hosts(host_weights);
+
+    std::FILE* f = stdout;
+    if (args.out != "-") {
+        f = std::fopen(args.out.c_str(), "wb");
+        if (!f) {
+            std::cerr << "Cannot open output: " << args.out << "\n";
+            return 3;
+        }
+    }
+
+    std::cerr << "Zipf exponent: " << s << (args.exponent > 0.0 ? " (given)" : " (fitted)")
+              << ", vocabulary: " << vocab_size << ", docs: " << args.docs
+              << ", seed: " << args.seed << "\n";
+
+    const bool json = (args.format == "ndjson");
+    Rng rng(args.seed);
+    PageGenerator pages(vocab, terms, args, json);
+    bool written = false;
+    {
+        Writer w(f);
+        for (uint64_t d = 0; d < args.docs && w.ok(); ++d) {
+            const uint32_t host = hosts.sample(rng);
+            if (json) {
+                w.put("{\"url\":\""); write_url(w, host, d);
+                w.put("\",\"crawled_at\":\""); write_timestamp(w, rng);
+                w.put("\",\"text\":\"");
+                pages.write(w, rng, d);
+                w.put("\"}");
+            } else {
+                write_url(w, host, d); w.put('\t');
+                write_timestamp(w, rng); w.put('\t');
+                pages.write(w, rng, d);
+            }
+            w.endRecord();
+        }
+        w.flush();
+        written = w.ok();
+    }
+
+    written = std::fflush(f) == 0 && written;
+    if (f != stdout && std::fclose(f) != 0) written = false;
+    if (!written) {
+        std::cerr << "Write error: " << (args.out == "-" ? "stdout" : args.out) << ": " << std::strerror(errno) << "\n";
+        return 4;
+    }
+    return 0;
+}
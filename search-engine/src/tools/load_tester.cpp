@@ -0,0 +1,509 @@
+// Query-log replay load tester.
+//
+// Replays a query log (one query per line; with tabs, the text after the
+// last one) against an in-process SearchEngine or a running server's
+// /api/search, and reports throughput and latency percentiles.
+//
+//  - closed loop: --clients N clients each send the next query as soon as
+//    the previous one is answered (optionally paced to --rate in total);
+//  - open loop: queries arrive at --rate per second (evenly or, with
+//    --poisson, exponentially spaced) whether or not earlier ones are done.
+//
+// Latency is measured from when a query was meant to be sent, not from
+// when a busy client got around to sending it, so a stall is charged to
+// every query it delayed (coordinated omission). The service time from the
+// actual send is reported alongside. With several rates (--rate 100,200,400)
+// each is run in turn, which shows where the latency knee and saturation are.
+// Against the engine it also counts heap allocations per query.
+#include "search/search_engine.hpp"
+#include "structures/alloc_counter.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <httplib.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Args {
+    std::string log;
+    std::string target = "engine";     // engine | http
+    std::string mode = "closed";       // closed | open
+
+    // in-process engine
+    std::string sample_file = "data/sample.tsv";
+    std::string index_file;
+    bool stemming = true;
+    size_t query_threads = 0;
+    size_t arena_kb = 64;              // per-thread query arena; 0 = heap only
+
+    // server
+    std::string host = "127.0.0.1";
+    int port = 8080;
+
+    size_t clients = 0;                // 0 = 8 closed, 64 open
+    std::vector<double> rates;         // per second; several = one run each
+    bool poisson = false;
+    double duration_s = 10.0;
+    double warmup_s = 1.0;
+    size_t limit = 10;
+    uint64_t seed = 42;
+    std::string json_path;
+};
+
+void print_usage(const char* argv0) {
+    std::cout
+        << "Usage:\n"
+        << "  " << argv0 << " --log queries.txt [--target engine|http] [--mode closed|open]\n"
+        << "      [--clients N] [--rate R[,R...]] [--poisson] [--duration 10] [--warmup 1]\n"
+        << "      [--limit 10] [--seed S] [--json report.json]\n"
+        << "      engine: [--sample path] [--index index.bin] [--no-stem] [--query-threads N] [--query-arena-kb 64]\n"
+        << "      http:   [--host 127.0.0.1] [--port 8080]\n\n"
+        << "Examples:\n"
+        << "  " << argv0 << " --log data/queries.txt --mode closed --clients 16 --duration 30\n"
+        << "  " << argv0 << " --log data/queries.txt --target http --port 8080 --mode open --rate 200,400,800\n\n";
+}
+
+bool parse_rates(const std::string& s, std::vector<double>& out) {
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        const double r = std::stod(item);
+        if (r <= 0) return false;
+        out.push_back(r);
+    }
+    return !out.empty();
+}
+
+bool parse_args(int argc, char** argv, Args& a) {
+    for (int i = 1; i < argc; ++i) {
+        std::string s = argv[i];
+        if (s == "--log" && i + 1 < argc) a.log = argv[++i];
+        else if (s == "--target" && i + 1 < argc) a.target = argv[++i];
+        else if (s == "--mode" && i + 1 < argc) a.mode = argv[++i];
+        else if (s == "--sample" && i + 1 < argc) a.sample_file = argv[++i];
+        else if (s == "--index" && i + 1 < argc) a.index_file = argv[++i];
+        else if (s == "--no-stem") a.stemming = false;
+        else if (s == "--query-threads" && i + 1 < argc) a.query_threads = std::stoul(argv[++i]);
+        else if (s == "--query-arena-kb" && i + 1 < argc) a.arena_kb = std::stoul(argv[++i]);
+        else if (s == "--host" && i + 1 < argc) a.host = argv[++i];
+        else if (s == "--port" && i + 1 < argc) a.port = std::stoi(argv[++i]);
+        else if (s == "--clients" && i + 1 < argc) a.clients = std::stoul(argv[++i]);
+        else if (s == "--rate" && i + 1 < argc) {
+            if (!parse_rates(argv[++i], a.rates)) {
+                std::cerr << "Bad --rate (want positive numbers, comma-separated): " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if (s == "--poisson") a.poisson = true;
+        else if (s == "--duration" && i + 1 < argc) a.duration_s = std::stod(argv[++i]);
+        else if (s == "--warmup" && i + 1 < argc) a.warmup_s = std::stod(argv[++i]);
+        else if (s == "--limit" && i + 1 < argc) a.limit = std::stoul(argv[++i]);
+        else if (s == "--seed" && i + 1 < argc) a.seed = std::stoull(argv[++i]);
+        else if (s == "--json" && i + 1 < argc) a.json_path = argv[++i];
+        else if (s == "--help" || s == "-h") { print_usage(argv[0]); return false; }
+        else {
+            std::cerr << "Unknown arg: " << s << "\n";
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+    if (a.log.empty()) {
+        std::cerr << "--log is required\n";
+        print_usage(argv[0]);
+        return false;
+    }
+    if (a.target != "engine" && a.target != "http") {
+        std::cerr << "Unknown target: " << a.target << "\n";
+        return false;
+    }
+    if (a.mode != "closed" && a.mode != "open") {
+        std::cerr << "Unknown mode: " << a.mode << "\n";
+        return false;
+    }
+    if (a.mode == "open" && a.rates.empty()) {
+        std::cerr << "Open loop needs --rate\n";
+        return false;
+    }
+    if (a.clients == 0) a.clients = a.mode == "open" ? 64 : 8;
+    if (a.duration_s <= 0) a.duration_s = 1;
+    if (a.warmup_s < 0) a.warmup_s = 0;
+    return true;
+}
+
+// Log-linear latency histogram in microseconds, in the manner of
+// HdrHistogram: values below 256 are exact, above that each power of two
+// is split into 128 buckets, so a reported value is within 1% of the truth.
+class LatencyHistogram {
+public:
+    LatencyHistogram() : counts_(kBuckets, 0) {}
+
+    void record(uint64_t us) {
+        ++counts_[index_(us)];
+        ++count_;
+        sum_ += us;
+        max_ = std::max(max_, us);
+    }
+
+    void merge(const LatencyHistogram& o) {
+        for (size_t i = 0; i < kBuckets; ++i) counts_[i] += o.counts_[i];
+        count_ += o.count_;
+        sum_ += o.sum_;
+        max_ = std::max(max_, o.max_);
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? (double)sum_ / (double)count_ : 0.0; }
+
+    // smallest recorded value (bucket top) with at least q of the samples at or below it
+    uint64_t quantile(double q) const {
+        if (!count_) return 0;
+        const uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(q * (double)count_));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) return std::min(top_(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    static constexpr int kSubBits = 7;
+    static constexpr size_t kBuckets = 256 + 57 * 128;
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0, sum_ = 0, max_ = 0;
+
+    static size_t index_(uint64_t v) {
+        if (v < 256) return (size_t)v;
+        const int shift = (int)std::bit_width(v) - (kSubBits + 1);
+        return 256 + (size_t)(shift - 1) * 128 + (size_t)((v >> shift) - 128);
+    }
+    static uint64_t top_(size_t i) {
+        if (i < 256) return i;
+        const int shift = (int)((i - 256) / 128) + 1;
+        const uint64_t m = (i - 256) % 128 + 128;
+        return ((m + 1) << shift) - 1;
+    }
+};
+
+// One client's way of answering a query; false on an error response.
+class Target {
+public:
+    virtual ~Target() = default;
+    virtual bool send(const std::string& q, bool& rejected) = 0;
+};
+
+class EngineTarget : public Target {
+public:
+    EngineTarget(const SearchEngine& engine, size_t limit) : engine_(engine), limit_(limit) {}
+
+    bool send(const std::string& q, bool& rejected) override {
+        try {
+            engine_.execute(q, limit_);
+            return true;
+        } catch (const QueryRejected&) {
+            rejected = true;
+        } catch (const std::exception&) {
+        }
+        return false;
+    }
+
+private:
+    const SearchEngine& engine_;
+    size_t limit_;
+};
+
+std::string url_encode(const std::string& s) {
+    static const char* hex = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : s) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            out.push_back(static_cast<char>(c));
+        } else {
+            out.push_back('%');
+            out.push_back(hex[c >> 4]);
+            out.push_back(hex[c & 15]);
+        }
+    }
+    return out;
+}
+
+// one keep-alive connection per client
+class HttpTarget : public Target {
+public:
+    HttpTarget(const std::string& host, int port, size_t limit)
+        : client_(host, port), suffix_("&limit=" + std::to_string(limit)) {
+        client_.set_keep_alive(true);
+        client_.set_connection_timeout(5);
+        client_.set_read_timeout(30);
+    }
+
+    bool send(const std::string& q, bool& rejected) override {
+        auto res = client_.Get("/api/search?q=" + url_encode(q) + suffix_);
+        if (!res) return false;
+        rejected = res->status == 429 || res->status == 422;
+        return res->status == 200;
+    }
+
+private:
+    httplib::Client client_;
+    std::string suffix_;
+};
+
+struct RunResult {
+    double rate = 0.0;            // offered; 0 = unpaced closed loop
+    double seconds = 0.0;         // measured window
+    uint64_t ok = 0, errors = 0, rejected = 0;
+    uint64_t allocs = 0;          // operator new calls on the client threads while measuring
+    LatencyHistogram latency;     // from the intended send time
+    LatencyHistogram service;     // from the actual send time
+};
+
+// splitmix64: the same arrival gaps for the same seed
+uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Intended send times (ns from the start) of every query of an open-loop run.
+std::vector<uint64_t> schedule(double rate, double seconds, bool poisson, uint64_t seed) {
+    std::vector<uint64_t> at;
+    const double mean_gap = 1e9 / rate;
+    double t = 0.0;
+    uint64_t state = seed;
+    while (t < seconds * 1e9) {
+        at.push_back((uint64_t)t);
+        if (poisson) {
+            const double u = ((double)(splitmix64(state) >> 11) + 0.5) / 9007199254740992.0;
+            t += -std::log(u) * mean_gap;
+        } else {
+            t += mean_gap;
+        }
+    }
+    return at;
+}
+
+uint64_t micros(Clock::duration d) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+// Runs warmup + duration; samples meant to be sent during the warmup are dropped.
+RunResult run(const Args& a, double rate, const std::vector<std::string>& queries,
+              const std::function<std::unique_ptr<Target>()>& make_target) {
+    const bool open = a.mode == "open";
+    const double total_s = a.warmup_s + a.duration_s;
+    const uint64_t warmup_ns = (uint64_t)(a.warmup_s * 1e9);
+    const uint64_t end_ns = (uint64_t)(total_s * 1e9);
+    const std::vector<uint64_t> arrivals = open ? schedule(rate, total_s, a.poisson, a.seed) : std::vector<uint64_t>{};
+
+    std::vector<RunResult> parts(a.clients);
+    std::atomic<uint64_t> next{0};
+    const Clock::time_point t0 = Clock::now() + std::chrono::milliseconds(50);
+
+    auto client = [&](size_t c) {
+        std::unique_ptr<Target> target = make_target();
+        RunResult& out = parts[c];
+        // a paced closed-loop client sends every `gap` ns, starting at an offset
+        const double gap = (!open && rate > 0) ? 1e9 * (double)a.clients / rate : 0.0;
+        uint64_t sent = 0;
+        std::this_thread::sleep_until(t0);
+        while (true) {
+            uint64_t i, intended;
+            if (open) {
+                i = next.fetch_add(1, std::memory_order_relaxed);
+                if (i >= arrivals.size()) break;
+                intended = arrivals[i];
+            } else {
+                i = next.fetch_add(1, std::memory_order_relaxed);
+                intended = gap > 0 ? (uint64_t)(gap * ((double)sent + (double)c / (double)a.clients))
+                                   : (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count();
+                if (intended >= end_ns) break;
+            }
+            const Clock::time_point when = t0 + std::chrono::nanoseconds(intended);
+            std::this_thread::sleep_until(when);
+            const Clock::time_point start = Clock::now();
+            bool rejected = false;
+            bool ok;
+            uint64_t calls;
+            {
+                AllocCounter::Scope counting;
+                const uint64_t calls0 = AllocCounter::calls();
+                ok = target->send(queries[i % queries.size()], rejected);
+                calls = AllocCounter::calls() - calls0;
+            }
+            const Clock::time_point done = Clock::now();
+            ++sent;
+            if (intended < warmup_ns) continue;
+            out.allocs += calls;
+            if (ok) {
+                ++out.ok;
+                out.latency.record(micros(done - when));
+                out.service.record(micros(done - start));
+            } else if (rejected) {
+                ++out.rejected;
+            } else {
+                ++out.errors;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(a.clients);
+    for (size_t c = 0; c < a.clients; ++c) threads.emplace_back(client, c);
+    for (auto& t : threads) t.join();
+    const double elapsed = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    RunResult r;
+    r.rate = rate;
+    r.seconds = std::max(elapsed - a.warmup_s, 1e-9);
+    for (const RunResult& p : parts) {
+        r.ok += p.ok;
+        r.errors += p.errors;
+        r.rejected += p.rejected;
+        r.allocs += p.allocs;
+        r.latency.merge(p.latency);
+        r.service.merge(p.service);
+    }
+    return r;
+}
+
+void print_header(bool engine) {
+    std::printf("%10s %10s %8s %8s %9s %9s %9s %9s %9s%s\n", "offered/s", "done/s", "errors", "rejected",
+                "p50 ms", "p99 ms", "p99.9 ms", "max ms", "svc p99", engine ? "  allocs/q" : "");
+}
+
+uint64_t queries_done(const RunResult& r) { return r.ok + r.errors + r.rejected; }
+
+void print_row(const RunResult& r, bool engine) {
+    auto ms = [](uint64_t us) { return (double)us / 1000.0; };
+    char offered[32];
+    if (r.rate > 0) std::snprintf(offered, sizeof(offered), "%.1f", r.rate);
+    else std::snprintf(offered, sizeof(offered), "max");
+    std::printf("%10s %10.1f %8llu %8llu %9.3f %9.3f %9.3f %9.3f %9.3f", offered,
+                (double)queries_done(r) / r.seconds, (unsigned long long)r.errors, (unsigned long long)r.rejected,
+                ms(r.latency.quantile(0.5)), ms(r.latency.quantile(0.99)), ms(r.latency.quantile(0.999)),
+                ms(r.latency.max()), ms(r.service.quantile(0.99)));
+    if (engine) std::printf("%10.1f", (double)r.allocs / (double)std::max<uint64_t>(1, queries_done(r)));
+    std::printf("\n");
+}
+
+std::string histogram_json(const LatencyHistogram& h) {
+    std::ostringstream oss;
+    oss << "{\"count\":" << h.count() << ",\"mean_us\":" << h.mean() << ",\"p50_us\":" << h.quantile(0.5)
+        << ",\"p90_us\":" << h.quantile(0.9) << ",\"p99_us\":" << h.quantile(0.99)
+        << ",\"p999_us\":" << h.quantile(0.999) << ",\"max_us\":" << h.max() << "}";
+    return oss.str();
+}
+
+std::string report_json(const Args& a, const std::vector<RunResult>& runs) {
+    std::ostringstream oss;
+    oss << "{\"mode\":\"" << a.mode << "\",\"target\":\"" << a.target << "\",\"clients\":" << a.clients
+        << ",\"runs\":[";
+    for (size_t i = 0; i < runs.size(); ++i) {
+        const RunResult& r = runs[i];
+        if (i) oss << ",";
+        oss << "{\"offered_per_sec\":" << r.rate << ",\"seconds\":" << r.seconds
+            << ",\"throughput_per_sec\":" << (double)queries_done(r) / r.seconds << ",\"ok\":" << r.ok
+            << ",\"errors\":" << r.errors << ",\"rejected\":" << r.rejected;
+        if (a.target == "engine") {
+            oss << ",\"allocs_per_query\":" << (double)r.allocs / (double)std::max<uint64_t>(1, queries_done(r));
+        }
+        oss << ",\"latency\":" << histogram_json(r.latency) << ",\"service\":" << histogram_json(r.service) << "}";
+    }
+    oss << "]}";
+    return oss.str();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Args a;
+    if (!parse_args(argc, argv, a)) return 1;
+
+    std::vector<std::string> queries;
+    {
+        std::ifstream in(a.log);
+        if (!in) {
+            std::cerr << "Cannot open query log: " << a.log << "\n";
+            return 2;
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (size_t tab = line.rfind('\t'); tab != std::string::npos) line.erase(0, tab + 1);
+            if (!line.empty() && line[0] != '#') queries.push_back(line);
+        }
+    }
+    if (queries.empty()) {
+        std::cerr << "No queries in " << a.log << "\n";
+        return 2;
+    }
+
+    SearchEngine engine;
+    std::function<std::unique_ptr<Target>()> make_target;
+    if (a.target == "engine") {
+        ParallelOptions par;
+        par.threads = a.query_threads;
+        engine.setParallelism(par);
+        engine.setQueryArena({a.arena_kb << 10, ArenaOptions{}.max_bytes});
+        std::string err;
+        if (!engine.loadFromSampleFile(a.sample_file, &err)) {
+            std::cerr << "Load error: " << err << "\n";
+            return 2;
+        }
+        if (!a.index_file.empty()) {
+            if (!engine.loadIndex(a.index_file, &err)) {
+                std::cerr << "Index load error: " << err << "\n";
+                return 2;
+            }
+        } else {
+            engine.buildIndex(a.stemming);
+        }
+        make_target = [&] { return std::make_unique<EngineTarget>(engine, a.limit); };
+    } else {
+        make_target = [&] { return std::make_unique<HttpTarget>(a.host, a.port, a.limit); };
+    }
+
+    std::vector<double> rates = a.rates;
+    if (rates.empty()) rates.push_back(0.0); // closed loop, as fast as the clients go
+
+    std::printf("%s loop, %zu clients, %zu queries, %.1f s per run after %.1f s warmup\n", a.mode.c_str(),
+                a.clients, queries.size(), a.duration_s, a.warmup_s);
+    const bool engine_target = a.target == "engine";
+    print_header(engine_target);
+    std::vector<RunResult> runs;
+    for (double rate : rates) {
+        runs.push_back(run(a, rate, queries, make_target));
+        print_row(runs.back(), engine_target);
+        std::fflush(stdout);
+    }
+
+    if (!a.json_path.empty()) {
+        std::ofstream jf(a.json_path);
+        if (!jf) {
+            std::cerr << "Cannot write report: " << a.json_path << "\n";
+            return 3;
+        }
+        jf << report_json(a, runs) << "\n";
+    }
+    return 0;
+}
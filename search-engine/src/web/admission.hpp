@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct AdmissionOptions {
+    uint64_t expensive_cost = 1 << 22;   // estimated cost from which a query counts as expensive
+    size_t max_expensive = 0;            // concurrent expensive queries; 0 = no cap
+    size_t max_per_client = 1;           // of those, per client address; 0 = no per-client cap
+};
+
+// Caps concurrent expensive queries, overall and per client, so that one
+// client cannot tie up every worker with them. Cheap queries always pass.
+class Admission {
+public:
+    // Holds an admitted slot until destroyed.
+    class Ticket {
+    public:
+        Ticket() = default;
+        ~Ticket() { release(); }
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+
+        void release() {
+            if (owner_) owner_->release_(client_);
+            owner_ = nullptr;
+        }
+
+    private:
+        friend class Admission;
+        Admission* owner_ = nullptr;
+        std::string client_;
+    };
+
+    explicit Admission(AdmissionOptions opt) : opt_(opt) {}
+
+    bool enabled() const { return opt_.max_expensive > 0; }
+    bool expensive(uint64_t cost) const { return cost >= opt_.expensive_cost; }
+
+    // false if a cap is reached; otherwise `t` holds the slot
+    bool tryAcquire(const std::string& client, Ticket& t) {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (running_ >= opt_.max_expensive) return false;
+        size_t& mine = per_client_[client];
+        if (opt_.max_per_client && mine >= opt_.max_per_client) return false;
+        ++mine;
+        ++running_;
+        t.release();
+        t.owner_ = this;
+        t.client_ = client;
+        return true;
+    }
+
+private:
+    AdmissionOptions opt_;
+    std::mutex mu_;
+    size_t running_ = 0;
+    std::unordered_map<std::string, size_t> per_client_;
+
+    void release_(const std::string& client) {
+        std::lock_guard<std::mutex> lk(mu_);
+        --running_;
+        auto it = per_client_.find(client);
+        if (it != per_client_.end() && --it->second == 0) per_client_.erase(it);
+    }
+};
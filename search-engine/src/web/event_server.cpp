@@ -0,0 +1,450 @@
+#include "event_server.hpp"
+#include "../structures/thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char* reason_phrase(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 422: return "Unprocessable Content";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default:  return "Unknown";
+    }
+}
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+std::string url_decode(std::string_view s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '+') {
+            out.push_back(' ');
+        } else if (s[i] == '%' && i + 2 < s.size() && hex_value(s[i + 1]) >= 0 && hex_value(s[i + 2]) >= 0) {
+            out.push_back(static_cast<char>(hex_value(s[i + 1]) * 16 + hex_value(s[i + 2])));
+            i += 2;
+        } else {
+            out.push_back(s[i]);
+        }
+    }
+    return out;
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        char x = a[i], y = b[i];
+        if (x >= 'A' && x <= 'Z') x = static_cast<char>(x - 'A' + 'a');
+        if (y >= 'A' && y <= 'Z') y = static_cast<char>(y - 'A' + 'a');
+        if (x != y) return false;
+    }
+    return true;
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) s.remove_suffix(1);
+    return s;
+}
+
+enum class Parse { Incomplete, Done, Bad };
+
+// Parses the request at the front of `buf`; `used` is its size in bytes,
+// body included (bodies are skipped, only GET/HEAD are served).
+Parse parse_request(const std::string& buf, HttpRequest& req, size_t& used) {
+    const size_t end = buf.find("\r\n\r\n");
+    if (end == std::string::npos) return Parse::Incomplete;
+    std::string_view head(buf.data(), end);
+
+    size_t eol = head.find("\r\n");
+    std::string_view line = head.substr(0, eol);
+    size_t sp1 = line.find(' ');
+    size_t sp2 = (sp1 == std::string_view::npos) ? sp1 : line.find(' ', sp1 + 1);
+    if (sp2 == std::string_view::npos) return Parse::Bad;
+
+    req = HttpRequest{};
+    req.method = std::string(line.substr(0, sp1));
+    std::string_view target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    std::string_view version = line.substr(sp2 + 1);
+    req.keep_alive = (version == "HTTP/1.1");
+
+    size_t qmark = target.find('?');
+    req.path = url_decode(target.substr(0, qmark));
+    if (qmark != std::string_view::npos) {
+        std::string_view qs = target.substr(qmark + 1);
+        while (!qs.empty()) {
+            size_t amp = qs.find('&');
+            std::string_view kv = qs.substr(0, amp);
+            size_t eq = kv.find('=');
+            std::string key = url_decode(kv.substr(0, eq));
+            std::string val = (eq == std::string_view::npos) ? std::string() : url_decode(kv.substr(eq + 1));
+            if (!key.empty()) req.params.emplace(std::move(key), std::move(val));
+            if (amp == std::string_view::npos) break;
+            qs.remove_prefix(amp + 1);
+        }
+    }
+
+    size_t content_length = 0;
+    while (eol != std::string_view::npos) {
+        size_t next = head.find("\r\n", eol + 2);
+        std::string_view h = head.substr(eol + 2, next == std::string_view::npos ? std::string_view::npos : next - eol - 2);
+        eol = next;
+        size_t colon = h.find(':');
+        if (colon == std::string_view::npos) continue;
+        std::string_view name = trim(h.substr(0, colon));
+        std::string_view value = trim(h.substr(colon + 1));
+        if (iequals(name, "connection")) {
+            if (iequals(value, "close")) req.keep_alive = false;
+            else if (iequals(value, "keep-alive")) req.keep_alive = true;
+        } else if (iequals(name, "content-length")) {
+            content_length = 0;
+            for (char c : value) {
+                if (c < '0' || c > '9') return Parse::Bad;
+                content_length = content_length * 10 + (size_t)(c - '0');
+            }
+        }
+    }
+
+    if (buf.size() < end + 4 + content_length) return Parse::Incomplete;
+    used = end + 4 + content_length;
+    return Parse::Done;
+}
+
+std::string serialize(const HttpReply& r, bool keep_alive, bool head_only) {
+    std::string out;
+    out.reserve(128 + r.body.size());
+    out += "HTTP/1.1 " + std::to_string(r.status) + " " + reason_phrase(r.status) + "\r\n";
+    out += "Content-Type: " + r.content_type + "\r\n";
+    out += "Content-Length: " + std::to_string(r.body.size()) + "\r\n";
+    out += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    if (!head_only) out += r.body;
+    return out;
+}
+
+} // namespace
+
+EventServer::EventServer(EventServerOptions opt, HttpHandler handler)
+    : opt_(std::move(opt)), handler_(std::move(handler)) {
+    if (opt_.workers == 0) opt_.workers = std::max(1u, std::thread::hardware_concurrency());
+}
+
+#if defined(__linux__)
+
+namespace {
+
+struct Conn {
+    int fd = -1;
+    uint64_t gen = 0;               // tells a reused fd apart in completions
+    std::string addr;
+    std::string in;
+    std::string out;
+    size_t out_pos = 0;
+    bool busy = false;              // a request is with the workers
+    bool close_after = false;       // close once `out` is flushed
+    bool peer_closed = false;       // read side hit EOF
+    uint32_t events = EPOLLIN;      // currently registered with epoll
+    std::chrono::steady_clock::time_point last_active;
+};
+
+struct Completion {
+    int fd;
+    uint64_t gen;
+    std::string bytes;
+    bool close;
+};
+
+bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+} // namespace
+
+int EventServer::run() {
+    int lfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (lfd < 0) {
+        std::cerr << "socket: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    int one = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(opt_.port));
+    if (bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(lfd, SOMAXCONN) != 0 ||
+        !set_nonblocking(lfd)) {
+        std::cerr << "listen on port " << opt_.port << ": " << std::strerror(errno) << "\n";
+        ::close(lfd);
+        return 1;
+    }
+
+    const int epfd = epoll_create1(EPOLL_CLOEXEC);
+    const int evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epfd < 0 || evfd < 0) {
+        std::cerr << "epoll setup: " << std::strerror(errno) << "\n";
+        if (evfd >= 0) ::close(evfd);
+        if (epfd >= 0) ::close(epfd);
+        ::close(lfd);
+        return 1;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = lfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+    ev.data.fd = evfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, evfd, &ev);
+
+    std::atomic<size_t> queued{0};
+    std::mutex done_mu;
+    std::vector<Completion> done, draining;
+    // after the state its tasks use, so it is joined before that goes away
+    auto pool = std::make_unique<ThreadPool>(opt_.workers);
+
+    std::unordered_map<int, Conn> conns;
+    uint64_t next_gen = 0;
+    auto now = std::chrono::steady_clock::now();
+    auto last_sweep = now;
+
+    auto close_conn = [&](int fd) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        conns.erase(fd);
+    };
+
+    // a busy connection is not read: its next request waits in the socket
+    // until the answer is queued, so c.in never grows past one request
+    auto watch = [&](Conn& c) {
+        const uint32_t want = (c.peer_closed || c.busy ? 0u : (uint32_t)EPOLLIN) |
+                              (c.out_pos < c.out.size() ? (uint32_t)EPOLLOUT : 0u);
+        if (want == c.events) return;
+        epoll_event e{};
+        e.events = want;
+        e.data.fd = c.fd;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &e);
+        c.events = want;
+    };
+
+    // writes what it can; false if the connection is gone
+    auto flush = [&](Conn& c) {
+        while (c.out_pos < c.out.size()) {
+            ssize_t n = ::send(c.fd, c.out.data() + c.out_pos, c.out.size() - c.out_pos, MSG_NOSIGNAL);
+            if (n > 0) { c.out_pos += (size_t)n; continue; }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            close_conn(c.fd);
+            return false;
+        }
+        if (c.out_pos == c.out.size()) {
+            c.out.clear();
+            c.out_pos = 0;
+            if (c.close_after && !c.busy) { close_conn(c.fd); return false; }
+        }
+        watch(c);
+        return true;
+    };
+
+    auto reply_now = [&](Conn& c, int status, const std::string& body, bool keep_alive) {
+        HttpReply r;
+        r.status = status;
+        r.body = body;
+        c.out += serialize(r, keep_alive, false);
+        if (!keep_alive) c.close_after = true;
+    };
+
+    // hands the next complete request of `c` to the workers, one at a time
+    auto dispatch = [&](Conn& c) {
+        while (!c.busy && !c.close_after) {
+            HttpRequest req;
+            size_t used = 0;
+            Parse p = parse_request(c.in, req, used);
+            if (p == Parse::Incomplete) {
+                if (c.in.size() > opt_.max_request_bytes) reply_now(c, 413, "request too large\n", false);
+                else if (c.peer_closed) c.close_after = true; // answered everything it sent
+                break;
+            }
+            if (p == Parse::Bad) {
+                reply_now(c, 400, "bad request\n", false);
+                break;
+            }
+            c.in.erase(0, used);
+            req.remote_addr = c.addr;
+            stats_.requests.fetch_add(1, std::memory_order_relaxed);
+
+            if (req.method != "GET" && req.method != "HEAD") {
+                reply_now(c, 405, "only GET is served here\n", req.keep_alive);
+                continue;
+            }
+            if (queued.load(std::memory_order_relaxed) >= opt_.max_queue) {
+                stats_.rejected.fetch_add(1, std::memory_order_relaxed);
+                reply_now(c, 503, "server busy\n", req.keep_alive);
+                continue;
+            }
+
+            c.busy = true;
+            queued.fetch_add(1, std::memory_order_relaxed);
+            pool->submit([this, &queued, &done_mu, &done, evfd, fd = c.fd, gen = c.gen, req = std::move(req)] {
+                HttpReply r;
+                try {
+                    r = handler_(req);
+                } catch (const std::exception& e) {
+                    r.status = 500;
+                    r.body = std::string(e.what()) + "\n";
+                }
+                Completion comp{fd, gen, serialize(r, req.keep_alive, req.method == "HEAD"), !req.keep_alive};
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                {
+                    std::lock_guard<std::mutex> lk(done_mu);
+                    done.push_back(std::move(comp));
+                }
+                uint64_t one = 1;
+                ssize_t w = ::write(evfd, &one, sizeof(one));
+                (void)w;
+            });
+        }
+        return flush(c);
+    };
+
+    std::vector<epoll_event> events(256);
+    char buf[16384];
+    while (true) {
+        int n = epoll_wait(epfd, events.data(), (int)events.size(), 1000);
+        if (n < 0 && errno != EINTR) {
+            std::cerr << "epoll_wait: " << std::strerror(errno) << "\n";
+            break;
+        }
+        now = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < n; ++i) {
+            const int fd = events[i].data.fd;
+            const uint32_t what = events[i].events;
+
+            if (fd == lfd) {
+                while (true) {
+                    sockaddr_in peer{};
+                    socklen_t plen = sizeof(peer);
+                    int cfd = accept4(lfd, reinterpret_cast<sockaddr*>(&peer), &plen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (cfd < 0) break;
+                    char ip[INET_ADDRSTRLEN] = {0};
+                    inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip));
+                    setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    Conn& c = conns[cfd];
+                    c = Conn{};
+                    c.fd = cfd;
+                    c.gen = ++next_gen;
+                    c.addr = ip;
+                    c.last_active = now;
+                    epoll_event e{};
+                    e.events = EPOLLIN;
+                    e.data.fd = cfd;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &e);
+                    stats_.connections.fetch_add(1, std::memory_order_relaxed);
+                }
+                continue;
+            }
+
+            if (fd == evfd) {
+                uint64_t cnt;
+                ssize_t r = ::read(evfd, &cnt, sizeof(cnt));
+                (void)r;
+                {
+                    std::lock_guard<std::mutex> lk(done_mu);
+                    draining.swap(done);
+                }
+                for (Completion& comp : draining) {
+                    auto it = conns.find(comp.fd);
+                    if (it == conns.end() || it->second.gen != comp.gen) continue; // client went away
+                    Conn& c = it->second;
+                    c.busy = false;
+                    c.last_active = now;
+                    c.out += comp.bytes;
+                    if (comp.close) c.close_after = true;
+                    dispatch(c); // answers pipelined requests and flushes
+                }
+                draining.clear();
+                continue;
+            }
+
+            auto it = conns.find(fd);
+            if (it == conns.end()) continue;
+            Conn& c = it->second;
+            c.last_active = now;
+
+            if (what & (EPOLLERR | EPOLLHUP)) {
+                close_conn(fd);
+                continue;
+            }
+            if (what & EPOLLOUT) {
+                if (!flush(c)) continue;
+            }
+            if (what & EPOLLIN) {
+                // stops at max_request_bytes; dispatch() answers 413 if no request is complete by then
+                while (c.in.size() <= opt_.max_request_bytes) {
+                    ssize_t r = ::recv(fd, buf, sizeof(buf), 0);
+                    if (r > 0) { c.in.append(buf, (size_t)r); continue; }
+                    if (r < 0 && errno == EINTR) continue;
+                    if (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) c.peer_closed = true;
+                    break;
+                }
+                dispatch(c); // after EOF watch() stops polling the read side
+            }
+        }
+
+        if (now - last_sweep >= std::chrono::seconds(1)) {
+            last_sweep = now;
+            const auto idle = std::chrono::milliseconds(opt_.idle_timeout_ms);
+            std::vector<int> stale;
+            for (auto& [fd, c] : conns) {
+                if (!c.busy && c.out.empty() && now - c.last_active > idle) stale.push_back(fd);
+            }
+            for (int fd : stale) close_conn(fd);
+        }
+    }
+
+    pool.reset();   // joined first: its tasks write to evfd
+    for (auto& [fd, c] : conns) ::close(fd);
+    ::close(evfd);
+    ::close(epfd);
+    ::close(lfd);
+    return 1;
+}
+
+#else
+
+int EventServer::run() {
+    std::cerr << "The event-driven server needs Linux (epoll)\n";
+    return 1;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    std::unordered_map<std::string, std::string> params;   // decoded query string
+    std::string remote_addr;
+    bool keep_alive = true;
+
+    std::string param(const std::string& name, const std::string& def = "") const {
+        auto it = params.find(name);
+        return it == params.end() ? def : it->second;
+    }
+};
+
+struct HttpReply {
+    int status = 200;
+    std::string content_type = "text/plain";
+    std::string body;
+};
+
+using HttpHandler = std::function<HttpReply(const HttpRequest&)>;
+
+struct EventServerOptions {
+    int port = 8080;
+    size_t workers = 0;               // 0 = hardware concurrency
+    size_t max_queue = 1024;          // requests waiting for a worker; beyond it -> 503
+    size_t max_request_bytes = 64 << 10;
+    int idle_timeout_ms = 30000;      // keep-alive connections idle this long are closed
+};
+
+struct EventServerStats {
+    std::atomic<uint64_t> connections{0};
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> rejected{0};  // answered 503 because the queue was full
+};
+
+// HTTP/1.1 front end on one epoll loop (Linux). The loop only accepts,
+// reads, parses and writes; requests run on a fixed worker pool and their
+// replies are handed back to the loop through an eventfd. Connections are
+// kept alive and pipelined requests are answered in order, one at a time.
+class EventServer {
+public:
+    EventServer(EventServerOptions opt, HttpHandler handler);
+
+    // Blocks serving; returns non-zero if the socket could not be set up.
+    int run();
+
+    const EventServerStats& stats() const { return stats_; }
+
+private:
+    EventServerOptions opt_;
+    HttpHandler handler_;
+    EventServerStats stats_;
+};
@@ -0,0 +1,213 @@
+#include "json.hpp"
+#include <cstdlib>
+#include <stdexcept>
+
+namespace json {
+
+std::string escape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size() + 8);
+    for (unsigned char c : s) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    static const char* hex = "0123456789abcdef";
+                    out += "\\u00";
+                    out.push_back(hex[c >> 4]);
+                    out.push_back(hex[c & 15]);
+                } else {
+                    out.push_back(static_cast<char>(c));
+                }
+        }
+    }
+    return out;
+}
+
+void append_string(std::string& out, const std::string& s) {
+    out.push_back('"');
+    out += escape(s);
+    out.push_back('"');
+}
+
+const Value* Value::get(const std::string& key) const {
+    for (const auto& kv : object) {
+        if (kv.first == key) return &kv.second;
+    }
+    return nullptr;
+}
+
+namespace {
+
+class Parser {
+public:
+    explicit Parser(const std::string& s) : s_(s) {}
+
+    Value parseDocument() {
+        Value v = parseValue_();
+        skipWs_();
+        if (i_ != s_.size()) fail_("trailing characters");
+        return v;
+    }
+
+private:
+    const std::string& s_;
+    size_t i_ = 0;
+    int depth_ = 0;
+
+    [[noreturn]] void fail_(const char* what) const {
+        throw std::runtime_error(std::string("JSON parse error: ") + what + " at offset " + std::to_string(i_));
+    }
+
+    void skipWs_() {
+        while (i_ < s_.size() && (s_[i_] == ' ' || s_[i_] == '\n' || s_[i_] == '\r' || s_[i_] == '\t')) ++i_;
+    }
+
+    bool consume_(const char* lit) {
+        size_t n = 0;
+        while (lit[n]) ++n;
+        if (s_.compare(i_, n, lit) != 0) return false;
+        i_ += n;
+        return true;
+    }
+
+    Value parseValue_() {
+        skipWs_();
+        if (i_ >= s_.size()) fail_("unexpected end");
+        if (++depth_ > 64) fail_("nesting too deep");
+
+        Value v;
+        char c = s_[i_];
+        if (c == '{') parseObject_(v);
+        else if (c == '[') parseArray_(v);
+        else if (c == '"') { v.type = Value::Type::String; v.string = parseString_(); }
+        else if (consume_("true")) { v.type = Value::Type::Bool; v.boolean = true; }
+        else if (consume_("false")) { v.type = Value::Type::Bool; v.boolean = false; }
+        else if (consume_("null")) { v.type = Value::Type::Null; }
+        else parseNumber_(v);
+
+        --depth_;
+        return v;
+    }
+
+    void parseObject_(Value& v) {
+        v.type = Value::Type::Object;
+        ++i_;
+        skipWs_();
+        if (i_ < s_.size() && s_[i_] == '}') { ++i_; return; }
+        while (true) {
+            skipWs_();
+            if (i_ >= s_.size() || s_[i_] != '"') fail_("expected key");
+            std::string key = parseString_();
+            skipWs_();
+            if (i_ >= s_.size() || s_[i_] != ':') fail_("expected ':'");
+            ++i_;
+            v.object.emplace_back(std::move(key), parseValue_());
+            skipWs_();
+            if (i_ < s_.size() && s_[i_] == ',') { ++i_; continue; }
+            if (i_ < s_.size() && s_[i_] == '}') { ++i_; return; }
+            fail_("expected ',' or '}'");
+        }
+    }
+
+    void parseArray_(Value& v) {
+        v.type = Value::Type::Array;
+        ++i_;
+        skipWs_();
+        if (i_ < s_.size() && s_[i_] == ']') { ++i_; return; }
+        while (true) {
+            v.array.push_back(parseValue_());
+            skipWs_();
+            if (i_ < s_.size() && s_[i_] == ',') { ++i_; continue; }
+            if (i_ < s_.size() && s_[i_] == ']') { ++i_; return; }
+            fail_("expected ',' or ']'");
+        }
+    }
+
+    void parseNumber_(Value& v) {
+        const char* begin = s_.c_str() + i_;
+        char* end = nullptr;
+        v.number = std::strtod(begin, &end);
+        if (end == begin) fail_("unexpected character");
+        v.type = Value::Type::Number;
+        i_ += static_cast<size_t>(end - begin);
+    }
+
+    static void appendUtf8_(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out.push_back(static_cast<char>(cp));
+        } else if (cp < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    uint32_t parseHex4_() {
+        if (i_ + 4 > s_.size()) fail_("short \\u escape");
+        uint32_t v = 0;
+        for (int k = 0; k < 4; ++k) {
+            char h = s_[i_++];
+            v <<= 4;
+            if (h >= '0' && h <= '9') v |= (uint32_t)(h - '0');
+            else if (h >= 'a' && h <= 'f') v |= (uint32_t)(h - 'a' + 10);
+            else if (h >= 'A' && h <= 'F') v |= (uint32_t)(h - 'A' + 10);
+            else fail_("bad \\u escape");
+        }
+        return v;
+    }
+
+    std::string parseString_() {
+        std::string out;
+        ++i_; // opening quote
+        while (i_ < s_.size()) {
+            char c = s_[i_++];
+            if (c == '"') return out;
+            if (c != '\\') { out.push_back(c); continue; }
+            if (i_ >= s_.size()) break;
+            char e = s_[i_++];
+            switch (e) {
+                case '"': out.push_back('"'); break;
+                case '\\': out.push_back('\\'); break;
+                case '/': out.push_back('/'); break;
+                case 'b': out.push_back('\b'); break;
+                case 'f': out.push_back('\f'); break;
+                case 'n': out.push_back('\n'); break;
+                case 'r': out.push_back('\r'); break;
+                case 't': out.push_back('\t'); break;
+                case 'u': {
+                    uint32_t cp = parseHex4_();
+                    if (cp >= 0xD800 && cp <= 0xDBFF && i_ + 6 <= s_.size() && s_[i_] == '\\' && s_[i_ + 1] == 'u') {
+                        i_ += 2;
+                        uint32_t lo = parseHex4_();
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    }
+                    appendUtf8_(out, cp);
+                    break;
+                }
+                default: fail_("bad escape");
+            }
+        }
+        fail_("unterminated string");
+    }
+};
+
+} // namespace
+
+Value parse(const std::string& text) {
+    return Parser(text).parseDocument();
+}
+
+} // namespace json
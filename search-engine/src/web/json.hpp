@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal JSON support for the engine's own HTTP API: escaping for the
+// writers, and a small reader used by the shard coordinator.
+namespace json {
+
+std::string escape(const std::string& s);
+
+// appends "s" (quoted and escaped)
+void append_string(std::string& out, const std::string& s);
+
+struct Value {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<Value> array;
+    std::vector<std::pair<std::string, Value>> object;
+
+    const Value* get(const std::string& key) const;
+    bool isNull() const { return type == Type::Null; }
+};
+
+// throws std::runtime_error on malformed input
+Value parse(const std::string& text);
+
+} // namespace json
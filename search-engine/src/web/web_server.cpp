@@ -1,4 +1,11 @@
 #include "web_server.hpp"
+#include "json.hpp"
+#include "admission.hpp"
+#include "../search/boolean_query_parser.hpp"
+#include "../structures/single_flight.hpp"
+#include <algorithm>
+#include <cctype>
+#include <functional>
 #include <sstream>
 
 #include <httplib.h>
@@ -19,7 +26,40 @@ static std::string html_escape(const std::string& s) {
     return out;
 }
 
-static std::string render_page(const std::string& q, const std::vector<SearchResult>& results) {
+static std::string url_encode(const std::string& s) {
+    static const char* hex = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : s) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            out.push_back(static_cast<char>(c));
+        } else {
+            out.push_back('%');
+            out.push_back(hex[c >> 4]);
+            out.push_back(hex[c & 15]);
+        }
+    }
+    return out;
+}
+
+// `limit` 0 only counts the matches; `facets`: top hosts to count (0 = none);
+// `client` is the remote address, for per-client admission control
+using SearchFn = std::function<SearchResponse(const std::string& q, size_t limit, size_t facets,
+                                              const std::string& client)>;
+
+// /api/search?explain=1 on engine servers: the search response with an
+// "explain" member; never coalesced
+using ExplainFn = std::function<std::string(const std::string& q, size_t limit, size_t facets,
+                                            const std::string& client)>;
+
+constexpr size_t kPageFacets = 10;
+
+static int error_status(const std::exception& e) {
+    if (auto* r = dynamic_cast<const QueryRejected*>(&e)) return r->retryable() ? 429 : 422;
+    return 400;
+}
+
+static std::string render_page(const std::string& q, const SearchResponse& resp) {
+    const auto& results = resp.results;
     std::ostringstream oss;
     oss << "<!doctype html><html><head><meta charset='utf-8'>"
         << "<title>Search Engine</title>"
@@ -39,7 +79,22 @@ static std::string render_page(const std::string& q, const std::vector<SearchRes
         << "</form>";
 
     if (!q.empty()) {
-        oss << "<p>Query: <b>" << html_escape(q) << "</b> | Found: <b>" << results.size() << "</b></p>";
+        oss << "<p>Query: <b>" << html_escape(q) << "</b> | Found: <b>" << resp.total << "</b>";
+        if (results.size() < resp.total) oss << " (showing " << results.size() << ")";
+        oss << "</p>";
+        if (resp.partial) {
+            oss << "<p style='color:#b00'>Partial results:";
+            for (const auto& e : resp.errors) oss << " " << html_escape(e) << ";";
+            oss << "</p>";
+        }
+        if (!resp.hosts.empty()) {
+            oss << "<p>Sites:";
+            for (const auto& f : resp.hosts) {
+                oss << " <a href='/search?q=" << html_escape(url_encode("(" + q + ") AND site:" + f.value)) << "'>"
+                    << html_escape(f.value) << "</a> (" << f.count << ")";
+            }
+            oss << "</p>";
+        }
         for (const auto& r : results) {
             oss << "<div class='res'>"
                 << "<div class='url'><a href='" << html_escape(r.url) << "' target='_blank'>"
@@ -49,32 +104,442 @@ static std::string render_page(const std::string& q, const std::vector<SearchRes
         }
     }
 
-    oss << "<hr><p style='color:#666'>Operators: AND OR NOT, parentheses (), phrases \"like this\"</p>";
+    oss << "<hr><p style='color:#666'>Operators: AND OR NOT, NEAR/k, parentheses (), phrases \"like this\", "
+        << "site:host, after:YYYY-MM-DD, before:YYYY-MM-DD</p>";
     oss << "</body></html>";
     return oss.str();
 }
 
-int WebServer::run(SearchEngine& engine, int port) {
-    httplib::Server svr;
+static void append_response_json(std::string& out, const std::string& q, const SearchResponse& resp) {
+    out += "{\"query\":";
+    json::append_string(out, q);
+    out += ",\"total\":" + std::to_string(resp.total);
+    out += ",\"partial\":";
+    out += resp.partial ? "true" : "false";
+    out += ",\"errors\":[";
+    for (size_t i = 0; i < resp.errors.size(); ++i) {
+        if (i) out.push_back(',');
+        json::append_string(out, resp.errors[i]);
+    }
+    out += "],\"results\":[";
+    for (size_t i = 0; i < resp.results.size(); ++i) {
+        const auto& r = resp.results[i];
+        if (i) out.push_back(',');
+        out += "{\"id\":" + std::to_string(r.global_id) + ",\"url\":";
+        json::append_string(out, r.url);
+        out += ",\"snippet\":";
+        json::append_string(out, r.snippet);
+        out.push_back('}');
+    }
+    out.push_back(']');
+    if (!resp.hosts.empty()) {
+        out += ",\"facets\":{\"host\":[";
+        for (size_t i = 0; i < resp.hosts.size(); ++i) {
+            if (i) out.push_back(',');
+            out += "{\"value\":";
+            json::append_string(out, resp.hosts[i].value);
+            out += ",\"count\":" + std::to_string(resp.hosts[i].count) + "}";
+        }
+        out += "]}";
+    }
+    out.push_back('}');
+}
 
-    svr.Get("/", [&](const httplib::Request&, httplib::Response& res) {
+static std::string render_json(const std::string& q, const SearchResponse& resp) {
+    std::string out;
+    out.reserve(256 + resp.results.size() * 256);
+    append_response_json(out, q, resp);
+    return out;
+}
+
+static void append_explain_json(std::string& out, const QueryExplain& ex) {
+    out += "{\"rpn\":";
+    json::append_string(out, ex.rpn);
+    out += ",\"plan_ns\":" + std::to_string(ex.plan_nanos) + ",\"eval_ns\":" + std::to_string(ex.eval_nanos) +
+           ",\"collect_ns\":" + std::to_string(ex.collect_nanos) +
+           ",\"alloc_bytes\":" + std::to_string(ex.alloc_bytes) +
+           ",\"alloc_calls\":" + std::to_string(ex.alloc_calls) + ",\"root\":" + std::to_string(ex.root) +
+           ",\"nodes\":[";
+    for (size_t i = 0; i < ex.nodes.size(); ++i) {
+        const ExplainNode& n = ex.nodes[i];
+        if (i) out.push_back(',');
+        out += "{\"label\":";
+        json::append_string(out, n.label);
+        out += ",\"lhs\":" + std::to_string(n.lhs) + ",\"rhs\":" + std::to_string(n.rhs) + ",\"args\":[";
+        for (size_t a = 0; a < n.args.size(); ++a) out += (a ? "," : "") + std::to_string(n.args[a]);
+        out += "],\"out\":" + std::to_string(n.out) + ",\"ns\":" + std::to_string(n.nanos) +
+               ",\"alloc_bytes\":" + std::to_string(n.alloc_bytes) + "}";
+    }
+    out += "],\"text\":";
+    json::append_string(out, ex.toText());
+    out.push_back('}');
+}
+
+static size_t parse_limit(const std::string& value, size_t def) {
+    try {
+        long v = std::stol(value);
+        if (v >= 0) return static_cast<size_t>(std::min<long>(v, 10000));
+    } catch (const std::exception&) {}
+    return def;
+}
+
+static size_t param_limit(const httplib::Request& req, size_t def, const char* name = "limit") {
+    if (!req.has_param(name)) return def;
+    return parse_limit(req.get_param_value(name), def);
+}
+
+static void install_search_routes(httplib::Server& svr, SearchFn search, ExplainFn explain = nullptr) {
+    svr.Get("/", [](const httplib::Request&, httplib::Response& res) {
         res.set_content(render_page("", {}), "text/html; charset=utf-8");
     });
 
-    svr.Get("/search", [&](const httplib::Request& req, httplib::Response& res) {
+    svr.Get("/search", [search](const httplib::Request& req, httplib::Response& res) {
         std::string q;
         if (req.has_param("q")) q = req.get_param_value("q");
-        std::vector<SearchResult> results;
         try {
-            results = engine.search(q, 50);
-            res.set_content(render_page(q, results), "text/html; charset=utf-8");
+            SearchResponse resp = search(q, 50, kPageFacets, req.remote_addr);
+            res.set_content(render_page(q, resp), "text/html; charset=utf-8");
         } catch (const std::exception& e) {
             std::string msg = std::string("<pre>Error: ") + html_escape(e.what()) + "</pre>";
-            res.status = 400;
+            res.status = error_status(e);
             res.set_content(render_page(q, {}) + msg, "text/html; charset=utf-8");
         }
     });
 
+    // JSON API; also the protocol between ShardCoordinator and its shards
+    svr.Get("/api/search", [search, explain](const httplib::Request& req, httplib::Response& res) {
+        std::string q;
+        if (req.has_param("q")) q = req.get_param_value("q");
+        try {
+            const size_t limit = param_limit(req, 50), facets = param_limit(req, 0, "facets");
+            if (explain && param_limit(req, 0, "explain")) {
+                res.set_content(explain(q, limit, facets, req.remote_addr), "application/json");
+                return;
+            }
+            SearchResponse resp = search(q, limit, facets, req.remote_addr);
+            res.set_content(render_json(q, resp), "application/json");
+        } catch (const std::exception& e) {
+            res.status = error_status(e);
+            res.set_content("{\"error\":\"" + json::escape(e.what()) + "\"}", "application/json");
+        }
+    });
+
+    svr.Get("/api/count", [search](const httplib::Request& req, httplib::Response& res) {
+        std::string q;
+        if (req.has_param("q")) q = req.get_param_value("q");
+        try {
+            res.set_content(render_json(q, search(q, 0, 0, req.remote_addr)), "application/json");
+        } catch (const std::exception& e) {
+            res.status = error_status(e);
+            res.set_content("{\"error\":\"" + json::escape(e.what()) + "\"}", "application/json");
+        }
+    });
+}
+
+// /suggest?prefix=...&k=...
+using SuggestFn = std::function<std::string(const std::string& prefix, size_t k)>;
+
+// /similar?url=...&k=...
+using SimilarFn = std::function<std::string(const std::string& url, size_t k)>;
+
+// /debug/slow-queries, /debug/memory
+using DebugFn = std::function<std::string()>;
+
+// Routes only a server over a local engine has.
+struct EngineRoutes {
+    SuggestFn suggest;
+    ExplainFn explain;
+    SimilarFn similar;
+    DebugFn slow_queries;
+    DebugFn memory;
+};
+
+static SuggestFn engine_suggest(const SearchEngine& engine) {
+    return [&engine](const std::string& prefix, size_t k) {
+        Suggestion found[CompletionTrie::kTopK];
+        const size_t n = engine.suggest(prefix, found, k);
+        std::string out = "{\"prefix\":";
+        json::append_string(out, prefix);
+        out += ",\"suggestions\":[";
+        for (size_t i = 0; i < n; ++i) {
+            if (i) out.push_back(',');
+            out += "{\"term\":";
+            json::append_string(out, std::string(found[i].term));
+            out += ",\"df\":" + std::to_string(found[i].df) + "}";
+        }
+        out += "]}";
+        return out;
+    };
+}
+
+static void admit(const SearchEngine& engine, Admission& admission, const std::string& q,
+                  const std::string& client, Admission::Ticket& ticket) {
+    if (admission.enabled() && admission.expensive(engine.estimateQueryCost(q)) &&
+        !admission.tryAcquire(client, ticket)) {
+        throw QueryRejected("Too many expensive queries running; try again later", true);
+    }
+}
+
+// A batch takes one slot for its whole run, charged with the summed cost of
+// its queries; queries that do not parse cost nothing and fail on their own.
+static void admit_batch(const SearchEngine& engine, Admission& admission, const std::vector<std::string>& queries,
+                        const std::string& client, Admission::Ticket& ticket) {
+    if (!admission.enabled()) return;
+    uint64_t cost = 0;
+    for (const auto& q : queries) {
+        try {
+            cost += engine.estimateQueryCost(q);
+        } catch (const std::exception&) {}
+    }
+    if (admission.expensive(cost) && !admission.tryAcquire(client, ticket)) {
+        throw QueryRejected("Too many expensive queries running; try again later", true);
+    }
+}
+
+// Runs queries under the engine's budget; expensive ones need an admission slot.
+static SearchFn engine_search(SearchEngine& engine, std::shared_ptr<Admission> admission) {
+    return [&engine, admission](const std::string& q, size_t limit, size_t facets, const std::string& client) {
+        Admission::Ticket ticket;
+        admit(engine, *admission, q, client, ticket);
+        if (limit == 0 && facets == 0) {
+            SearchResponse resp;
+            resp.total = engine.count(q);
+            return resp;
+        }
+        return engine.execute(q, limit, facets);
+    };
+}
+
+static EngineRoutes engine_routes(SearchEngine& engine, std::shared_ptr<Admission> admission) {
+    EngineRoutes r;
+    r.suggest = engine_suggest(engine);
+    r.explain = [&engine, admission](const std::string& q, size_t limit, size_t facets, const std::string& client) {
+        Admission::Ticket ticket;
+        admit(engine, *admission, q, client, ticket);
+        QueryExplain ex;
+        std::string out = render_json(q, engine.execute(q, limit, facets, &ex));
+        out.pop_back();
+        out += ",\"explain\":";
+        append_explain_json(out, ex);
+        out.push_back('}');
+        return out;
+    };
+    r.slow_queries = [&engine]() -> std::string {
+        const SlowQueryLog* log = engine.slowQueryLog();
+        if (!log) return "{\"error\":\"slow-query log is off (--slow-query-ms)\"}";
+        std::string out = "{\"threshold_ms\":" + std::to_string(log->thresholdMs()) +
+                          ",\"recorded\":" + std::to_string(log->recorded()) + ",\"queries\":[";
+        const std::vector<SlowQuery> queries = log->snapshot();
+        for (size_t i = 0; i < queries.size(); ++i) {
+            if (i) out.push_back(',');
+            out += "{\"query\":";
+            json::append_string(out, queries[i].query);
+            out += ",\"unix_ms\":" + std::to_string(queries[i].unix_ms) +
+                   ",\"total_ns\":" + std::to_string(queries[i].explain.totalNanos()) + ",\"explain\":";
+            append_explain_json(out, queries[i].explain);
+            out.push_back('}');
+        }
+        out += "]}";
+        return out;
+    };
+    r.similar = [&engine](const std::string& url, size_t k) {
+        std::string out = "{\"url\":";
+        json::append_string(out, url);
+        out += ",\"results\":[";
+        const std::vector<SimilarDoc> found = engine.similar(url, k);
+        for (size_t i = 0; i < found.size(); ++i) {
+            if (i) out.push_back(',');
+            out += "{\"url\":";
+            json::append_string(out, found[i].result.url);
+            out += ",\"snippet\":";
+            json::append_string(out, found[i].result.snippet);
+            out += ",\"score\":" + std::to_string(found[i].score) + "}";
+        }
+        out += "]}";
+        return out;
+    };
+    r.memory = [&engine]() { return engine.memoryReport().toJson(); };
+    return r;
+}
+
+int WebServer::run(SearchEngine& engine, int port, const AdmissionOptions& adm) {
+    httplib::Server svr;
+
+    auto admission = std::make_shared<Admission>(adm);
+    const EngineRoutes routes = engine_routes(engine, admission);
+    install_search_routes(svr, engine_search(engine, admission), routes.explain);
+
+    svr.Get("/suggest", [suggest = routes.suggest](const httplib::Request& req, httplib::Response& res) {
+        const std::string prefix = req.has_param("prefix") ? req.get_param_value("prefix") : "";
+        res.set_content(suggest(prefix, param_limit(req, CompletionTrie::kTopK, "k")), "application/json");
+    });
+
+    svr.Get("/similar", [similar = routes.similar](const httplib::Request& req, httplib::Response& res) {
+        try {
+            res.set_content(similar(req.has_param("url") ? req.get_param_value("url") : "", param_limit(req, 10, "k")),
+                            "application/json");
+        } catch (const std::exception& e) {
+            res.status = error_status(e);
+            res.set_content("{\"error\":\"" + json::escape(e.what()) + "\"}", "application/json");
+        }
+    });
+
+    svr.Get("/debug/slow-queries", [slow = routes.slow_queries](const httplib::Request&, httplib::Response& res) {
+        res.set_content(slow(), "application/json");
+    });
+
+    svr.Get("/debug/memory", [memory = routes.memory](const httplib::Request&, httplib::Response& res) {
+        res.set_content(memory(), "application/json");
+    });
+
+    // Batch API: one query per line in the body; answers are streamed as
+    // NDJSON in input order while the rest of the batch is still running.
+    svr.Post("/api/batch", [&engine, admission](const httplib::Request& req, httplib::Response& res) {
+        auto queries = std::make_shared<std::vector<std::string>>();
+        size_t pos = 0;
+        while (pos < req.body.size()) {
+            size_t nl = req.body.find('\n', pos);
+            if (nl == std::string::npos) nl = req.body.size();
+            std::string q = req.body.substr(pos, nl - pos);
+            if (!q.empty() && q.back() == '\r') q.pop_back();
+            if (!q.empty()) queries->push_back(std::move(q));
+            pos = nl + 1;
+        }
+        const size_t limit = param_limit(req, 50);
+
+        // held until the last answer is streamed
+        auto ticket = std::make_shared<Admission::Ticket>();
+        try {
+            admit_batch(engine, *admission, *queries, req.remote_addr, *ticket);
+        } catch (const std::exception& e) {
+            res.status = error_status(e);
+            res.set_content("{\"error\":\"" + json::escape(e.what()) + "\"}", "application/json");
+            return;
+        }
+
+        res.set_chunked_content_provider("application/x-ndjson",
+            [&engine, queries, limit, ticket](size_t, httplib::DataSink& sink) {
+                engine.searchBatch(*queries, limit, [&sink](size_t index, const BatchItem& item) {
+                    std::string line = "{\"index\":" + std::to_string(index) + ",";
+                    if (!item.error.empty()) {
+                        line += "\"query\":";
+                        json::append_string(line, item.query);
+                        line += ",\"error\":";
+                        json::append_string(line, item.error);
+                        line += "}";
+                    } else {
+                        std::string body;
+                        append_response_json(body, item.query, item.response);
+                        line.append(body, 1, std::string::npos); // splice into the same object
+                    }
+                    line.push_back('\n');
+                    sink.write(line.data(), line.size());
+                });
+                sink.done();
+                ticket->release();
+                return true;
+            });
+    });
+
     // listen
     return svr.listen("0.0.0.0", port) ? 0 : 1;
 }
+
+// Same routes as install_search_routes on the event-driven server, plus
+// /api/stats and the engine routes that are set. Searches go through a
+// SingleFlight keyed by canonical query.
+static int run_evented(SearchFn search, const EventServerOptions& opt, EngineRoutes engine = {}) {
+    auto flights = std::make_shared<SingleFlight<SearchResponse>>();
+    EventServer* server = nullptr;
+
+    // waiters on a coalesced query take no admission slot of their own
+    auto coalesced = [search, flights](const std::string& q, size_t limit, size_t facets, const std::string& client) {
+        const std::string key = BooleanQueryParser::canonical(q) + "\n" + std::to_string(limit) + "\n" +
+                                std::to_string(facets);
+        return flights->run(key, [&] { return search(q, limit, facets, client); });
+    };
+
+    EventServer svr(opt, [&server, coalesced, flights, engine](const HttpRequest& req) {
+        HttpReply rep;
+        const std::string q = req.param("q");
+        if (req.path == "/") {
+            rep.content_type = "text/html; charset=utf-8";
+            rep.body = render_page("", {});
+        } else if (req.path == "/search") {
+            rep.content_type = "text/html; charset=utf-8";
+            try {
+                rep.body = render_page(q, *coalesced(q, 50, kPageFacets, req.remote_addr));
+            } catch (const std::exception& e) {
+                rep.status = error_status(e);
+                rep.body = render_page(q, {}) + "<pre>Error: " + html_escape(e.what()) + "</pre>";
+            }
+        } else if (req.path == "/api/search" || req.path == "/api/count") {
+            const bool count = req.path == "/api/count";
+            const size_t limit = count ? 0 : parse_limit(req.param("limit"), 50);
+            const size_t facets = count ? 0 : parse_limit(req.param("facets"), 0);
+            rep.content_type = "application/json";
+            try {
+                if (!count && engine.explain && parse_limit(req.param("explain"), 0)) {
+                    rep.body = engine.explain(q, limit, facets, req.remote_addr);
+                } else {
+                    rep.body = render_json(q, *coalesced(q, limit, facets, req.remote_addr));
+                }
+            } catch (const std::exception& e) {
+                rep.status = error_status(e);
+                rep.body = "{\"error\":\"" + json::escape(e.what()) + "\"}";
+            }
+        } else if (req.path == "/suggest" && engine.suggest) {
+            rep.content_type = "application/json";
+            rep.body = engine.suggest(req.param("prefix"), parse_limit(req.param("k"), CompletionTrie::kTopK));
+        } else if (req.path == "/similar" && engine.similar) {
+            rep.content_type = "application/json";
+            try {
+                rep.body = engine.similar(req.param("url"), parse_limit(req.param("k"), 10));
+            } catch (const std::exception& e) {
+                rep.status = error_status(e);
+                rep.body = "{\"error\":\"" + json::escape(e.what()) + "\"}";
+            }
+        } else if (req.path == "/debug/slow-queries" && engine.slow_queries) {
+            rep.content_type = "application/json";
+            rep.body = engine.slow_queries();
+        } else if (req.path == "/debug/memory" && engine.memory) {
+            rep.content_type = "application/json";
+            rep.body = engine.memory();
+        } else if (req.path == "/api/stats") {
+            const EventServerStats& st = server->stats();
+            rep.content_type = "application/json";
+            rep.body = "{\"connections\":" + std::to_string(st.connections.load()) +
+                       ",\"requests\":" + std::to_string(st.requests.load()) +
+                       ",\"rejected\":" + std::to_string(st.rejected.load()) +
+                       ",\"evaluations\":" + std::to_string(flights->leaders()) +
+                       ",\"coalesced\":" + std::to_string(flights->followers()) + "}";
+        } else {
+            rep.status = 404;
+            rep.body = "not found\n";
+        }
+        return rep;
+    });
+    server = &svr;
+    return svr.run();
+}
+
+int WebServer::runEvented(SearchEngine& engine, const EventServerOptions& opt, const AdmissionOptions& adm) {
+    auto admission = std::make_shared<Admission>(adm);
+    return run_evented(engine_search(engine, admission), opt, engine_routes(engine, admission));
+}
+
+int WebServer::runEvented(ShardCoordinator& coordinator, const EventServerOptions& opt) {
+    return run_evented([&coordinator](const std::string& q, size_t limit, size_t facets, const std::string&) {
+        return coordinator.search(q, limit, facets);
+    }, opt);
+}
+
+int WebServer::run(ShardCoordinator& coordinator, int port) {
+    httplib::Server svr;
+
+    install_search_routes(svr, [&coordinator](const std::string& q, size_t limit, size_t facets, const std::string&) {
+        return coordinator.search(q, limit, facets);
+    });
+
+    return svr.listen("0.0.0.0", port) ? 0 : 1;
+}
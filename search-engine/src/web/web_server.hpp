@@ -1,8 +1,18 @@
 #pragma once
 #include <string>
 #include "../search/search_engine.hpp"
+#include "../coordinator/shard_coordinator.hpp"
+#include "event_server.hpp"
+#include "admission.hpp"
 
 class WebServer {
 public:
-    static int run(SearchEngine& engine, int port);
+    static int run(SearchEngine& engine, int port, const AdmissionOptions& adm = {});
+    static int run(ShardCoordinator& coordinator, int port);
+
+    // epoll front end with a bounded worker queue; concurrent requests for the
+    // same canonical query share one evaluation
+    static int runEvented(SearchEngine& engine, const EventServerOptions& opt,
+                          const AdmissionOptions& adm = {});
+    static int runEvented(ShardCoordinator& coordinator, const EventServerOptions& opt);
 };